@@ -1,8 +1,28 @@
+import gzip
+import hashlib
+import re
 from pathlib import Path
 
-FILES = {
-    "main": "html/main.html",
+# Every file in this directory is embedded in the firmware. "main.html" is
+# served at "/", everything else at "/<file name>".
+HTML_DIR = "html"
+INDEX_PAGE = "main.html"
+OUTPUT = "src/html/html.h"
+
+MIME_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".txt": "text/plain",
+    ".ico": "image/x-icon",
+    ".png": "image/png",
 }
+DEFAULT_MIME_TYPE = "application/octet-stream"
+
+# Only these are minified, everything else is embedded as is.
+MINIFIED_TYPES = (".html", ".css", ".js")
 
 MAIN_TEMPLATE = """
 #ifndef __HTML_H__
@@ -12,29 +32,145 @@ MAIN_TEMPLATE = """
 
 /* This file is automatically generated by gen_html.py */
 
+struct HtmlPage {
+  const char *path;
+  const char *mime_type;
+  const char *etag;
+  // gzip compressed page content, stored in PROGMEM
+  const uint8_t *content;
+  size_t length;
+};
+
 %(content)s
 
+extern const HtmlPage HTML_PAGES[] = {
+%(pages)s
+};
+
+#define HTML_PAGE_COUNT %(count)d
+
 #endif // __HTML_H__
 """
 
 FILE_TEMPLATE = """
-extern const char PAGE_%(name)s[] PROGMEM = R"=====(
+// %(file)s: %(size)d bytes, %(minified)d minified, %(compressed)d compressed
+extern const uint8_t PAGE_%(name)s[] PROGMEM = {
 %(content)s
-)=====";
+};
 """
 
-def make_html(page_name, content):
-    return FILE_TEMPLATE % {
-        "name": page_name,
-        "content": content,
+PAGE_TEMPLATE = """  { "%(path)s", "%(mime)s", "\\"%(etag)s\\"", PAGE_%(name)s, sizeof(PAGE_%(name)s) },"""
+
+# Blocks whose whitespace is significant and must be left untouched.
+PRESERVE_RE = re.compile(r"(<(pre|textarea)\b.*?</\2>)", re.DOTALL | re.IGNORECASE)
+HTML_COMMENT_RE = re.compile(r"<!--.*?-->", re.DOTALL)
+
+
+def minify(content):
+    """
+    Conservative minification: drops HTML comments, indentation and blank
+    lines. Line breaks are kept so inline scripts relying on them (e.g. for
+    `//` comments or automatic semicolon insertion) keep working.
+    """
+    out = []
+    for idx, part in enumerate(PRESERVE_RE.split(content)):
+        # split() returns [text, block, tag name, text, block, tag name, ...]
+        if idx % 3 == 1:
+            out.append(part)
+        elif idx % 3 == 0:
+            part = HTML_COMMENT_RE.sub("", part)
+            lines = (line.strip() for line in part.splitlines())
+            out.append("\n".join(line for line in lines if line))
+    return "".join(out)
+
+
+def compress(content):
+    # A fixed mtime keeps the output (and therefore the ETag) reproducible.
+    return gzip.compress(content, compresslevel=9, mtime=0)
+
+
+def etag(data):
+    return hashlib.sha1(data).hexdigest()[:16]
+
+
+def c_bytes(data, per_line=16):
+    lines = []
+    for off in range(0, len(data), per_line):
+        lines.append("  " + ", ".join("0x%02x" % b for b in data[off:off + per_line]) + ",")
+    return "\n".join(lines)
+
+
+def symbol_name(file_path):
+    # The whole file name, so that e.g. main.html and main.css don't clash.
+    return re.sub(r"\W", "_", file_path.name).upper()
+
+
+def make_page(file_path):
+    raw = file_path.read_bytes()
+    if file_path.suffix in MINIFIED_TYPES:
+        minified = minify(raw.decode("utf-8")).encode("utf-8")
+    else:
+        minified = raw
+    compressed = compress(minified)
+
+    name = symbol_name(file_path)
+    definition = FILE_TEMPLATE % {
+        "file": file_path.name,
+        "name": name,
+        "size": len(raw),
+        "minified": len(minified),
+        "compressed": len(compressed),
+        "content": c_bytes(compressed),
     }
+    entry = PAGE_TEMPLATE % {
+        "path": "/" if file_path.name == INDEX_PAGE else "/" + file_path.name,
+        "mime": MIME_TYPES.get(file_path.suffix, DEFAULT_MIME_TYPE),
+        "etag": etag(compressed),
+        "name": name,
+    }
+    return definition, entry
+
+
+def generate(html_dir=HTML_DIR):
+    definitions = []
+    entries = []
+    names = {}
+    for file_path in sorted(Path(html_dir).iterdir()):
+        if not file_path.is_file():
+            continue
+
+        name = symbol_name(file_path)
+        if name in names:
+            raise ValueError("%s and %s would both be embedded as PAGE_%s" % (names[name], file_path.name, name))
+        names[name] = file_path.name
+
+        definition, entry = make_page(file_path)
+        definitions.append(definition)
+        entries.append(entry)
+
+    return (MAIN_TEMPLATE % {
+        "content": "\n".join(definitions),
+        "pages": "\n".join(entries),
+        "count": len(entries),
+    }).strip() + "\n"
+
+
+def write_if_changed(path, content):
+    # Avoid touching the header (and triggering a full rebuild) when nothing
+    # changed.
+    path = Path(path)
+    if path.exists() and path.read_text() == content:
+        return
+    path.parent.mkdir(parents=True, exist_ok=True)
+    path.write_text(content)
+
+
+def main():
+    write_if_changed(OUTPUT, generate())
 
-expanded = []
-for page_name, file_path in FILES.items():
-    content = Path(file_path).read_text()
-    expanded.append(make_html(page_name.upper(), content))
 
-with open("src/html/html.h", "w") as f:
-    f.write((MAIN_TEMPLATE % {
-        "content": "\n".join(expanded)
-    }).strip())
+# PlatformIO runs this as a pre-script (see extra_scripts in platformio.ini),
+# through SCons which executes it with its own globals, Import among them.
+# Importing it (e.g. from test/test_gen_html.py) doesn't generate anything.
+if __name__ == "__main__" or "Import" in globals():
+    main()
@@ -0,0 +1,244 @@
+#ifndef __AUDIO_DSP_H__
+#define __AUDIO_DSP_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Fixed-point DSP kernels for the audio reactive effects: a Q15 radix-2 FFT,
+ * band energies and an onset (beat) detector.
+ *
+ * Everything in here is a pure function of its inputs (plus the explicit
+ * state in AudioAnalyzer) and doesn't depend on the board, so it can be
+ * checked against a floating-point reference on a host.
+ */
+
+#define AUDIO_FFT_SIZE 128
+#define AUDIO_FFT_BITS 7
+#define AUDIO_BANDS 8
+
+// Band magnitudes (in FFT output units) below this are considered silence.
+#define AUDIO_NOISE_FLOOR 24
+
+// An onset is reported when the spectral flux exceeds its running average by
+// this ratio (in 1/8ths)...
+#define AUDIO_ONSET_RATIO_8THS 14
+// ...and at least this many buffers have passed since the previous one.
+#define AUDIO_ONSET_REFRACTORY 4
+
+static_assert(AUDIO_FFT_SIZE == (1 << AUDIO_FFT_BITS), "FFT size must match its bit count");
+
+// sin(2 * pi * k / AUDIO_FFT_SIZE) in Q15 for the first quarter of the wave.
+static const int16_t AUDIO_QUARTER_SINE_Q15[AUDIO_FFT_SIZE / 4 + 1] = {
+      0,  1608,  3212,  4808,  6393,  7962,  9512, 11039,
+  12539, 14010, 15446, 16846, 18204, 19519, 20787, 22005,
+  23170, 24279, 25329, 26319, 27245, 28105, 28898, 29621,
+  30273, 30852, 31356, 31785, 32137, 32412, 32609, 32728,
+  32767,
+};
+
+// First FFT bin of each band (roughly logarithmic), the last entry is the end
+// of the last band. At 4kHz each bin is 31.25Hz wide.
+static const uint8_t AUDIO_BAND_EDGES[AUDIO_BANDS + 1] = {
+  1, 2, 3, 5, 8, 13, 21, 34, AUDIO_FFT_SIZE / 2
+};
+
+inline int16_t audio_sin_q15(uint16_t k) {
+  const uint16_t quarter = AUDIO_FFT_SIZE / 4;
+  k &= AUDIO_FFT_SIZE - 1;
+
+  if (k <= quarter) return AUDIO_QUARTER_SINE_Q15[k];
+  if (k <= 2 * quarter) return AUDIO_QUARTER_SINE_Q15[2 * quarter - k];
+  if (k <= 3 * quarter) return -AUDIO_QUARTER_SINE_Q15[k - 2 * quarter];
+  return -AUDIO_QUARTER_SINE_Q15[4 * quarter - k];
+}
+
+inline int16_t audio_cos_q15(uint16_t k) {
+  return audio_sin_q15(k + AUDIO_FFT_SIZE / 4);
+}
+
+inline int32_t q15_mul(int32_t a, int32_t b) {
+  return (a * b) >> 15;
+}
+
+/**
+ * Applies a Hann window in place. The window is derived from the same sine
+ * table as the FFT twiddles so it doesn't cost any extra memory.
+ */
+inline void audio_window(int16_t *samples) {
+  for (uint16_t n = 0; n < AUDIO_FFT_SIZE; n++) {
+    const int32_t w = (32767 - audio_cos_q15(n)) >> 1;
+    samples[n] = q15_mul(samples[n], w);
+  }
+}
+
+/**
+ * In-place radix-2 decimation-in-time FFT on Q15 data. Every stage halves its
+ * output to rule out overflows, so the result is scaled by 1/AUDIO_FFT_SIZE.
+ */
+inline void audio_fft(int16_t *re, int16_t *im) {
+  // Bit reversal permutation
+  for (uint16_t i = 1, j = 0; i < AUDIO_FFT_SIZE; i++) {
+    uint16_t bit = AUDIO_FFT_SIZE >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+
+    if (i < j) {
+      int16_t t = re[i]; re[i] = re[j]; re[j] = t;
+      t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+  }
+
+  for (uint16_t len = 2; len <= AUDIO_FFT_SIZE; len <<= 1) {
+    const uint16_t half = len >> 1;
+    const uint16_t step = AUDIO_FFT_SIZE / len;
+
+    for (uint16_t k = 0; k < half; k++) {
+      const int32_t wr = audio_cos_q15(k * step);
+      const int32_t wi = -audio_sin_q15(k * step);
+
+      for (uint16_t i = k; i < AUDIO_FFT_SIZE; i += len) {
+        const uint16_t j = i + half;
+        const int32_t tr = q15_mul(re[j], wr) - q15_mul(im[j], wi);
+        const int32_t ti = q15_mul(re[j], wi) + q15_mul(im[j], wr);
+
+        re[j] = (re[i] - tr) >> 1;
+        im[j] = (im[i] - ti) >> 1;
+        re[i] = (re[i] + tr) >> 1;
+        im[i] = (im[i] + ti) >> 1;
+      }
+    }
+  }
+}
+
+/**
+ * Approximate magnitude of the first half of the spectrum (alpha max plus
+ * beta min, overestimates by up to ~7%).
+ */
+inline void audio_magnitudes(const int16_t *re, const int16_t *im, uint16_t *mag) {
+  for (uint16_t i = 0; i < AUDIO_FFT_SIZE / 2; i++) {
+    const uint16_t a = abs(re[i]);
+    const uint16_t b = abs(im[i]);
+    const uint16_t hi = a > b ? a : b;
+    const uint16_t lo = a > b ? b : a;
+    mag[i] = hi + ((lo * 3) >> 3);
+  }
+}
+
+/**
+ * Mean magnitude of every band.
+ */
+inline void audio_band_energies(const uint16_t *mag, uint16_t *bands) {
+  for (uint8_t b = 0; b < AUDIO_BANDS; b++) {
+    uint32_t sum = 0;
+    for (uint8_t i = AUDIO_BAND_EDGES[b]; i < AUDIO_BAND_EDGES[b + 1]; i++) {
+      sum += mag[i];
+    }
+    bands[b] = sum / (AUDIO_BAND_EDGES[b + 1] - AUDIO_BAND_EDGES[b]);
+  }
+}
+
+struct AudioFeatures {
+  // Band energies normalized to 0-255 against the recent peak.
+  uint8_t bands[AUDIO_BANDS];
+  // Overall loudness, normalized the same way.
+  uint8_t level;
+  // True when this buffer starts a beat.
+  bool onset;
+};
+
+/**
+ * Turns buffers of raw samples into AudioFeatures. Keeps the little state
+ * needed across buffers: the peak used for normalization (automatic gain
+ * control) and the spectral flux history of the onset detector.
+ */
+class AudioAnalyzer {
+public:
+  void reset() {
+    peak = AUDIO_NOISE_FLOOR;
+    flux_avg = 0;
+    since_onset = AUDIO_ONSET_REFRACTORY;
+    for (uint8_t b = 0; b < AUDIO_BANDS; b++) {
+      prev_bands[b] = 0;
+    }
+  }
+
+  void process(const int16_t *samples, AudioFeatures &out) {
+    int16_t re[AUDIO_FFT_SIZE];
+    int16_t im[AUDIO_FFT_SIZE];
+    uint16_t mag[AUDIO_FFT_SIZE / 2];
+    uint16_t bands[AUDIO_BANDS];
+
+    // Remove the DC offset (the ADC input is biased at half scale).
+    int32_t mean = 0;
+    for (uint16_t i = 0; i < AUDIO_FFT_SIZE; i++) {
+      mean += samples[i];
+    }
+    mean /= AUDIO_FFT_SIZE;
+
+    for (uint16_t i = 0; i < AUDIO_FFT_SIZE; i++) {
+      int32_t s = samples[i] - mean;
+      re[i] = s > 32767 ? 32767 : (s < -32768 ? -32768 : s);
+      im[i] = 0;
+    }
+
+    audio_window(re);
+    audio_fft(re, im);
+    audio_magnitudes(re, im, mag);
+    audio_band_energies(mag, bands);
+
+    // Automatic gain control: follow the loudest band up immediately and
+    // decay slowly (~1/64 per buffer) when things get quieter.
+    uint16_t loudest = 0;
+    uint32_t total = 0;
+    for (uint8_t b = 0; b < AUDIO_BANDS; b++) {
+      loudest = bands[b] > loudest ? bands[b] : loudest;
+      total += bands[b];
+    }
+    peak = loudest > peak ? loudest : peak - (peak >> 6);
+    if (peak < AUDIO_NOISE_FLOOR) peak = AUDIO_NOISE_FLOOR;
+
+    for (uint8_t b = 0; b < AUDIO_BANDS; b++) {
+      out.bands[b] = normalize(bands[b]);
+    }
+    out.level = normalize(total / AUDIO_BANDS);
+
+    // Onsets: spectral flux (sum of the increases in energy) over the low
+    // bands, where most beats are, compared against its running average.
+    uint32_t flux = 0;
+    for (uint8_t b = 0; b < AUDIO_BANDS / 2; b++) {
+      if (bands[b] > prev_bands[b]) {
+        flux += bands[b] - prev_bands[b];
+      }
+    }
+    for (uint8_t b = 0; b < AUDIO_BANDS; b++) {
+      prev_bands[b] = bands[b];
+    }
+
+    since_onset = since_onset < 255 ? since_onset + 1 : since_onset;
+    out.onset = since_onset >= AUDIO_ONSET_REFRACTORY &&
+                flux > AUDIO_NOISE_FLOOR &&
+                (int32_t)flux * 8 > flux_avg * AUDIO_ONSET_RATIO_8THS;
+    if (out.onset) {
+      since_onset = 0;
+    }
+
+    flux_avg += ((int32_t)flux - flux_avg) / 16;
+  }
+
+private:
+  uint16_t peak = AUDIO_NOISE_FLOOR;
+  int32_t flux_avg = 0;
+  uint8_t since_onset = AUDIO_ONSET_REFRACTORY;
+  uint16_t prev_bands[AUDIO_BANDS] = {};
+
+  inline uint8_t normalize(uint32_t value) {
+    if (value < AUDIO_NOISE_FLOOR) return 0;
+    const uint32_t v = (value * 255) / peak;
+    return v > 255 ? 255 : v;
+  }
+};
+
+#endif // __AUDIO_DSP_H__
@@ -0,0 +1,82 @@
+#ifndef __AUDIO_INPUT_H__
+#define __AUDIO_INPUT_H__
+
+#include <Arduino.h>
+
+#include "AudioDsp.h"
+
+// Sampling rate of the A0 input. Keep in mind that reading the ESP8266's ADC
+// too often starves the WiFi stack: 4kHz still covers the bass and mids,
+// which is what the effects react to.
+#define AUDIO_SAMPLE_RATE 4000
+
+#define AUDIO_SAMPLE_PERIOD_US (1000000 / AUDIO_SAMPLE_RATE)
+
+/**
+ * Samples A0 into a double buffer: one buffer is being filled while the other
+ * one (the last complete one) can be analyzed.
+ *
+ * Sampling is polled from the main loop rather than run from a timer
+ * interrupt: analogRead() isn't in IRAM, so calling it from an interrupt
+ * crashes as soon as the flash cache is disabled (e.g. while writing to
+ * LittleFS). Sample slots are kept on a fixed grid of micros(); the ones
+ * that go by while the loop is busy elsewhere (e.g. in FastLED.show()) are
+ * filled with the next reading (zero-order hold), which smears the highest
+ * frequencies a little but keeps the timing, and so the spectrum, right.
+ */
+class AudioInput {
+public:
+  static void begin() {
+    write_buf = 0;
+    write_pos = 0;
+    ready = false;
+    next_sample_us = micros();
+  }
+
+  /**
+   * Takes a sample if its slot has come. Call as often as possible.
+   */
+  static void poll() {
+    const uint32_t now = micros();
+    if ((int32_t)(now - next_sample_us) < 0) return;
+
+    uint32_t slots = (now - next_sample_us) / AUDIO_SAMPLE_PERIOD_US + 1;
+    next_sample_us += slots * AUDIO_SAMPLE_PERIOD_US;
+    // After a long stall there's nothing worth keeping beyond one buffer.
+    if (slots > AUDIO_FFT_SIZE) slots = AUDIO_FFT_SIZE;
+
+    // 10 bit reading scaled up to use the whole Q15 range
+    const int16_t sample = (int16_t)(analogRead(A0) << 5);
+    while (slots-- > 0) {
+      buffers[write_buf][write_pos] = sample;
+
+      if (++write_pos == AUDIO_FFT_SIZE) {
+        write_pos = 0;
+        write_buf ^= 1;
+        ready = true;
+      }
+    }
+  }
+
+  /**
+   * Returns the most recent complete buffer of AUDIO_FFT_SIZE samples or
+   * NULL if no new buffer has been completed since the last call. The buffer
+   * stays valid until the next one is completed (AUDIO_FFT_SIZE samples
+   * later).
+   */
+  static const int16_t *read() {
+    if (!ready) return NULL;
+
+    ready = false;
+    return buffers[write_buf ^ 1];
+  }
+
+private:
+  static inline int16_t buffers[2][AUDIO_FFT_SIZE];
+  static inline uint8_t write_buf = 0;
+  static inline uint16_t write_pos = 0;
+  static inline bool ready = false;
+  static inline uint32_t next_sample_us = 0;
+};
+
+#endif // __AUDIO_INPUT_H__
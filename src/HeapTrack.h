@@ -0,0 +1,273 @@
+#ifndef __HEAP_TRACK_H__
+#define __HEAP_TRACK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ARDUINO
+#  include <Arduino.h>
+#endif
+
+/**
+ * Heap instrumentation: attributes every allocation to the subsystem that
+ * made it, keeps track of the low watermarks of the heap and flags
+ * allocations on the render path once the system is up.
+ *
+ * Allocations are intercepted by wrapping malloc and friends at link time
+ * (see ENABLE_HEAP_TRACK in platformio.ini), so there's no per-allocation
+ * header: allocations and frees are counted against the tag that's active
+ * when they happen, set with a HeapScope. The SDK and the WiFi stack allocate
+ * through their own entry points and don't show up here, but they're still
+ * part of the free heap watermarks.
+ *
+ * Nothing in here depends on the board other than sample(), so the same
+ * tracker works in a host build linked with the same --wrap flags. The
+ * firmware links libstdc++ statically so operator new goes through the
+ * wrapped malloc; on a host it has to be replaced to call malloc (see
+ * test/native/NativeTest.h), or it bypasses the tracker.
+ */
+
+enum class HeapTag : uint8_t {
+  Other,
+  Web,
+  Wifi,
+  Anim,
+  Render,
+  Sync,
+
+  // Number of tags, must always be the last entry.
+  Count,
+};
+
+/**
+ * Allocations and frees made under a tag. A block is counted against the tag
+ * active when it's allocated and again against the one active when it's
+ * freed, which aren't always the same (e.g. a String built while serving a
+ * request and freed later under another tag), so `allocs - frees` of a tag
+ * isn't what it holds on to. See HeapTrack::get_live_blocks() for that.
+ */
+struct HeapTagStats {
+  uint32_t allocs;
+  uint32_t frees;
+  // Total bytes requested, including the ones since freed.
+  uint32_t bytes;
+};
+
+// How often sample() looks at the largest free block, which means walking
+// the free list.
+#define HEAP_TRACK_SAMPLE_MS 1000
+
+class HeapTrack {
+public:
+  static const char *tag_name(HeapTag tag) {
+    static const char *names[] = { "other", "web", "wifi", "anim", "render", "sync" };
+    static_assert(sizeof(names) / sizeof(names[0]) == (size_t)HeapTag::Count, "Every tag needs a name");
+
+    return names[(uint8_t)tag];
+  }
+
+  static HeapTag get_tag() {
+    return current_tag;
+  }
+
+  static void set_tag(HeapTag tag) {
+    current_tag = tag;
+  }
+
+  static const HeapTagStats &get_stats(HeapTag tag) {
+    return stats[(uint8_t)tag];
+  }
+
+  /**
+   * From now on any allocation made under HeapTag::Render is a violation:
+   * rendering a frame is expected not to allocate once the system is up.
+   * With HEAP_TRACK_STRICT a violation is fatal, otherwise it's counted and
+   * reported by sample().
+   */
+  static void arm_steady_state() {
+    steady_state = true;
+    violations = 0;
+  }
+
+  static bool is_steady_state() {
+    return steady_state;
+  }
+
+  static uint32_t get_violations() {
+    return violations;
+  }
+
+  // Address of the code that made the last violating allocation.
+  static const void *get_last_violation_caller() {
+    return last_violation_caller;
+  }
+
+  // Blocks allocated and not freed yet, whatever their tag.
+  static uint32_t get_live_blocks() {
+    return live_blocks;
+  }
+
+  static uint32_t get_min_free_heap() {
+    return min_free_heap;
+  }
+
+  static uint32_t get_min_max_block() {
+    return min_max_block;
+  }
+
+  /**
+   * Updates the largest free block watermark and reports new violations. Call
+   * it from the main loop.
+   */
+  static void sample() {
+    #ifdef ARDUINO
+      const uint32_t now = millis();
+      if (last_sample_ms != 0 && now - last_sample_ms < HEAP_TRACK_SAMPLE_MS) return;
+      last_sample_ms = now;
+
+      update_min_free_heap();
+      const uint32_t max_block = ESP.getMaxFreeBlockSize();
+      if (max_block < min_max_block) {
+        min_max_block = max_block;
+      }
+
+      #ifdef ENABLE_SERIAL_DEBUG
+        if (violations != reported_violations) {
+          reported_violations = violations;
+          Serial.print(F("Heap: allocation while rendering, total "));
+          Serial.print(violations);
+          Serial.print(F(", last from 0x"));
+          Serial.println((uint32_t)last_violation_caller, HEX);
+        }
+      #endif
+    #endif
+  }
+
+  // Called by the malloc wrappers.
+  static void on_alloc(size_t size, const void *caller) {
+    HeapTagStats &s = stats[(uint8_t)current_tag];
+    s.allocs++;
+    s.bytes += size;
+
+    if (steady_state && current_tag == HeapTag::Render) {
+      violations++;
+      last_violation_caller = caller;
+      #if defined(HEAP_TRACK_STRICT) && defined(ARDUINO)
+        panic();
+      #endif
+    }
+  }
+
+  static void on_allocated(const void *ptr) {
+    if (ptr != nullptr) {
+      live_blocks++;
+    }
+    #ifdef ARDUINO
+      update_min_free_heap();
+    #endif
+  }
+
+  static void on_free() {
+    stats[(uint8_t)current_tag].frees++;
+    live_blocks--;
+  }
+
+private:
+  static inline HeapTag current_tag = HeapTag::Other;
+  static inline HeapTagStats stats[(uint8_t)HeapTag::Count] = {};
+  static inline uint32_t live_blocks = 0;
+
+  static inline bool steady_state = false;
+  static inline uint32_t violations = 0;
+  static inline uint32_t reported_violations = 0;
+  static inline const void *last_violation_caller = nullptr;
+
+  static inline uint32_t min_free_heap = UINT32_MAX;
+  static inline uint32_t min_max_block = UINT32_MAX;
+  static inline uint32_t last_sample_ms = 0;
+
+  #ifdef ARDUINO
+    static void update_min_free_heap() {
+      const uint32_t free_heap = ESP.getFreeHeap();
+      if (free_heap < min_free_heap) {
+        min_free_heap = free_heap;
+      }
+    }
+  #endif
+};
+
+/**
+ * Attributes the allocations made during its lifetime to `tag`. Scopes nest:
+ * the previous tag is restored on destruction.
+ */
+class HeapScope {
+public:
+  explicit HeapScope(HeapTag tag) : previous(HeapTrack::get_tag()) {
+    HeapTrack::set_tag(tag);
+  }
+
+  ~HeapScope() {
+    HeapTrack::set_tag(previous);
+  }
+
+  HeapScope(const HeapScope &) = delete;
+  HeapScope &operator=(const HeapScope &) = delete;
+
+private:
+  const HeapTag previous;
+};
+
+#ifdef ENABLE_HEAP_TRACK
+// Needs -Wl,--wrap=malloc,--wrap=free,--wrap=realloc,--wrap=calloc: the linker
+// sends every call to malloc to __wrap_malloc, and __real_malloc to the
+// actual malloc.
+extern "C" {
+  void *__real_malloc(size_t size);
+  void __real_free(void *ptr);
+  void *__real_realloc(void *ptr, size_t size);
+  void *__real_calloc(size_t count, size_t size);
+
+  void *__wrap_malloc(size_t size) {
+    HeapTrack::on_alloc(size, __builtin_return_address(0));
+    void *ptr = __real_malloc(size);
+    HeapTrack::on_allocated(ptr);
+    return ptr;
+  }
+
+  void __wrap_free(void *ptr) {
+    if (ptr != nullptr) {
+      HeapTrack::on_free();
+    }
+    __real_free(ptr);
+  }
+
+  // Growing a String goes through realloc, which may move the block: count it
+  // as an allocation of the new block and, once that succeeded, a free of the
+  // old one. realloc(ptr, 0) only frees.
+  void *__wrap_realloc(void *ptr, size_t size) {
+    if (size == 0) {
+      if (ptr != nullptr) {
+        HeapTrack::on_free();
+      }
+      return __real_realloc(ptr, size);
+    }
+
+    HeapTrack::on_alloc(size, __builtin_return_address(0));
+    void *new_ptr = __real_realloc(ptr, size);
+    HeapTrack::on_allocated(new_ptr);
+    if (new_ptr != nullptr && ptr != nullptr) {
+      HeapTrack::on_free();
+    }
+    return new_ptr;
+  }
+
+  void *__wrap_calloc(size_t count, size_t size) {
+    HeapTrack::on_alloc(count * size, __builtin_return_address(0));
+    void *ptr = __real_calloc(count, size);
+    HeapTrack::on_allocated(ptr);
+    return ptr;
+  }
+}
+#endif
+
+#endif // __HEAP_TRACK_H__
@@ -2,7 +2,21 @@
 #define __LED_ANIM_H__
 
 #include <FastLED.h>
+#include "MicroUtil.h"
 #include "LedControl.h"
+#include "LedSequence.h"
+#include "SyncClock.h"
+#include "AudioDsp.h"
+#include "AudioInput.h"
+#include "LedParticles.h"
+
+// Length of the cycle of a periodic animation: `frames` frames, each shown
+// for `frame_ms`. Frame `n` is due at any time t where
+// (t / frame_ms) % frames == n.
+struct AnimCycle {
+  uint16_t frames;
+  uint16_t frame_ms;
+};
 
 class LedAnim {
 public:
@@ -18,6 +32,26 @@ public:
   virtual void draw() {}
   virtual const char *name() = 0;
 
+  // Animations whose state isn't just a function of the time share it with
+  // other ledboxes when syncing (see LedSync.h). Returns the number of bytes
+  // written to `buf`.
+  virtual uint8_t save_sync_state(uint8_t *buf, uint8_t size) { return 0; }
+  virtual void load_sync_state(const uint8_t *buf, uint8_t len) {}
+
+  // With LED_HIGH_BIT_DEPTH, animations returning true render into
+  // `control->leds16` instead of `control->leds`.
+  virtual bool renders_hd() { return false; }
+
+  // Changes one of the animation's parameters (see the "set_param" API op).
+  // Returns false if there's no such parameter or the value is out of range.
+  virtual bool set_param(const char *name, int32_t value) { return false; }
+
+  // Animations that only ever show the same cycle of frames can declare it,
+  // and render any frame of it on demand into `leds`, so that the frames can
+  // be rendered once and played back from a cache (see LedCycleCache.h).
+  virtual bool get_cycle(AnimCycle &cycle) { return false; }
+  virtual void draw_cycle_frame(CRGB *leds, uint16_t frame) {}
+
 protected:
   LedControl *control;
   uint16_t led_count = 0;
@@ -45,31 +79,67 @@ public:
     color_idx = 0;
     current_color = rotation_colors[color_idx];
     target_color = rotation_colors[color_idx];
+    #ifdef LED_HIGH_BIT_DEPTH
+      current_color16 = CRGB16(current_color);
+    #endif
 
     control->fill_solid(current_color);
   }
 
+  #ifdef LED_HIGH_BIT_DEPTH
+    bool renders_hd() { return true; }
+  #endif
+
   void click() {
     this->color_idx++;
     this->color_idx %= rotation_colors.size();
     target_color = rotation_colors[color_idx];
   }
 
+  uint8_t save_sync_state(uint8_t *buf, uint8_t size) {
+    if (size < 1) return 0;
+    buf[0] = color_idx;
+    return 1;
+  }
+
+  void load_sync_state(const uint8_t *buf, uint8_t len) {
+    if (len < 1 || buf[0] >= rotation_colors.size()) return;
+    color_idx = buf[0];
+    target_color = rotation_colors[color_idx];
+  }
+
   void loop() {
-    if (current_color == target_color) {
-      return;
-    }
+    #ifdef LED_HIGH_BIT_DEPTH
+      // Fade at 16 bit precision so that the dithered output doesn't step
+      // between colors.
+      const CRGB16 target_color16 = CRGB16(target_color);
+      if (current_color16 == target_color16) {
+        return;
+      }
 
-    const bool changed = control->crgb_blend_to_crgb(current_color, target_color, 75);
-    if (changed) {
-      control->fill_solid(current_color);
-    }
+      const bool changed = control->crgb16_blend_to_crgb16(current_color16, target_color16, 75);
+      if (changed) {
+        control->fill_solid16(current_color16);
+      }
+    #else
+      if (current_color == target_color) {
+        return;
+      }
+
+      const bool changed = control->crgb_blend_to_crgb(current_color, target_color, 75);
+      if (changed) {
+        control->fill_solid(current_color);
+      }
+    #endif
   }
 
 private:
   uint8_t color_idx = 0;
   CRGB target_color;
   CRGB current_color;
+  #ifdef LED_HIGH_BIT_DEPTH
+    CRGB16 current_color16;
+  #endif
 
   const std::vector<CRGB> rotation_colors = {
     CRGB::White,
@@ -82,25 +152,34 @@ private:
   };
 };
 
+// Slowly cycles through the hue wheel. The hue is derived from the clock so
+// that synced ledboxes show the same color.
+#define HUE_STEP_MS 500
+
 class HueAnim : public LedAnim {
 public:
   const char *name() { return "hue"; }
 
   void begin(LedControl *control) {
     LedAnim::begin(control);
-    hue = 0;
+    update(true);
   }
 
   void loop() {
-    EVERY_N_MILLISECONDS(500) {
-      hue++;
-      const CRGB c = CHSV(hue, 255, 255);
-      control->fill_solid(c);
-    }
+    update(false);
   }
 
 private:
   uint8_t hue = 0;
+
+  inline void update(bool force) {
+    const uint8_t h = GET_MILLIS() / HUE_STEP_MS;
+    if (h != hue || force) {
+      hue = h;
+      const CRGB c = CHSV(hue, 255, 255);
+      control->fill_solid(c);
+    }
+  }
 };
 
 /**
@@ -110,19 +189,92 @@ private:
  * and overlayed to each other.
  *
  * https://github.com/FastLED/FastLED/blob/master/examples/Pacifica/Pacifica.ino
+ *
+ * With ENABLE_CYCLE_CACHE it's a different effect, drawn as a loop of
+ * WAVE_CYCLE_MS so that it can be cached (see LedCycleCache.h), live and
+ * cached alike. The color index counters integrate speeds that vary and never
+ * come back to where they started, so in the loop they move at a constant
+ * speed, their average rounded to whole turns: the waves no longer speed up
+ * and slow down. Frames also change every WAVE_CYCLE_FRAME_MS rather than
+ * every FRAME_INTERVAL_MS, to keep the cache small. The beats are the same,
+ * each has a whole number of periods in a minute.
  */
+#define WAVE_CYCLE_MS 60000
+#define WAVE_CYCLE_FRAME_MS 40
+#define WAVE_CYCLE_FRAMES (WAVE_CYCLE_MS / WAVE_CYCLE_FRAME_MS)
+
 class WaveAnim : public LedAnim {
 public:
   const char *name() { return "wave"; }
 
   void begin(LedControl *control) {
     LedAnim::begin(control);
+    last_run_ms = GET_MILLIS();
   }
 
+  // The wave position integrates speeds that vary over time, so it depends
+  // on when the animation started: share it.
+  uint8_t save_sync_state(uint8_t *buf, uint8_t size) {
+    const uint16_t state[] = {
+      color_idx_start_1, color_idx_start_2, color_idx_start_3, color_idx_start_4,
+      (uint16_t)(last_run_ms & 0xFFFF), (uint16_t)(last_run_ms >> 16),
+    };
+    if (size < sizeof(state)) return 0;
+
+    memcpy(buf, state, sizeof(state));
+    return sizeof(state);
+  }
+
+  void load_sync_state(const uint8_t *buf, uint8_t len) {
+    uint16_t state[6];
+    if (len != sizeof(state)) return;
+
+    memcpy(state, buf, sizeof(state));
+    color_idx_start_1 = state[0];
+    color_idx_start_2 = state[1];
+    color_idx_start_3 = state[2];
+    color_idx_start_4 = state[3];
+    last_run_ms = state[4] | ((uint32_t)state[5] << 16);
+  }
+
+#ifdef ENABLE_CYCLE_CACHE
+  // Drawn from the loop even live, so that the cache picks up seamlessly.
+  void draw() {
+    draw_cycle_frame(control->leds, (GET_MILLIS() / WAVE_CYCLE_FRAME_MS) % WAVE_CYCLE_FRAMES);
+  }
+
+  bool get_cycle(AnimCycle &cycle) {
+    cycle.frames = WAVE_CYCLE_FRAMES;
+    cycle.frame_ms = WAVE_CYCLE_FRAME_MS;
+    return true;
+  }
+
+  // Same as draw(), with each beat*() replaced by its loop_*() equivalent.
+  void draw_cycle_frame(CRGB *leds, uint16_t frame) {
+    const uint32_t t = (uint32_t)frame * WAVE_CYCLE_FRAME_MS;
+
+    // Turns of the counters in a minute at their average speed: 224/256
+    // (speed factor) times 11.5, 9.5, 6 and 5 (beatsin88) per ms.
+    const uint16_t idx_1 = loop_beat16(t, 9);
+    const uint16_t idx_2 = -loop_beat16(t, 8);
+    const uint16_t idx_3 = -loop_beat16(t, 5);
+    const uint16_t idx_4 = -loop_beat16(t, 4);
+
+    fill_solid(leds, NUM_LEDS, base_color);
+
+    layer(leds, palette_1, idx_1, loop_sin16(t, 3, 11 * 256, 14 * 256), loop_sin8(t, 10, 70, 130), -loop_beat16(t, 301));
+    layer(leds, palette_2, idx_2, loop_sin16(t, 4,  6 * 256,  9 * 256), loop_sin8(t, 17, 40,  80), loop_beat16(t, 401));
+    layer(leds, palette_3, idx_3, 6 * 256, loop_sin8(t, 9, 10, 38), 0 - loop_beat16(t, 503));
+    layer(leds, palette_3, idx_4, 5 * 256, loop_sin8(t, 8, 10, 28), loop_beat16(t, 601));
+
+    add_whitecaps(leds, loop_sin8(t, 9, 55, 65), loop_beat16(t, 7) >> 8);
+    deepen_colors(leds);
+  }
+#else
   void draw() {
     // Increment the four "color index start" counters, one for each wave layer.
     // Each is incremented at a different speed, and the speeds vary over time.
-    const long now = millis();
+    const uint32_t now = GET_MILLIS();
     const uint32_t delta_ms = now - last_run_ms;
 
     const uint16_t speedfactor1 = beatsin16(3, 179, 269);
@@ -141,21 +293,22 @@ public:
     control->fill_solid(base_color);
 
     // Render each of four layers, with different scales and speeds, that vary over time
-    layer(palette_1, color_idx_start_1, beatsin16(3, 11 * 256, 14 * 256), beatsin8(10, 70, 130), -beat16(301));
-    layer(palette_2, color_idx_start_2, beatsin16(4,  6 * 256,  9 * 256), beatsin8(17, 40,  80), beat16(401));
-    layer(palette_3, color_idx_start_3, 6 * 256, beatsin8(9, 10,38), 0-beat16(503));
-    layer(palette_3, color_idx_start_4, 5 * 256, beatsin8(8, 10,28), beat16(601));
+    layer(control->leds, palette_1, color_idx_start_1, beatsin16(3, 11 * 256, 14 * 256), beatsin8(10, 70, 130), -beat16(301));
+    layer(control->leds, palette_2, color_idx_start_2, beatsin16(4,  6 * 256,  9 * 256), beatsin8(17, 40,  80), beat16(401));
+    layer(control->leds, palette_3, color_idx_start_3, 6 * 256, beatsin8(9, 10,38), 0-beat16(503));
+    layer(control->leds, palette_3, color_idx_start_4, 5 * 256, beatsin8(8, 10,28), beat16(601));
 
     // Add brighter 'whitecaps' where the waves lines up more
-    add_whitecaps();
+    add_whitecaps(control->leds, beatsin8(9, 55, 65), beat8(7));
 
     // Deepen the blues and greens a bit
-    deepen_colors();
+    deepen_colors(control->leds);
 
     last_run_ms = now;
   }
+#endif
 
-private:
+protected:
   const CRGB base_color = CRGB(2, 6, 10);
 
   CRGBPalette16 palette_1 = {
@@ -177,14 +330,15 @@ private:
     0x001C70, 0x002080, 0x1040BF, 0x2060FF
   };
 
-  uint16_t color_idx_start_1, color_idx_start_2, color_idx_start_3, color_idx_start_4;
+  uint16_t color_idx_start_1 = 0, color_idx_start_2 = 0, color_idx_start_3 = 0, color_idx_start_4 = 0;
   uint32_t last_run_ms = 0;
 
-  void layer(CRGBPalette16& palette,
-             uint16_t color_idx_start,
-             uint16_t wavescale,
-             uint8_t brightness,
-             uint16_t ioff) {
+  virtual void layer(CRGB *leds,
+                     CRGBPalette16& palette,
+                     uint16_t color_idx_start,
+                     uint16_t wavescale,
+                     uint8_t brightness,
+                     uint16_t ioff) {
     uint16_t c_idx = color_idx_start;
     uint16_t waveangle = ioff;
     uint16_t wavescale_half = (wavescale / 2) + 20;
@@ -201,35 +355,675 @@ private:
       uint8_t sindex8 = scale16(sindex16, 240);
       CRGB palette_color = ColorFromPalette(palette, sindex8, brightness, LINEARBLEND);
 
-      control->leds[i] += palette_color;
+      leds[i] += palette_color;
     }
   }
 
   // Add extra 'white' to areas where the 4 layers of light have lined up brightly
-  inline void add_whitecaps() {
-    const uint8_t base_threshold = beatsin8(9, 55, 65);
-    uint8_t wave = beat8(7);
-
+  inline void add_whitecaps(CRGB *leds, const uint8_t base_threshold, uint8_t wave) {
     for(uint16_t i = 0; i < NUM_LEDS; i++) {
       const uint8_t threshold = scale8(sin8(wave), 20) + base_threshold;
-      const uint8_t avg_light = control->leds[i].getAverageLight();
+      const uint8_t avg_light = leds[i].getAverageLight();
       wave += 7;
 
       if (avg_light > threshold) {
         const uint8_t overage = avg_light - threshold;
         const uint8_t overage2 = qadd8(overage, overage);
 
-        control->leds[i] += CRGB(overage, overage2, qadd8(overage2, overage2));
+        leds[i] += CRGB(overage, overage2, qadd8(overage2, overage2));
       }
     }
   }
 
   // Deepen the blues and greens
-  inline void deepen_colors() {
+  inline void deepen_colors(CRGB *leds) {
     for(uint16_t i = 0; i < NUM_LEDS; i++) {
-      control->leds[i].blue = scale8(control->leds[i].blue, 145);
-      control->leds[i].green = scale8(control->leds[i].green, 200);
-      control->leds[i] |= CRGB(2, 5, 7);
+      leds[i].blue = scale8(leds[i].blue, 145);
+      leds[i].green = scale8(leds[i].green, 200);
+      leds[i] |= CRGB(2, 5, 7);
+    }
+  }
+
+#ifdef ENABLE_CYCLE_CACHE
+  // beat16() of something doing `per_loop` periods every WAVE_CYCLE_MS, at
+  // `t` ms into the loop. With a loop of a minute, that's its bpm.
+  static inline uint16_t loop_beat16(uint32_t t, uint16_t per_loop) {
+    return ((t * per_loop) % WAVE_CYCLE_MS) * 65536 / WAVE_CYCLE_MS;
+  }
+
+  static inline uint16_t loop_sin16(uint32_t t, uint16_t per_loop, uint16_t lowest, uint16_t highest) {
+    return lowest + scale16(sin16(loop_beat16(t, per_loop)) + 32768, highest - lowest);
+  }
+
+  static inline uint8_t loop_sin8(uint32_t t, uint16_t per_loop, uint8_t lowest, uint8_t highest) {
+    return lowest + scale8(sin8(loop_beat16(t, per_loop) >> 8), highest - lowest);
+  }
+#endif
+};
+
+// Simulation steps per frame are expressed in 1/HEAT_SPEED_ONE.
+#define HEAT_SPEED_ONE 8
+#define HEAT_DEFAULT_SEED 0x2012
+
+struct HeatPreset {
+  uint8_t cooling;
+  uint8_t sparking;
+  uint8_t speed;
+};
+
+/**
+ * Base class for effects simulating heat along the strip. The simulation runs
+ * in place on a single buffer of 8.8 fixed point cells (no scratch copy per
+ * frame), and cells are mapped to colors through a 256 entry palette built
+ * once in begin().
+ *
+ * All the randomness comes from the animation's own generator, so for a given
+ * seed and parameters the output is always the same.
+ *
+ * Parameters, also settable through the API:
+ *   cooling: how fast cells lose heat (0-255)
+ *   sparking: chance of new heat being added at every step (0-255)
+ *   speed: simulation steps per frame, in 1/HEAT_SPEED_ONE (1-32)
+ *   seed: restarts the simulation with the given seed
+ *
+ * Clicking cycles through the presets of the effect.
+ */
+class HeatAnim : public LedAnim {
+public:
+  void begin(LedControl *control) {
+    LedAnim::begin(control);
+
+    for (uint16_t i = 0; i < 256; i++) {
+      palette[i] = heat_color(i);
+    }
+    apply_preset(0);
+    reset(HEAT_DEFAULT_SEED);
+  }
+
+  void click() {
+    apply_preset(preset_idx + 1);
+  }
+
+  bool set_param(const char *name, int32_t value) {
+    switch (shash_n(name, strlen(name))) {
+      case shash("cooling"):
+        if (value < 0 || value > 255) return false;
+        cooling = value;
+        return true;
+      case shash("sparking"):
+        if (value < 0 || value > 255) return false;
+        sparking = value;
+        return true;
+      case shash("speed"):
+        if (value < 1 || value > 4 * HEAT_SPEED_ONE) return false;
+        speed = value;
+        return true;
+      case shash("seed"):
+        reset(value);
+        return true;
+    }
+    return false;
+  }
+
+  void draw() {
+    for (step_acc += speed; step_acc >= HEAT_SPEED_ONE; step_acc -= HEAT_SPEED_ONE) {
+      step(heat, NUM_LEDS);
+    }
+
+    for (uint16_t i = 0; i < NUM_LEDS; i++) {
+      control->leds[i] = palette[heat[i] >> 8];
+    }
+  }
+
+protected:
+  uint16_t heat[NUM_LEDS];
+  uint8_t cooling;
+  uint8_t sparking;
+  uint8_t speed;
+
+  // Advances the simulation of `count` (at least 1) cells by one step. The
+  // cells are a parameter so the simulation can run on any length.
+  virtual void step(uint16_t *cells, uint16_t count) = 0;
+  // Color of the given heat (0-255), used to build the palette.
+  virtual CRGB heat_color(uint8_t heat) = 0;
+  // Presets the click cycles through, the first one is the default.
+  virtual const HeatPreset *presets(uint8_t &count) = 0;
+
+  // xorshift32, see https://www.jstatsoft.org/article/view/v008i14
+  inline uint16_t rand16() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng >> 16;
+  }
+
+  // Uniform(ish) random number in [0, n)
+  inline uint16_t rand16(uint16_t n) {
+    return ((uint32_t)rand16() * n) >> 16;
+  }
+
+private:
+  CRGB palette[256];
+  uint32_t rng;
+  uint8_t step_acc;
+  uint8_t preset_idx;
+
+  void reset(uint32_t seed) {
+    // xorshift gets stuck on 0
+    rng = seed != 0 ? seed : HEAT_DEFAULT_SEED;
+    step_acc = 0;
+    memset(heat, 0, sizeof(heat));
+  }
+
+  void apply_preset(uint8_t idx) {
+    uint8_t count;
+    const HeatPreset *p = presets(count);
+
+    preset_idx = idx % count;
+    cooling = p[preset_idx].cooling;
+    sparking = p[preset_idx].sparking;
+    speed = p[preset_idx].speed;
+  }
+};
+
+/**
+ * Fire2012 by Mark Kriegsman: heat rises from the start of the strip, cooling
+ * down as it goes, with random sparks at the bottom.
+ *
+ * https://github.com/FastLED/FastLED/blob/master/examples/Fire2012/Fire2012.ino
+ */
+class FireAnim : public HeatAnim {
+public:
+  const char *name() { return "fire"; }
+
+protected:
+  void step(uint16_t *cells, uint16_t count) {
+    // Cool down every cell a little. As in the original, the longer the strip
+    // the less each cell cools down, so flames reach about as far.
+    const uint32_t cooling_range = (((uint32_t)cooling * 10 * 256) / count) + 2 * 256;
+    const uint16_t max_cooling = cooling_range > 0xFFFF ? 0xFFFF : cooling_range;
+    for (uint16_t i = 0; i < count; i++) {
+      const uint16_t c = rand16(max_cooling);
+      cells[i] = cells[i] > c ? cells[i] - c : 0;
+    }
+
+    // Heat drifts up and diffuses a little. Walking down from the top means
+    // every cell reads the ones below it before they're overwritten.
+    for (uint16_t k = count - 1; k >= 2; k--) {
+      cells[k] = ((uint32_t)cells[k - 1] + 2 * (uint32_t)cells[k - 2]) / 3;
+    }
+
+    // Randomly ignite new sparks near the bottom.
+    if ((rand16() >> 8) < sparking) {
+      const uint16_t y = rand16(count < 7 ? count : 7);
+      const uint32_t h = cells[y] + ((160 + rand16(96)) << 8);
+      cells[y] = h > 0xFFFF ? 0xFFFF : h;
+    }
+  }
+
+  CRGB heat_color(uint8_t heat) {
+    // The hottest colors are almost white, keep them a bit short of it.
+    return HeatColor(scale8(heat, 240));
+  }
+
+  const HeatPreset *presets(uint8_t &count) {
+    static const HeatPreset fire_presets[] = {
+      { 55, 120, HEAT_SPEED_ONE },       // Fire2012 defaults
+      { 80, 60, HEAT_SPEED_ONE / 2 },    // embers
+      { 40, 200, 2 * HEAT_SPEED_ONE },   // roaring
+    };
+    count = sizeof(fire_presets) / sizeof(fire_presets[0]);
+    return fire_presets;
+  }
+};
+
+// Fraction of the heat difference with its neighbours every cell takes in at
+// every step, in 1/256ths. Needs to stay below 128 for the simulation to be
+// stable.
+#define DIFFUSION_RATE 64
+
+/**
+ * Drops of heat falling at random places of the strip and slowly spreading
+ * out and cooling down. The strip is treated as a ring: heat leaving one end
+ * comes back in at the other.
+ */
+class DiffusionAnim : public HeatAnim {
+public:
+  const char *name() { return "diffusion"; }
+
+protected:
+  void step(uint16_t *cells, uint16_t count) {
+    // Discrete heat equation, in place: the only values that need keeping
+    // around are the previous cell before it was updated and the first cell,
+    // which is the right neighbour of the last one.
+    const int32_t first = cells[0];
+    int32_t prev = cells[count - 1];
+
+    for (uint16_t i = 0; i < count; i++) {
+      const int32_t cur = cells[i];
+      const int32_t next = i + 1 < count ? cells[i + 1] : first;
+
+      int32_t h = cur + (((prev + next - 2 * cur) * DIFFUSION_RATE) >> 8);
+      h -= (h * cooling) >> 14;
+
+      cells[i] = h < 0 ? 0 : (h > 0xFFFF ? 0xFFFF : h);
+      prev = cur;
+    }
+
+    if ((rand16() >> 8) < sparking) {
+      cells[rand16(count)] = 0xFFFF;
+    }
+  }
+
+  CRGB heat_color(uint8_t heat) {
+    static const CRGBPalette16 ice(CRGB::Black, CRGB::Blue, CRGB::Aqua, CRGB::White);
+    return ColorFromPalette(ice, scale8(heat, 240), 255, LINEARBLEND);
+  }
+
+  const HeatPreset *presets(uint8_t &count) {
+    static const HeatPreset diffusion_presets[] = {
+      { 24, 20, HEAT_SPEED_ONE },
+      { 8, 6, HEAT_SPEED_ONE / 2 },      // sparse, slow drops
+      { 48, 80, 4 * HEAT_SPEED_ONE },    // rain
+    };
+    count = sizeof(diffusion_presets) / sizeof(diffusion_presets[0]);
+    return diffusion_presets;
+  }
+};
+
+/**
+ * Plays back a precomputed frame sequence uploaded to LittleFS (see
+ * LedSequence.h). Frames are decoded one at a time when they're due so only
+ * the read-ahead buffer is kept in memory. Clicking restarts the sequence.
+ */
+class SequenceAnim : public LedAnim {
+public:
+  const char *name() { return "sequence"; }
+
+  void begin(LedControl *control) {
+    LedAnim::begin(control);
+    control->fill_solid(CRGB::Black);
+
+    reader.open(SEQUENCE_PATH);
+    next_frame_ms = GET_MILLIS();
+  }
+
+  void end() {
+    reader.close();
+  }
+
+  void click() {
+    if (reader.is_open()) {
+      reader.rewind();
+      next_frame_ms = GET_MILLIS();
+    }
+  }
+
+  void draw() {
+    if (!reader.is_open()) return;
+
+    const uint32_t now = GET_MILLIS();
+    if ((int32_t)(now - next_frame_ms) < 0) return;
+
+    #ifdef ENABLE_SERIAL_DEBUG
+      const uint32_t start_us = micros();
+      const uint32_t start_pos = reader.position();
+    #endif
+
+    const uint16_t duration_ms = reader.next_frame(control->leds, NUM_LEDS);
+    if (duration_ms == 0) {
+      #ifdef ENABLE_SERIAL_DEBUG
+        Serial.println("Corrupt sequence file, stopping playback.");
+      #endif
+      reader.close();
+      return;
+    }
+
+    next_frame_ms += duration_ms;
+    if ((int32_t)(now - next_frame_ms) > SEQUENCE_MAX_LAG_MS) {
+      // We fell too far behind (e.g. a slow web request): drop the backlog
+      // rather than trying to catch up by playing frames back to back.
+      next_frame_ms = now + duration_ms;
+    }
+
+    #ifdef ENABLE_SERIAL_DEBUG
+      // Seeking back to the start of the file yields a bogus byte count on
+      // the first frame of a loop, so just skip it.
+      const uint32_t end_pos = reader.position();
+      if (end_pos > start_pos) {
+        stats_decode_us += micros() - start_us;
+        stats_bytes += end_pos - start_pos;
+        stats_frames++;
+      }
+
+      if (stats_frames == 256) {
+        Serial.print("sequence: ");
+        Serial.print(stats_decode_us / stats_frames);
+        Serial.print("us/frame decoded, ");
+        Serial.print(stats_bytes / stats_frames);
+        Serial.println(" bytes/frame");
+        stats_decode_us = stats_bytes = stats_frames = 0;
+      }
+    #endif
+  }
+
+private:
+  SequenceReader reader;
+  uint32_t next_frame_ms = 0;
+
+  #ifdef ENABLE_SERIAL_DEBUG
+    uint32_t stats_decode_us = 0;
+    uint32_t stats_bytes = 0;
+    uint16_t stats_frames = 0;
+  #endif
+};
+
+// Phase shift of the waves between two rows of the matrix
+#define WAVE_2D_ROW_ANGLE 1500
+#define WAVE_2D_ROW_COLOR 3000
+
+/**
+ * WaveAnim for 2D matrices: every row renders the same waves as WaveAnim but
+ * shifted a bit further along, so that the wave fronts run diagonally across
+ * the matrix rather than being repeated identically on each row.
+ */
+class Wave2DAnim : public WaveAnim {
+public:
+  const char *name() { return "wave2d"; }
+
+protected:
+  void layer(CRGB *leds,
+             CRGBPalette16& palette,
+             uint16_t color_idx_start,
+             uint16_t wavescale,
+             uint8_t brightness,
+             uint16_t ioff) {
+    const uint16_t wavescale_half = (wavescale / 2) + 20;
+
+    for (uint16_t y = 0; y < MATRIX_ROWS; y++) {
+      uint16_t c_idx = color_idx_start + y * WAVE_2D_ROW_COLOR;
+      uint16_t waveangle = ioff + y * WAVE_2D_ROW_ANGLE;
+
+      for (uint16_t x = 0; x < MATRIX_COLS; x++) {
+        waveangle += 250;
+
+        uint16_t s16 = sin16(waveangle) + 32768;
+        uint16_t cs = scale16(s16, wavescale_half) + wavescale_half;
+
+        c_idx += cs;
+
+        uint16_t sindex16 = sin16(c_idx) + 32768;
+        uint8_t sindex8 = scale16(sindex16, 240);
+        CRGB palette_color = ColorFromPalette(palette, sindex8, brightness, LINEARBLEND);
+
+        leds[XY(x, y)] += palette_color;
+      }
+    }
+  }
+};
+
+/**
+ * Base class for effects reacting to the audio input on A0. Sampling only
+ * runs while one of these is the current animation (it's polled from
+ * loop()); every new buffer of samples updates `features`.
+ */
+class AudioAnim : public LedAnim {
+public:
+  void begin(LedControl *control) {
+    LedAnim::begin(control);
+    analyzer.reset();
+    features = AudioFeatures();
+    AudioInput::begin();
+  }
+
+  void loop() {
+    AudioInput::poll();
+
+    const int16_t *samples = AudioInput::read();
+    if (samples != NULL) {
+      analyzer.process(samples, features);
+      on_features();
+    }
+  }
+
+protected:
+  AudioAnalyzer analyzer;
+  AudioFeatures features;
+
+  virtual void on_features() {}
+};
+
+// Per frame decay of the spectrum bars, in 1/256ths of the full height
+#define SPECTRUM_DECAY 12
+
+/**
+ * Splits the strip in one segment per frequency band (low to high) and
+ * shows each band's energy as a bar. Bars fall back slowly so that they
+ * don't flicker. Clicking rotates the colors.
+ */
+class SpectrumAnim : public AudioAnim {
+public:
+  const char *name() { return "spectrum"; }
+
+  void click() {
+    hue_offset += 32;
+  }
+
+  void draw() {
+    const uint16_t segment = NUM_LEDS / AUDIO_BANDS;
+
+    for (uint8_t b = 0; b < AUDIO_BANDS; b++) {
+      levels[b] = std::max(features.bands[b], qsub8(levels[b], SPECTRUM_DECAY));
+
+      const uint16_t first = b * segment;
+      // The last band also takes whatever is left at the end of the strip.
+      const uint16_t count = b == AUDIO_BANDS - 1 ? NUM_LEDS - first : segment;
+      const uint16_t lit = ((uint32_t)levels[b] * count + 127) / 255;
+      const CRGB color = CHSV(hue_offset + b * (256 / AUDIO_BANDS), 255, 255);
+
+      std::fill_n(&control->leds[first], lit, color);
+      std::fill_n(&control->leds[first + lit], count - lit, CRGB::Black);
+    }
+  }
+
+private:
+  uint8_t levels[AUDIO_BANDS] = {};
+  uint8_t hue_offset = 0;
+};
+
+// Per frame decay of the flash following a beat, in 1/256ths
+#define PULSE_DECAY 225
+
+/**
+ * Flashes the whole strip on every beat, moving to a new color each time,
+ * and otherwise glows with the bass. Clicking changes how far apart the
+ * colors of successive beats are.
+ */
+class PulseAnim : public AudioAnim {
+public:
+  const char *name() { return "pulse"; }
+
+  void click() {
+    hue_step = hue_step >= 96 ? 16 : hue_step + 16;
+  }
+
+  void draw() {
+    flash = scale8(flash, PULSE_DECAY);
+    const uint8_t glow = features.bands[0] / 3;
+    control->fill_solid(CHSV(hue, 255, std::max(flash, glow)));
+  }
+
+protected:
+  void on_features() {
+    if (features.onset) {
+      hue += hue_step;
+      flash = 255;
+    }
+  }
+
+private:
+  uint8_t hue = 0;
+  uint8_t hue_step = 48;
+  uint8_t flash = 0;
+};
+
+#define SPARKLE_CAPACITY 128
+
+/**
+ * Random sparkles that light up and fade out at their own pace. Clicking
+ * switches between white and colored sparkles.
+ */
+class SparkleAnim : public LedAnim {
+public:
+  const char *name() { return "sparkle"; }
+
+  void begin(LedControl *control) {
+    LedAnim::begin(control);
+    sparkles.clear();
+  }
+
+  void click() {
+    colored = !colored;
+  }
+
+  void draw() {
+    sparkles.update(NUM_LEDS);
+
+    // Keep the density roughly the same regardless of the strip length.
+    for (uint16_t i = 0; i <= NUM_LEDS / 32; i++) {
+      if (random8() < 96) {
+        const CRGB color = colored ? CRGB(CHSV(random8(), 200, 255)) : CRGB(CRGB::White);
+        sparkles.spawn((int32_t)random16(NUM_LEDS) << PARTICLE_FRAC_BITS, 0, color, random8(6, 20));
+      }
+    }
+
+    control->fill_solid(CRGB::Black);
+    sparkles.splat(control->leds, NUM_LEDS);
+  }
+
+private:
+  ParticlePool<SPARKLE_CAPACITY> sparkles;
+  bool colored = false;
+};
+
+#define COMET_COUNT 3
+#define COMET_TRAIL_FADE 48
+
+/**
+ * A few comets running along the strip in both directions at different
+ * speeds, each leaving a fading trail behind. Clicking launches a new one
+ * straight away.
+ */
+class CometAnim : public LedAnim {
+public:
+  const char *name() { return "comet"; }
+
+  void begin(LedControl *control) {
+    LedAnim::begin(control);
+    comets.clear();
+    control->fill_solid(CRGB::Black);
+  }
+
+  void click() {
+    launch();
+  }
+
+  void draw() {
+    fadeToBlackBy(control->leds, NUM_LEDS, COMET_TRAIL_FADE);
+
+    // Comets don't fade, they are recycled as they leave the strip.
+    comets.update(NUM_LEDS);
+    if (random8() < 6) {
+      launch();
+    }
+
+    comets.splat(control->leds, NUM_LEDS);
+  }
+
+private:
+  ParticlePool<COMET_COUNT> comets;
+  uint8_t hue = 0;
+
+  void launch() {
+    const int16_t speed = random16(PARTICLE_ONE / 4, PARTICLE_ONE * 3 / 2);
+    hue += 37;
+
+    if (random8() & 1) {
+      comets.spawn(0, speed, CHSV(hue, 200, 255), 0);
+    } else {
+      comets.spawn((int32_t)(NUM_LEDS - 1) << PARTICLE_FRAC_BITS, -speed, CHSV(hue, 200, 255), 0);
+    }
+  }
+};
+
+// Gravity pulling rockets and sparks back to the start of the strip, in
+// 1/256ths of a pixel per frame, per frame.
+#define FIREWORKS_GRAVITY -6
+#define FIREWORKS_ROCKETS 4
+#define FIREWORKS_CAPACITY 128
+#define FIREWORKS_SPARKS_PER_ROCKET 24
+
+/**
+ * Rockets launched from the start of the strip that burst into colored
+ * sparks at the top of their climb. Clicking launches a rocket.
+ */
+class FireworksAnim : public LedAnim {
+public:
+  const char *name() { return "fireworks"; }
+
+  void begin(LedControl *control) {
+    LedAnim::begin(control);
+    rockets.clear();
+    sparks.clear();
+    control->fill_solid(CRGB::Black);
+  }
+
+  void click() {
+    launch();
+  }
+
+  void draw() {
+    fadeToBlackBy(control->leds, NUM_LEDS, 64);
+
+    if (random8() < 4) {
+      launch();
+    }
+
+    rockets.update(NUM_LEDS, FIREWORKS_GRAVITY);
+    for (uint16_t i = 0; i < rockets.size();) {
+      if (rockets.velocity(i) <= 0) {
+        explode(rockets.position(i));
+        rockets.kill(i);
+        continue;
+      }
+      i++;
+    }
+
+    sparks.update(NUM_LEDS, FIREWORKS_GRAVITY / 2);
+
+    rockets.splat(control->leds, NUM_LEDS);
+    sparks.splat(control->leds, NUM_LEDS);
+  }
+
+private:
+  ParticlePool<FIREWORKS_ROCKETS> rockets;
+  ParticlePool<FIREWORKS_CAPACITY> sparks;
+
+  void launch() {
+    // Pick the height the rocket will burst at (between half and 90% of the
+    // strip) and work out the launch speed needed to get there: v^2 = 2gh.
+    const uint32_t height = (uint32_t)random16(NUM_LEDS / 2, NUM_LEDS * 9 / 10 + 1) << PARTICLE_FRAC_BITS;
+    const int16_t speed = particle_isqrt(2 * -FIREWORKS_GRAVITY * height);
+
+    rockets.spawn(0, speed, CRGB(255, 160, 60), 0, 160);
+  }
+
+  void explode(int32_t pos) {
+    const uint8_t hue = random8();
+
+    for (uint8_t i = 0; i < FIREWORKS_SPARKS_PER_ROCKET; i++) {
+      const int16_t vel = (int16_t)random16(2 * PARTICLE_ONE) - PARTICLE_ONE;
+      sparks.spawn(pos, vel, CHSV(hue + random8(24), 220, 255), random8(4, 10));
     }
   }
 };
@@ -240,8 +1034,32 @@ enum AnimEffect {
   Solid = 0,
   Wave = 1,
   Hue = 2,
+  Sequence = 3,
+  Spectrum = 4,
+  Pulse = 5,
+  Wave2D = 6,
+  Sparkle = 7,
+  Comet = 8,
+  Fireworks = 9,
+  Fire = 10,
+  Diffusion = 11,
+
+  // Number of effects available, must always be the last entry.
+  EffectCount,
 };
 
+/**
+ * Whether `effect` can be shown with this build's layout: effects that need
+ * one it doesn't have are left out of the rotation and can't be selected.
+ */
+constexpr bool effect_available(int8_t effect) {
+  if (effect < AnimEffect::Initial || effect >= AnimEffect::EffectCount) {
+    return false;
+  }
+  // On a single row it's just Wave.
+  return effect != AnimEffect::Wave2D || MATRIX_ROWS > 1;
+}
+
 extern LedAnim* make_effect(int8_t effect) {
   switch(effect) {
     case AnimEffect::Initial:
@@ -252,6 +1070,26 @@ extern LedAnim* make_effect(int8_t effect) {
       return new HueAnim();
     case AnimEffect::Wave:
       return new WaveAnim();
+    case AnimEffect::Sequence:
+      return new SequenceAnim();
+    case AnimEffect::Spectrum:
+      return new SpectrumAnim();
+    case AnimEffect::Pulse:
+      return new PulseAnim();
+#if MATRIX_ROWS > 1
+    case AnimEffect::Wave2D:
+      return new Wave2DAnim();
+#endif
+    case AnimEffect::Sparkle:
+      return new SparkleAnim();
+    case AnimEffect::Comet:
+      return new CometAnim();
+    case AnimEffect::Fireworks:
+      return new FireworksAnim();
+    case AnimEffect::Fire:
+      return new FireAnim();
+    case AnimEffect::Diffusion:
+      return new DiffusionAnim();
     default:
       #ifdef ENABLE_SERIAL_DEBUG
         Serial.print("Attempted to create invalid effect: ");
@@ -0,0 +1,198 @@
+#ifndef __LED_API_H__
+#define __LED_API_H__
+
+#include <ArduinoJson.h>
+
+#include "MicroUtil.h"
+
+/**
+ * Building blocks for the JSON API: per-op request schemas and a perfect
+ * hash table, both resolved at compile time, mapping op names to handlers.
+ */
+
+enum class ApiFieldType : uint8_t {
+  // Integer in [min, max]
+  Int,
+  // Array of three integers in [min, max], e.g. an RGB or HSV color
+  Triplet,
+  // String whose length is in [min, max]
+  Text,
+  // Array of 2 to API_TRIPLET_LIST_MAX triplets, e.g. gradient stops
+  TripletList,
+};
+
+#define API_TRIPLET_LIST_MAX 8
+
+struct ApiField {
+  const char *name;
+  ApiFieldType type;
+  bool required;
+  int32_t min;
+  int32_t max;
+};
+
+template <typename Handler>
+struct ApiOp {
+  const char *name;
+  Handler handler;
+  const ApiField *fields;
+  uint8_t field_count;
+};
+
+// Convenience for ops that don't take any arguments.
+#define API_NO_FIELDS nullptr, 0
+#define API_FIELDS(fields) fields, (sizeof(fields) / sizeof(fields[0]))
+
+// Longest op name. Longer names can't be an op: lookups reject them before
+// hashing anything.
+#define API_OP_NAME_MAX 16
+
+/**
+ * Perfect hash table mapping shash(op name) to an index in the op table.
+ *
+ * The slot of an op is the top BITS bits of its hash multiplied by a seed.
+ * make_api_op_index() searches for a seed that gives every op its own slot at
+ * compile time, so lookups cost one hash, one multiplication and a single
+ * string comparison to reject unknown ops. If no seed can be found (or an op
+ * name is longer than API_OP_NAME_MAX) the index has a seed of 0: assert on
+ * it and bump BITS.
+ */
+template <uint8_t BITS>
+struct ApiOpIndex {
+  uint32_t seed;
+  int8_t slots[1 << BITS];
+
+  static constexpr size_t slot(uint32_t hash, uint32_t seed) {
+    return (uint32_t)(hash * seed) >> (32 - BITS);
+  }
+
+  template <typename Handler>
+  const ApiOp<Handler> *find(const ApiOp<Handler> *ops, const char *name) const {
+    if (name == nullptr) return nullptr;
+
+    // The name comes from the client, it can be of any length.
+    const size_t len = strnlen(name, API_OP_NAME_MAX + 1);
+    if (len > API_OP_NAME_MAX) return nullptr;
+
+    const int8_t idx = slots[slot(shash_n(name, len), seed)];
+    if (idx < 0 || strcmp(ops[idx].name, name) != 0) {
+      return nullptr;
+    }
+    return &ops[idx];
+  }
+};
+
+#define API_OP_INDEX_MAX_SEED_ATTEMPTS 1024
+
+template <uint8_t BITS, typename Handler, size_t N>
+constexpr ApiOpIndex<BITS> make_api_op_index(const ApiOp<Handler> (&ops)[N]) {
+  ApiOpIndex<BITS> index = {};
+
+  // Slots hold an int8_t index.
+  if (N >= 128 || N > (1 << BITS)) return index;
+
+  for (size_t i = 0; i < N; i++) {
+    size_t len = 0;
+    while (ops[i].name[len] != '\0') len++;
+    if (len > API_OP_NAME_MAX) return index;
+  }
+
+  for (uint32_t attempt = 0; attempt < API_OP_INDEX_MAX_SEED_ATTEMPTS; attempt++) {
+    // Odd multipliers spread the hash bits without losing any of them.
+    index.seed = 0x9E3779B1u + 2 * attempt;
+    for (size_t i = 0; i < (1 << BITS); i++) {
+      index.slots[i] = -1;
+    }
+
+    bool perfect = true;
+    for (size_t i = 0; i < N && perfect; i++) {
+      const size_t s = ApiOpIndex<BITS>::slot(shash(ops[i].name), index.seed);
+      perfect = index.slots[s] < 0;
+      index.slots[s] = i;
+    }
+
+    if (perfect) return index;
+  }
+
+  index.seed = 0;
+  return index;
+}
+
+inline bool api_int_in_range(JsonVariantConst value, const ApiField &field) {
+  if (!value.is<int32_t>()) return false;
+
+  const int32_t v = value.as<int32_t>();
+  return v >= field.min && v <= field.max;
+}
+
+inline bool api_triplet_valid(JsonVariantConst value, const ApiField &field) {
+  if (!value.is<JsonArrayConst>()) return false;
+
+  JsonArrayConst array = value.as<JsonArrayConst>();
+  if (array.size() != 3) return false;
+
+  for (JsonVariantConst item : array) {
+    if (!api_int_in_range(item, field)) return false;
+  }
+  return true;
+}
+
+inline bool api_triplet_list_valid(JsonVariantConst value, const ApiField &field) {
+  if (!value.is<JsonArrayConst>()) return false;
+
+  JsonArrayConst array = value.as<JsonArrayConst>();
+  if (array.size() < 2 || array.size() > API_TRIPLET_LIST_MAX) return false;
+
+  for (JsonVariantConst item : array) {
+    if (!api_triplet_valid(item, field)) return false;
+  }
+  return true;
+}
+
+inline bool api_text_valid(JsonVariantConst value, const ApiField &field) {
+  if (!value.is<const char *>()) return false;
+
+  const size_t len = strlen(value.as<const char *>());
+  return len >= (size_t)field.min && len <= (size_t)field.max;
+}
+
+/**
+ * Checks a request against the op's schema. Fields that aren't part of the
+ * schema are ignored. Handlers can assume every field they declared is either
+ * missing (when optional) or of the right type and in range.
+ */
+template <typename Handler>
+const ApiField *api_validate(JsonObjectConst request, const ApiOp<Handler> &op) {
+  for (uint8_t i = 0; i < op.field_count; i++) {
+    const ApiField &field = op.fields[i];
+    JsonVariantConst value = request[field.name];
+
+    if (value.isNull()) {
+      if (field.required) return &field;
+      continue;
+    }
+
+    bool valid = false;
+    switch (field.type) {
+      case ApiFieldType::Int:
+        valid = api_int_in_range(value, field);
+        break;
+      case ApiFieldType::Triplet:
+        valid = api_triplet_valid(value, field);
+        break;
+      case ApiFieldType::Text:
+        valid = api_text_valid(value, field);
+        break;
+      case ApiFieldType::TripletList:
+        valid = api_triplet_list_valid(value, field);
+        break;
+    }
+
+    if (!valid) return &field;
+  }
+
+  // Returns the first invalid field, if any.
+  return nullptr;
+}
+
+#endif // __LED_API_H__
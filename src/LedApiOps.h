@@ -0,0 +1,76 @@
+#ifndef __LED_API_OPS_H__
+#define __LED_API_OPS_H__
+
+#include <ArduinoJson.h>
+
+#include "LedApi.h"
+#include "LedControl.h"
+
+// Large enough for the biggest request: a gradient with all its stops.
+#define JSON_BUFFER_CAPACITY_BYTES \
+  (JSON_OBJECT_SIZE(6) + JSON_ARRAY_SIZE(API_TRIPLET_LIST_MAX) + API_TRIPLET_LIST_MAX * JSON_ARRAY_SIZE(3))
+
+/*
+ * API ops and their request schemas. Requests are validated against the
+ * schema before the handler runs, so handlers can read their fields without
+ * further checks.
+ *
+ * Handlers are members of `Api` (LedWeb), one per op. The table doesn't
+ * depend on the web server otherwise, so requests can be parsed, looked up
+ * and validated on a host.
+ */
+template <typename Api>
+struct LedApiOps {
+  typedef void (Api::*Handler)();
+
+  static constexpr ApiField FILL_SOLID_FIELDS[] = {
+    { "color",       ApiFieldType::Triplet, true,  0, 255 },
+    { "range_start", ApiFieldType::Int,     false, 0, NUM_LEDS - 1 },
+    { "range_size",  ApiFieldType::Int,     false, 0, NUM_LEDS },
+  };
+
+  static constexpr ApiField FILL_GRADIENT_FIELDS[] = {
+    { "colors",      ApiFieldType::TripletList, true,  0, 255 },
+    // "rgb" (default) or "hsv"
+    { "space",       ApiFieldType::Text,        false, 3, 3 },
+    { "range_start", ApiFieldType::Int,         false, 0, NUM_LEDS - 1 },
+    { "range_size",  ApiFieldType::Int,         false, 0, NUM_LEDS },
+  };
+
+  static constexpr ApiField FILL_RAINBOW_FIELDS[] = {
+    { "initial_hue", ApiFieldType::Int, false, 0, 255 },
+    // In 1/256ths of a hue per pixel
+    { "hue_step",    ApiFieldType::Int, false, 0, 65535 },
+    { "range_start", ApiFieldType::Int, false, 0, NUM_LEDS - 1 },
+    { "range_size",  ApiFieldType::Int, false, 0, NUM_LEDS },
+  };
+
+  static constexpr ApiField SET_BRIGHTNESS_FIELDS[] = {
+    { "value", ApiFieldType::Int, true, 0, LED_MAX_BRIGHTNESS },
+  };
+
+  static constexpr ApiField SET_PARAM_FIELDS[] = {
+    { "name",  ApiFieldType::Text, true, 1, 16 },
+    { "value", ApiFieldType::Int,  true, INT32_MIN, INT32_MAX },
+  };
+
+  static constexpr ApiOp<Handler> OPS[] = {
+    { "fill_solid",     &Api::handle_fill_solid,    API_FIELDS(FILL_SOLID_FIELDS) },
+    { "fill_gradient",  &Api::handle_fill_gradient, API_FIELDS(FILL_GRADIENT_FIELDS) },
+    { "fill_rainbow",   &Api::handle_fill_rainbow,  API_FIELDS(FILL_RAINBOW_FIELDS) },
+    { "status",         &Api::handle_status,        API_NO_FIELDS },
+    { "reboot",         &Api::handle_reboot,        API_NO_FIELDS },
+    { "set_brightness", &Api::handle_brightness,    API_FIELDS(SET_BRIGHTNESS_FIELDS) },
+    { "set_param",      &Api::handle_set_param,     API_FIELDS(SET_PARAM_FIELDS) },
+    { "heap_stats",     &Api::handle_heap_stats,    API_NO_FIELDS },
+  };
+
+  static constexpr ApiOpIndex<4> INDEX = make_api_op_index<4>(OPS);
+  static_assert(INDEX.seed != 0, "No perfect hash for the API ops: increase the index size");
+
+  static const ApiOp<Handler> *find(const char *name) {
+    return INDEX.find(OPS, name);
+  }
+};
+
+#endif // __LED_API_OPS_H__
@@ -4,12 +4,31 @@
 #include <Arduino.h>
 #include <FastLED.h>
 
+#include "LedMatrix.h"
+#include "LedDither.h"
+#include "LedFill.h"
+
 // The max brightness value is 255 as far as FastLED is concerned but it may
 // be necessary to lower the max brightness since after a certain threshold
 // colors start losing accuracy (also this can be used as an implicit power
 // limitation).
 #define LED_MAX_BRIGHTNESS 255
 
+// Brightness changes are spread over a few frames instead of being applied in
+// one go: every frame covers 1/LED_BRIGHTNESS_RAMP_DIVISOR of the distance
+// left to the target brightness.
+#define LED_BRIGHTNESS_RAMP_DIVISOR 6
+
+/*
+ * Build with -DLED_HIGH_BIT_DEPTH to enable the high bit depth pipeline:
+ * brightness is applied at 16 bit precision and the result is dithered over
+ * time down to the 8 bits the strip understands, which avoids the banding of
+ * low brightness levels. Animations can also render straight into the 16 bit
+ * `leds16` buffer (see LedAnim::renders_hd()) for smoother fades. This costs
+ * 12 extra bytes of RAM per led (`leds16`, `output` and the dithering
+ * residual).
+ */
+
 /**
  * Collection of methods to control leds and ranges of leds
  */
@@ -17,11 +36,16 @@ class LedControl {
 public:
   CRGB *leds;
 
+  #ifdef LED_HIGH_BIT_DEPTH
+    CRGB16 leds16[NUM_LEDS];
+    // What's actually sent to the strip.
+    CRGB output[NUM_LEDS];
+  #endif
+
   LedControl(CRGB leds[]) : leds(leds){}
 
   void set_brightness(uint8_t brightness) {
     this->brightness = brightness;
-    FastLED.setBrightness(brightness);
     #ifdef ENABLE_SERIAL_DEBUG
       Serial.print("set_brightness(");
       Serial.print(this->brightness);
@@ -46,22 +70,137 @@ public:
   }
 
   inline void commit() {
+    ramp_brightness();
+
+    #ifdef LED_HIGH_BIT_DEPTH
+      if (hd_source) {
+        dither_output(leds16, output, dither_residual, NUM_LEDS, output_brightness);
+      } else {
+        dither_output(leds, output, dither_residual, NUM_LEDS, output_brightness);
+      }
+    #else
+      FastLED.setBrightness(output_brightness >> 8);
+    #endif
+
     FastLED.show();
   }
 
+  #ifdef LED_HIGH_BIT_DEPTH
+    // Whether the current animation renders into `leds16` rather than `leds`.
+    void set_hd_source(bool hd_source) {
+      this->hd_source = hd_source;
+    }
+
+    inline void fill_solid16(const CRGB16 color) {
+      std::fill_n(leds16, NUM_LEDS, color);
+      // Keep the 8 bit buffer in sync as it's what the API reports.
+      std::fill_n(leds, NUM_LEDS, color.to_crgb());
+    }
+  #endif
+
+  // Boundary checks: make sure we only fill ranges in 0..num_leds-1. The
+  // range fills below apply it, callers can too to know what they'll get.
+  static inline void clamp_range(uint16_t &first, uint16_t &count) {
+    first = first >= NUM_LEDS ? NUM_LEDS - 1 : first;
+    count = first + count > NUM_LEDS ? NUM_LEDS - first : count;
+  }
+
   /**
    * A more flexible version of the fill_solid method that FastLED provides
    * that allows to fill ranges of LEDs. By default, it will fill the whole
    * strip.
    */
-  inline void fill_solid(const CRGB color, uint8_t first = 0, uint8_t count = -1) {
-    if (count < 0) count = NUM_LEDS;
-
-    // Boundary checks: make sure we only fill ranges in 0..num_leds-1
-    first = first >= NUM_LEDS ? NUM_LEDS - 1 : first;
-    count = first + count > NUM_LEDS ? NUM_LEDS - first : count;
+  inline void fill_solid(const CRGB color, uint16_t first = 0, uint16_t count = NUM_LEDS) {
+    clamp_range(first, count);
 
     std::fill_n(&leds[first], count, color);
+    #ifdef LED_HIGH_BIT_DEPTH
+      std::fill_n(&leds16[first], count, CRGB16(color));
+    #endif
+  }
+
+  /**
+   * Gradients through evenly spaced color stops, interpolated in RGB or HSV
+   * (see LedFill.h), over a range of LEDs.
+   */
+  template <typename Color>
+  inline void fill_gradient(const Color *stops, uint8_t stop_count,
+                            uint16_t first = 0, uint16_t count = NUM_LEDS) {
+    clamp_range(first, count);
+
+    fill_gradient_ramp(&leds[first], count, stops, stop_count);
+    sync_hd(first, count);
+  }
+
+  /**
+   * Rainbow over a range of LEDs, moving by `hue_step` 1/256ths of a hue
+   * at every pixel.
+   */
+  inline void fill_rainbow(uint8_t initial_hue, uint16_t hue_step,
+                           uint16_t first = 0, uint16_t count = NUM_LEDS) {
+    clamp_range(first, count);
+
+    fill_rainbow_ramp(&leds[first], count, initial_hue, hue_step);
+    sync_hd(first, count);
+  }
+
+  /**
+   * 2D primitives, see LedMatrix.h for the layout. Coordinates are signed so
+   * that shapes can be partially outside of the matrix: they're clipped.
+   * Like the range fills they write both buffers with LED_HIGH_BIT_DEPTH.
+   */
+  inline void set_xy(int16_t x, int16_t y, const CRGB color) {
+    if (x < 0 || y < 0 || x >= MATRIX_COLS || y >= MATRIX_ROWS) return;
+    const uint16_t i = XY(x, y);
+    leds[i] = color;
+    #ifdef LED_HIGH_BIT_DEPTH
+      leds16[i] = CRGB16(color);
+    #endif
+  }
+
+  inline void fill_rect(int16_t x, int16_t y, int16_t w, int16_t h, const CRGB color) {
+    const int16_t x0 = std::max(x, (int16_t)0);
+    const int16_t y0 = std::max(y, (int16_t)0);
+    const int16_t x1 = std::min((int32_t)x + w, (int32_t)MATRIX_COLS);
+    const int16_t y1 = std::min((int32_t)y + h, (int32_t)MATRIX_ROWS);
+    #ifdef LED_HIGH_BIT_DEPTH
+      const CRGB16 color16 = CRGB16(color);
+    #endif
+
+    for (int16_t row = y0; row < y1; row++) {
+      for (int16_t col = x0; col < x1; col++) {
+        const uint16_t i = XY(col, row);
+        leds[i] = color;
+        #ifdef LED_HIGH_BIT_DEPTH
+          leds16[i] = color16;
+        #endif
+      }
+    }
+  }
+
+  // Bresenham's line, both ends included. The error terms are 32 bits wide
+  // as the ends can be anywhere in the int16_t range.
+  void draw_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, const CRGB color) {
+    const int32_t dx = abs((int32_t)x1 - x0);
+    const int32_t dy = -abs((int32_t)y1 - y0);
+    const int8_t sx = x0 < x1 ? 1 : -1;
+    const int8_t sy = y0 < y1 ? 1 : -1;
+    int32_t err = dx + dy;
+
+    while (true) {
+      set_xy(x0, y0, color);
+      if (x0 == x1 && y0 == y1) break;
+
+      const int32_t e2 = 2 * err;
+      if (e2 >= dy) {
+        err += dy;
+        x0 += sx;
+      }
+      if (e2 <= dx) {
+        err += dx;
+        y0 += sy;
+      }
+    }
   }
 
   inline bool u8_blend_to_u8(uint8_t &curr,
@@ -85,8 +224,58 @@ public:
     return r == true || g == true || b == true;
   }
 
+  inline bool u16_blend_to_u16(uint16_t &curr,
+                               const uint16_t target,
+                               const uint8_t scale) {
+    const uint16_t diff = curr < target ? target - curr : curr - target;
+    if (diff == 0) return false;
+
+    // Always move by at least one step so that we eventually get there.
+    const uint16_t delta = std::max(scale16by8(diff, scale), (uint16_t)1);
+    curr += curr < target ? delta : -delta;
+    return true;
+  }
+
+  inline bool crgb16_blend_to_crgb16(CRGB16 &curr,
+                                     const CRGB16 target,
+                                     const uint8_t scale) {
+    const bool r = u16_blend_to_u16(curr.r, target.r, scale);
+    const bool g = u16_blend_to_u16(curr.g, target.g, scale);
+    const bool b = u16_blend_to_u16(curr.b, target.b, scale);
+
+    // Returns true when any value has changed.
+    return r || g || b;
+  }
+
 private:
   uint8_t brightness = 0;
+  // Brightness currently applied to the output (0-65535), ramping towards
+  // `brightness`.
+  uint16_t output_brightness = 0;
+
+  #ifdef LED_HIGH_BIT_DEPTH
+    bool hd_source = false;
+    CRGB dither_residual[NUM_LEDS];
+  #endif
+
+  // Copies a range rendered in 8 bits over to the 16 bit buffer.
+  inline void sync_hd(uint16_t first, uint16_t count) {
+    #ifdef LED_HIGH_BIT_DEPTH
+      for (uint16_t i = first; i < first + count; i++) {
+        leds16[i] = CRGB16(leds[i]);
+      }
+    #endif
+  }
+
+  inline void ramp_brightness() {
+    const int32_t target = brightness * 257;
+    const int32_t diff = target - output_brightness;
+    if (diff == 0) return;
+
+    int32_t step = diff / LED_BRIGHTNESS_RAMP_DIVISOR;
+    if (step == 0) step = diff > 0 ? 1 : -1;
+    output_brightness += step;
+  }
 };
 
 #endif // __LED_CONTROL_H__
@@ -0,0 +1,332 @@
+#ifndef __LED_CYCLE_CACHE_H__
+#define __LED_CYCLE_CACHE_H__
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <LittleFS.h>
+
+#include "LedAnim.h"
+#include "LedSequence.h"
+
+/**
+ * Cache of the frames of periodic animations (see LedAnim::get_cycle), enabled
+ * with ENABLE_CYCLE_CACHE.
+ *
+ * Once a periodic animation has been running live for CYCLE_CACHE_SETTLE_MS,
+ * its cycle is rendered a few frames at a time, after each frame, and encoded
+ * to a sequence file on LittleFS. Once the whole cycle is there the animation
+ * isn't drawn anymore: frames are decoded from the file when they're due. The
+ * file is kept, so switching back to the animation later plays it back from
+ * the cache straight away.
+ *
+ * Frames are written as delta frames, with a keyframe every
+ * CYCLE_CACHE_KEYFRAME_INTERVAL frames. Next to the file, an index holds the
+ * offset of every keyframe (4 bytes each, little endian), so that playback
+ * starts at whichever frame is due, or catches up after a stall, by decoding
+ * from the keyframe before it.
+ *
+ * Nothing is written unless the file fits in the filesystem, at its largest,
+ * with CYCLE_CACHE_FS_RESERVE_BYTES to spare. A cache that couldn't be built,
+ * or turned out to be corrupt, isn't tried again until reboot: the animation
+ * is drawn live.
+ *
+ * Frames are cached before brightness and color correction, which are only
+ * applied on output, so the cache stays valid when those change. It does
+ * need to be invalidated when an animation's rendering changes: bump
+ * CYCLE_CACHE_VERSION.
+ */
+
+#define CYCLE_CACHE_VERSION 2
+#define CYCLE_CACHE_TMP_PATH "/cycle.tmp"
+#define CYCLE_CACHE_INDEX_TMP_PATH "/cycle_idx.tmp"
+
+// Frames rendered and written to the cache after each frame.
+#define CYCLE_CACHE_SLICE_FRAMES 4
+
+// Frames from one keyframe to the next. Seeking decodes up to that many.
+#define CYCLE_CACHE_KEYFRAME_INTERVAL 16
+
+// How long an animation runs live before its cache is built, so that
+// clicking through the effects doesn't write anything.
+#define CYCLE_CACHE_SETTLE_MS 5000
+
+// Left free on the filesystem, for sequence uploads.
+#define CYCLE_CACHE_FS_RESERVE_BYTES (64 * 1024)
+
+// Animations whose cache failed, remembered until reboot.
+#define CYCLE_CACHE_MAX_FAILED 4
+
+class CycleCache {
+public:
+  /**
+   * Plays `anim` back from the cache if it's already there, or gets ready to
+   * build its cache once it has been running for a while. Does nothing for
+   * animations that aren't periodic.
+   */
+  void begin(LedAnim *anim, uint32_t now_ms) {
+    end();
+
+    #ifdef LED_HIGH_BIT_DEPTH
+      // Frames are cached at 8 bits per channel.
+      if (anim->renders_hd()) return;
+    #endif
+    if (!anim->get_cycle(cycle) || cycle.frames == 0 || cycle.frame_ms == 0) return;
+    if (has_failed(anim->name())) return;
+
+    this->anim = anim;
+    snprintf(path, sizeof(path), "/cycle%u_%s.lbs", CYCLE_CACHE_VERSION, anim->name());
+    snprintf(index_path, sizeof(index_path), "/cycle%u_%s.idx", CYCLE_CACHE_VERSION, anim->name());
+
+    if (open_cache()) {
+      #ifdef ENABLE_SERIAL_DEBUG
+        Serial.print(F("Cycle cache: playing back "));
+        Serial.println(path);
+      #endif
+      return;
+    }
+
+    begin_ms = now_ms;
+    build_frame = 0;
+  }
+
+  // Stops playback, throwing away the cache if it isn't complete yet.
+  void end() {
+    if (writer.is_open()) {
+      writer.close();
+      LittleFS.remove(CYCLE_CACHE_TMP_PATH);
+    }
+    if (index_writer) {
+      index_writer.close();
+      LittleFS.remove(CYCLE_CACHE_INDEX_TMP_PATH);
+    }
+    reader.close();
+    if (index) {
+      index.close();
+    }
+    anim = nullptr;
+  }
+
+  bool is_ready() {
+    return reader.is_open();
+  }
+
+  /**
+   * Renders the next few frames of the cycle into the cache, once the
+   * animation has settled. Call it once per frame, after showing it: it costs
+   * at most CYCLE_CACHE_SLICE_FRAMES frames' worth of rendering and encoding.
+   */
+  void build_slice(uint32_t now_ms) {
+    if (anim == nullptr || is_ready()) return;
+    if (!writer.is_open()) {
+      if (now_ms - begin_ms < CYCLE_CACHE_SETTLE_MS) return;
+      if (!start_build()) {
+        anim = nullptr;
+        return;
+      }
+    }
+
+    for (uint8_t i = 0; i < CYCLE_CACHE_SLICE_FRAMES && build_frame < cycle.frames; i++) {
+      anim->draw_cycle_frame(frame, build_frame);
+      const bool keyframe = build_frame % CYCLE_CACHE_KEYFRAME_INTERVAL == 0;
+      if (keyframe) {
+        uint8_t offset[4];
+        put_u32(offset, writer.size());
+        if (index_writer.write(offset, sizeof(offset)) != sizeof(offset)) {
+          fail();
+          return;
+        }
+      }
+      if (!writer.write_frame(frame, cycle.frame_ms, keyframe ? nullptr : previous)) {
+        fail();
+        return;
+      }
+      memcpy(previous, frame, sizeof(frame));
+      build_frame++;
+    }
+
+    if (build_frame < cycle.frames) return;
+
+    #ifdef ENABLE_SERIAL_DEBUG
+      const uint32_t size = writer.size();
+    #endif
+    const bool complete = writer.close();
+    index_writer.close();
+    remove_cache();
+    if (!complete ||
+        !LittleFS.rename(CYCLE_CACHE_TMP_PATH, path) ||
+        !LittleFS.rename(CYCLE_CACHE_INDEX_TMP_PATH, index_path) ||
+        !open_cache()) {
+      LittleFS.remove(CYCLE_CACHE_TMP_PATH);
+      LittleFS.remove(CYCLE_CACHE_INDEX_TMP_PATH);
+      remove_cache();
+      fail();
+      return;
+    }
+
+    #ifdef ENABLE_SERIAL_DEBUG
+      Serial.print(F("Cycle cache: "));
+      Serial.print(path);
+      Serial.print(F(" complete, "));
+      Serial.print(size);
+      Serial.println(F(" bytes"));
+    #endif
+  }
+
+  /**
+   * Draws the frame due at `now_ms` into `leds`, if it's not already there.
+   * Decodes on from the frame shown last, or from the keyframe before the one
+   * due when that's closer. Returns false if the animation should be drawn
+   * live instead.
+   */
+  bool draw(CRGB *leds, uint32_t now_ms) {
+    if (!reader.is_open()) return false;
+
+    const uint16_t due = (now_ms / cycle.frame_ms) % cycle.frames;
+    if (due == shown_frame) return true;
+
+    // Delta frames apply to `frame`, which holds the last one decoded.
+    uint16_t from = next_frame;
+    const uint16_t since_keyframe = due % CYCLE_CACHE_KEYFRAME_INTERVAL;
+    if (due < next_frame || due - next_frame > since_keyframe) {
+      from = due - since_keyframe;
+      if (!seek(due / CYCLE_CACHE_KEYFRAME_INTERVAL)) {
+        return corrupt();
+      }
+    }
+    // The reader loops back to the first frame by itself.
+    for (uint16_t n = from; n <= due; n++) {
+      if (reader.next_frame(frame, NUM_LEDS) == 0) {
+        return corrupt();
+      }
+    }
+    memcpy(leds, frame, sizeof(frame));
+
+    next_frame = due + 1 < cycle.frames ? due + 1 : 0;
+    shown_frame = due;
+    return true;
+  }
+
+private:
+  LedAnim *anim = nullptr;
+  AnimCycle cycle;
+  char path[32];
+  char index_path[32];
+  const char *failed[CYCLE_CACHE_MAX_FAILED];
+  uint8_t failed_count = 0;
+
+  uint32_t begin_ms = 0;
+  SequenceWriter writer;
+  File index_writer;
+  uint16_t build_frame = 0;
+  CRGB previous[NUM_LEDS];
+
+  // The frame being built, or the last one played back.
+  CRGB frame[NUM_LEDS];
+
+  SequenceReader reader;
+  File index;
+  uint16_t next_frame = 0;
+  int32_t shown_frame = -1;
+
+  uint16_t keyframe_count() {
+    return (cycle.frames + CYCLE_CACHE_KEYFRAME_INTERVAL - 1) / CYCLE_CACHE_KEYFRAME_INTERVAL;
+  }
+
+  // Size of the cache and its index if no frame compressed at all.
+  uint32_t max_size() {
+    const uint32_t max_frame_bytes = 3 + NUM_LEDS * 3 +
+                                     (NUM_LEDS + SEQUENCE_OP_MAX_COUNT - 1) / SEQUENCE_OP_MAX_COUNT;
+    return SEQUENCE_HEADER_BYTES + cycle.frames * max_frame_bytes + keyframe_count() * 4;
+  }
+
+  bool start_build() {
+    FSInfo info;
+    if (!LittleFS.info(info) ||
+        info.usedBytes + max_size() + CYCLE_CACHE_FS_RESERVE_BYTES > info.totalBytes) {
+      #ifdef ENABLE_SERIAL_DEBUG
+        Serial.print(F("Cycle cache: no room for "));
+        Serial.println(path);
+      #endif
+      return false;
+    }
+
+    index_writer = LittleFS.open(CYCLE_CACHE_INDEX_TMP_PATH, "w");
+    if (!index_writer || !writer.open(CYCLE_CACHE_TMP_PATH, NUM_LEDS, cycle.frames)) {
+      fail();
+      return false;
+    }
+    return true;
+  }
+
+  bool open_cache() {
+    if (!LittleFS.exists(path) || !reader.open(path)) return false;
+
+    if (LittleFS.exists(index_path)) {
+      index = LittleFS.open(index_path, "r");
+    }
+    if (reader.get_led_count() != NUM_LEDS || reader.get_frame_count() != cycle.frames ||
+        !index || index.size() != (size_t)keyframe_count() * 4) {
+      reader.close();
+      if (index) {
+        index.close();
+      }
+      remove_cache();
+      return false;
+    }
+
+    next_frame = 0;
+    shown_frame = -1;
+    return true;
+  }
+
+  // Moves the reader to keyframe `n`, using the index.
+  bool seek(uint16_t n) {
+    uint8_t offset[4];
+    return index.seek((uint32_t)n * 4, SeekSet) &&
+           index.read(offset, sizeof(offset)) == sizeof(offset) &&
+           reader.seek_frame((uint32_t)n * CYCLE_CACHE_KEYFRAME_INTERVAL, get_u32(offset));
+  }
+
+  bool corrupt() {
+    #ifdef ENABLE_SERIAL_DEBUG
+      Serial.println(F("Cycle cache: corrupt, removing it."));
+    #endif
+    reader.close();
+    index.close();
+    remove_cache();
+    fail();
+    return false;
+  }
+
+  // Gives up on the animation's cache until reboot.
+  void fail() {
+    if (anim != nullptr && failed_count < CYCLE_CACHE_MAX_FAILED) {
+      failed[failed_count++] = anim->name();
+    }
+    end();
+  }
+
+  bool has_failed(const char *name) {
+    for (uint8_t i = 0; i < failed_count; i++) {
+      if (strcmp(failed[i], name) == 0) return true;
+    }
+    return false;
+  }
+
+  void remove_cache() {
+    LittleFS.remove(path);
+    LittleFS.remove(index_path);
+  }
+
+  static void put_u32(uint8_t *dst, uint32_t value) {
+    for (uint8_t i = 0; i < 4; i++) {
+      dst[i] = value >> (8 * i);
+    }
+  }
+
+  static uint32_t get_u32(const uint8_t *src) {
+    return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+  }
+};
+
+#endif // __LED_CYCLE_CACHE_H__
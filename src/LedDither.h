@@ -0,0 +1,69 @@
+#ifndef __LED_DITHER_H__
+#define __LED_DITHER_H__
+
+#include <FastLED.h>
+
+/**
+ * 16 bit per channel color, used by the high bit depth pipeline (see
+ * LED_HIGH_BIT_DEPTH in LedControl.h).
+ */
+struct CRGB16 {
+  uint16_t r = 0;
+  uint16_t g = 0;
+  uint16_t b = 0;
+
+  CRGB16() {}
+  CRGB16(uint16_t r, uint16_t g, uint16_t b) : r(r), g(g), b(b) {}
+
+  // 0xAB becomes 0xABAB so that 0xFF maps to full scale.
+  explicit CRGB16(const CRGB c) : r(c.r * 257), g(c.g * 257), b(c.b * 257) {}
+
+  inline bool operator==(const CRGB16 &o) const {
+    return r == o.r && g == o.g && b == o.b;
+  }
+
+  inline bool operator!=(const CRGB16 &o) const {
+    return !(*this == o);
+  }
+
+  inline CRGB to_crgb() const {
+    return CRGB(r >> 8, g >> 8, b >> 8);
+  }
+};
+
+inline uint16_t dither_channel_value(const CRGB16 &c, uint8_t channel) {
+  return channel == 0 ? c.r : (channel == 1 ? c.g : c.b);
+}
+
+inline uint16_t dither_channel_value(const CRGB &c, uint8_t channel) {
+  return c.raw[channel] * 257;
+}
+
+/**
+ * Scales a 16 bit value by `scale` (0-65535) and reduces it to 8 bits,
+ * carrying what's lost over to the next frame through `residual`: over a few
+ * frames the average output matches the 16 bit value (temporal error
+ * diffusion).
+ */
+inline uint8_t dither_channel(uint16_t value, uint16_t scale, uint8_t &residual) {
+  const uint32_t acc = (((uint32_t)value * scale) >> 16) + residual;
+  residual = acc & 0xFF;
+  return acc > 0xFFFF ? 255 : acc >> 8;
+}
+
+/**
+ * Output pass of the high bit depth pipeline: applies the brightness to
+ * every pixel of `src` (either CRGB or CRGB16) at 16 bit precision and
+ * dithers the result down to `dst`. `residual` holds the per channel error
+ * carried across frames and must live as long as the strip.
+ */
+template <typename T>
+inline void dither_output(const T *src, CRGB *dst, CRGB *residual, uint16_t count, uint16_t scale) {
+  for (uint16_t i = 0; i < count; i++) {
+    for (uint8_t c = 0; c < 3; c++) {
+      dst[i].raw[c] = dither_channel(dither_channel_value(src[i], c), scale, residual[i].raw[c]);
+    }
+  }
+}
+
+#endif // __LED_DITHER_H__
@@ -0,0 +1,212 @@
+#ifndef __LED_FILL_H__
+#define __LED_FILL_H__
+
+#include <FastLED.h>
+
+/**
+ * Gradient and rainbow fill kernels. Colors are computed incrementally in
+ * fixed point along the range rather than converted from scratch for every
+ * pixel:
+ *
+ * - RGB ramps step every channel by a constant 16.16 increment.
+ * - HSV ramps (and rainbows) rely on FastLED's rainbow conversion being
+ *   piecewise linear in the hue, with a knot every 32 hues: the pixels at
+ *   both ends of each section are converted exactly and the ones in between
+ *   are interpolated in RGB. That's two conversions every 32 hues, however
+ *   many pixels they're spread over. Saturation and value aren't linear, so
+ *   ramps through them are cut shorter.
+ *
+ * On a host, setting up a ramp costs about as much as converting 20 to 30
+ * pixels (see test/test_fill), so steps leaving fewer than
+ * FILL_MIN_RAMP_PIXELS pixels per ramp are converted pixel by pixel. A whole rainbow needs at least 256
+ * pixels to be ramped: the default rainbow over a 60 led strip, 7.5 pixels
+ * per section, is converted pixel by pixel.
+ *
+ * Hues, saturations and values are 8.8 fixed point so that long ranges can
+ * change by less than one hue per pixel.
+ *
+ * Nothing in here depends on the board other than FastLED's color types, so
+ * the kernels can be checked against per-pixel conversions on a host.
+ */
+
+#define FILL_HUE_SECTION_BITS 13 // 32 hues, in 8.8
+// Pixels per ramp below which they're converted one by one.
+#define FILL_MIN_RAMP_PIXELS 32
+// Most saturation or value a single ramp covers, in 8.8: they don't scale
+// colors linearly, so ramps through them have to be shorter than sections.
+#define FILL_MAX_RAMP_SV (32 << 8)
+
+inline CRGB fill_hsv_color(int32_t hue, int32_t sat, int32_t val) {
+  return CHSV((hue >> 8) & 0xFF, sat >> 8, val >> 8);
+}
+
+/**
+ * Fills `len` pixels going from `a` towards `b` in RGB, `b` being reached at
+ * pixel `span` (which may be past the end of the range).
+ */
+inline void fill_rgb_ramp(CRGB *leds, uint16_t len, const CRGB a, const CRGB b, uint16_t span) {
+  // One division for the three channels: 1 / span in 8.24.
+  const int32_t inverse = span > 0 ? (1 << 24) / span : 0;
+  int32_t acc[3];
+  int32_t step[3];
+  for (uint8_t c = 0; c < 3; c++) {
+    acc[c] = a.raw[c] * 65536 + 0x8000;
+    step[c] = (int64_t)((int32_t)b.raw[c] - a.raw[c]) * inverse / 256;
+  }
+
+  for (uint16_t i = 0; i < len; i++) {
+    leds[i] = CRGB(acc[0] >> 16, acc[1] >> 16, acc[2] >> 16);
+    acc[0] += step[0];
+    acc[1] += step[1];
+    acc[2] += step[2];
+  }
+}
+
+/**
+ * Whether fill_hsv_ramp() interpolates with these steps, rather than
+ * converting every pixel.
+ */
+inline bool fill_hsv_uses_ramp(int32_t hue_step, int32_t sat_step, int32_t val_step) {
+  return (uint32_t)abs(hue_step) * FILL_MIN_RAMP_PIXELS <= (1 << FILL_HUE_SECTION_BITS) &&
+         (uint32_t)abs(sat_step) * FILL_MIN_RAMP_PIXELS <= FILL_MAX_RAMP_SV &&
+         (uint32_t)abs(val_step) * FILL_MIN_RAMP_PIXELS <= FILL_MAX_RAMP_SV;
+}
+
+/**
+ * Converts every pixel, for steps too steep to be worth a ramp. Kept out of
+ * line: inlined into fill_hsv_ramp() it ran 3 times slower on a host.
+ */
+__attribute__((noinline))
+inline void fill_hsv_per_pixel(CRGB *leds, uint16_t len,
+                               int32_t hue, int32_t hue_step,
+                               int32_t sat, int32_t sat_step,
+                               int32_t val, int32_t val_step) {
+  for (uint16_t i = 0; i < len; i++) {
+    leds[i] = fill_hsv_color(hue, sat, val);
+    hue = (hue + hue_step) & 0xFFFF;
+    sat += sat_step;
+    val += val_step;
+  }
+}
+
+/**
+ * Fills `len` pixels starting from (`hue`, `sat`, `val`) and moving by the
+ * given steps at every pixel, all in 8.8 fixed point. The hue wraps around.
+ */
+inline void fill_hsv_ramp(CRGB *leds, uint16_t len,
+                          int32_t hue, int32_t hue_step,
+                          int32_t sat, int32_t sat_step,
+                          int32_t val, int32_t val_step) {
+  // With steep steps, ramps only span a few pixels and setting up each costs
+  // more than converting them.
+  if (!fill_hsv_uses_ramp(hue_step, sat_step, val_step)) {
+    fill_hsv_per_pixel(leds, len, hue, hue_step, sat, sat_step, val, val_step);
+    return;
+  }
+
+  uint16_t i = 0;
+
+  while (i < len) {
+    hue &= 0xFFFF;
+
+    // Number of pixels (from i) whose hue is in the same section.
+    uint32_t n = len - i;
+    if (hue_step != 0) {
+      const int32_t section_start = (hue >> FILL_HUE_SECTION_BITS) << FILL_HUE_SECTION_BITS;
+      const int32_t section_end = section_start + (1 << FILL_HUE_SECTION_BITS) - 1;
+      const uint32_t in_section = hue_step > 0
+        ? (section_end - hue) / hue_step + 1
+        : (hue - section_start) / -hue_step + 1;
+      n = std::min(n, in_section);
+    }
+    if (sat_step != 0) {
+      n = std::min(n, (uint32_t)(FILL_MAX_RAMP_SV / abs(sat_step)) + 1);
+    }
+    if (val_step != 0) {
+      n = std::min(n, (uint32_t)(FILL_MAX_RAMP_SV / abs(val_step)) + 1);
+    }
+
+    const CRGB first = fill_hsv_color(hue, sat, val);
+    if (n == 1) {
+      leds[i] = first;
+    } else {
+      const int32_t last = n - 1;
+      fill_rgb_ramp(&leds[i], n, first,
+                    fill_hsv_color(hue + last * hue_step, sat + last * sat_step, val + last * val_step),
+                    last);
+    }
+
+    hue += n * hue_step;
+    sat += n * sat_step;
+    val += n * val_step;
+    i += n;
+  }
+}
+
+/**
+ * Rainbow starting at `hue` and moving by `hue_step` (in 1/256ths of a hue,
+ * so 256 is FastLED's fill_rainbow with a delta of 1) at every pixel.
+ */
+inline void fill_rainbow_ramp(CRGB *leds, uint16_t len, uint8_t hue, uint16_t hue_step) {
+  fill_hsv_ramp(leds, len, (int32_t)hue << 8, hue_step, 255 << 8, 0, 255 << 8, 0);
+}
+
+// Hue step of exactly one rainbow over `len` pixels.
+inline uint16_t fill_rainbow_step(uint16_t len) {
+  return std::min<uint32_t>(65536 / std::max<uint16_t>(len, 1), 65535);
+}
+
+/**
+ * Gradient through `stop_count` colors spread evenly over `len` pixels, the
+ * first and the last one being exactly the first and last stop.
+ */
+inline void fill_gradient_ramp(CRGB *leds, uint16_t len, const CRGB *stops, uint8_t stop_count) {
+  if (len == 0 || stop_count == 0) return;
+  if (len == 1 || stop_count == 1) {
+    std::fill_n(leds, len, stops[0]);
+    return;
+  }
+
+  // Stop k sits on pixel k * (len - 1) / (stop_count - 1).
+  uint16_t start = 0;
+  for (uint8_t k = 0; k + 1 < stop_count; k++) {
+    const uint16_t end = (uint32_t)(k + 1) * (len - 1) / (stop_count - 1);
+    // The pixel of the next stop is left to the next segment.
+    fill_rgb_ramp(&leds[start], end - start, stops[k], stops[k + 1], end - start);
+    start = end;
+  }
+  leds[len - 1] = stops[stop_count - 1];
+}
+
+/**
+ * Same as above, interpolating in HSV. The hue takes the shortest way around
+ * the color wheel from one stop to the next.
+ */
+inline void fill_gradient_ramp(CRGB *leds, uint16_t len, const CHSV *stops, uint8_t stop_count) {
+  if (len == 0 || stop_count == 0) return;
+  if (len == 1 || stop_count == 1) {
+    std::fill_n(leds, len, CRGB(stops[0]));
+    return;
+  }
+
+  uint16_t start = 0;
+  for (uint8_t k = 0; k + 1 < stop_count; k++) {
+    const uint16_t end = (uint32_t)(k + 1) * (len - 1) / (stop_count - 1);
+    if (end > start) {
+      // Steps are rounded towards zero so the ramp never overshoots the
+      // next stop.
+      const CHSV &a = stops[k];
+      const CHSV &b = stops[k + 1];
+      const int32_t seg = end - start;
+
+      fill_hsv_ramp(&leds[start], seg,
+                    (int32_t)a.hue << 8, (int32_t)(int8_t)(b.hue - a.hue) * 256 / seg,
+                    (int32_t)a.sat << 8, ((int32_t)b.sat - a.sat) * 256 / seg,
+                    (int32_t)a.val << 8, ((int32_t)b.val - a.val) * 256 / seg);
+    }
+    start = end;
+  }
+  leds[len - 1] = stops[stop_count - 1];
+}
+
+#endif // __LED_FILL_H__
@@ -8,11 +8,26 @@
 
 #include "LedControl.h"
 #include "LedAnim.h"
+#include "SyncClock.h"
+#include "HeapTrack.h"
+#ifdef ENABLE_CYCLE_CACHE
+#  include "LedCycleCache.h"
+#endif
+
+// rendering a frame every 16ms is roughly equivalent to 60fps
+#define FRAME_INTERVAL_MS 16
 
 class LedManager {
 public:
   LedManager() {
-    FastLED.addLeds<WS2812B, DATA_PIN, GRB>(this->leds, NUM_LEDS).setCorrection(TypicalSMD5050);
+    #ifdef LED_HIGH_BIT_DEPTH
+      // Brightness and dithering are taken care of by LedControl.
+      FastLED.addLeds<WS2812B, DATA_PIN, GRB>(control.output, NUM_LEDS).setCorrection(TypicalSMD5050);
+      FastLED.setBrightness(255);
+      FastLED.setDither(DISABLE_DITHER);
+    #else
+      FastLED.addLeds<WS2812B, DATA_PIN, GRB>(this->leds, NUM_LEDS).setCorrection(TypicalSMD5050);
+    #endif
 
     swap_animation(AnimEffect::Initial);
   };
@@ -22,7 +37,7 @@ public:
 
     // The initial animation will have populated every led with 'black'. Force a
     // show as to avoid a "blink" from the strip when it's first powered up.
-    FastLED.show();
+    control.commit();
 
     swap_animation(AnimEffect::Solid);
   }
@@ -36,39 +51,107 @@ public:
   }
 
   void handle() {
-    current_animation->loop();
+    if (!render()) return;
 
-    // rendering a frame every 16ms is roughly equivalent to 60fps
-    EVERY_N_MILLIS(16) {
-      current_animation->draw();
-      FastLED.show();
-    }
+    #ifdef ENABLE_CYCLE_CACHE
+      // Fill the cache in the time left until the next frame. Writing files
+      // isn't rendering: it may allocate.
+      HeapScope heap_scope(HeapTag::Anim);
+      cycle_cache.build_slice(GET_MILLIS());
+    #endif
   }
 
   void next_effect() {
-    current_effect++;
-    if (current_effect >= 3) {
-      current_effect = 0;
-    }
+    do {
+      current_effect++;
+      if (current_effect >= AnimEffect::EffectCount) {
+        current_effect = 0;
+      }
+    } while (!effect_available(current_effect));
 
     swap_animation(current_effect);
   }
 
+  bool set_effect(int8_t effect) {
+    if (!effect_available(effect)) {
+      return false;
+    }
+
+    swap_animation(effect);
+    return true;
+  }
+
+  int8_t get_effect() {
+    return current_effect;
+  }
+
+  LedAnim *get_animation() {
+    return current_animation;
+  }
+
 private:
   CRGB leds[NUM_LEDS];
   LedControl control = LedControl(leds);
-  LedAnim *current_animation;
+  LedAnim *current_animation = NULL;
 
   int8_t current_effect = AnimEffect::Initial;
 
   uint8_t brightness = 0;
+  uint32_t last_frame = 0;
+
+  #ifdef ENABLE_CYCLE_CACHE
+    CycleCache cycle_cache;
+  #endif
+
+  // Renders and shows the next frame if it's due. Returns whether it did.
+  bool render() {
+    // Once started, rendering is expected not to allocate (see HeapTrack.h).
+    HeapScope heap_scope(HeapTag::Render);
+
+    #ifdef ENABLE_CYCLE_CACHE
+      const bool cached = cycle_cache.is_ready();
+    #else
+      const bool cached = false;
+    #endif
+
+    if (!cached) {
+      current_animation->loop();
+    }
+
+    // Frames are rendered on a fixed grid of the (shared) clock rather than
+    // 16ms after the previous one so that synced ledboxes show them at the
+    // same time.
+    const uint32_t frame = GET_MILLIS() / FRAME_INTERVAL_MS;
+    if (frame == last_frame) {
+      return false;
+    }
+
+    last_frame = frame;
+    if (!cached || !draw_cached()) {
+      current_animation->draw();
+    }
+    control.commit();
+    return true;
+  }
+
+  inline bool draw_cached() {
+    #ifdef ENABLE_CYCLE_CACHE
+      return cycle_cache.draw(control.leds, GET_MILLIS());
+    #else
+      return false;
+    #endif
+  }
 
   void swap_animation(int8_t effect) {
+    HeapScope heap_scope(HeapTag::Anim);
+
     current_effect = effect;
     swap_animation(make_effect(effect));
   }
 
   void swap_animation(LedAnim *anim) {
+    HeapScope heap_scope(HeapTag::Anim);
+
     #ifdef ENABLE_SERIAL_DEBUG
       Serial.print("swap_animation(");
       Serial.print(anim->name());
@@ -76,11 +159,20 @@ private:
     #endif
     const LedAnim *old_anim = current_animation;
     if (current_animation != NULL) {
+      #ifdef ENABLE_CYCLE_CACHE
+        cycle_cache.end();
+      #endif
       current_animation->end();
     }
 
     current_animation = anim;
+    #ifdef LED_HIGH_BIT_DEPTH
+      control.set_hd_source(current_animation->renders_hd());
+    #endif
     current_animation->begin(&control);
+    #ifdef ENABLE_CYCLE_CACHE
+      cycle_cache.begin(current_animation, GET_MILLIS());
+    #endif
 
     if (old_anim != NULL) {
       delete old_anim;
@@ -0,0 +1,111 @@
+#ifndef __LED_MATRIX_H__
+#define __LED_MATRIX_H__
+
+#include <Arduino.h>
+
+/**
+ * 2D layout of the strip, declared at build time next to NUM_LEDS:
+ *
+ *   MATRIX_WIDTH, MATRIX_HEIGHT: size of the panel as wired, where the strip
+ *     starts at the top left corner and runs along the rows.
+ *   MATRIX_SERPENTINE: 1 when every other row runs backwards (the strip folds
+ *     back at the end of each row), 0 when all rows run left to right.
+ *   MATRIX_ROTATION: 0, 90, 180 or 270 degrees (clockwise) between the panel
+ *     as wired and the way it's looked at.
+ *
+ * Without a layout the strip is a single row of NUM_LEDS pixels. Coordinates
+ * used by XY() are the rotated ones, MATRIX_COLS x MATRIX_ROWS.
+ */
+
+#ifndef MATRIX_WIDTH
+#  define MATRIX_WIDTH NUM_LEDS
+#  define MATRIX_HEIGHT 1
+#endif
+
+#ifndef MATRIX_SERPENTINE
+#  define MATRIX_SERPENTINE 0
+#endif
+
+#ifndef MATRIX_ROTATION
+#  define MATRIX_ROTATION 0
+#endif
+
+#define MATRIX_COLS (MATRIX_ROTATION % 180 == 0 ? MATRIX_WIDTH : MATRIX_HEIGHT)
+#define MATRIX_ROWS (MATRIX_ROTATION % 180 == 0 ? MATRIX_HEIGHT : MATRIX_WIDTH)
+
+static_assert(MATRIX_WIDTH * MATRIX_HEIGHT <= NUM_LEDS, "The matrix needs more leds than NUM_LEDS");
+static_assert(MATRIX_ROTATION == 0 || MATRIX_ROTATION == 90 ||
+              MATRIX_ROTATION == 180 || MATRIX_ROTATION == 270,
+              "MATRIX_ROTATION must be one of 0, 90, 180 or 270");
+
+/**
+ * A panel layout, as described above. Only the one declared at build time
+ * (MATRIX_LAYOUT) ends up in XY_TABLE; the others are there for tests.
+ */
+struct MatrixLayout {
+  uint16_t width;
+  uint16_t height;
+  bool serpentine;
+  uint16_t rotation;
+};
+
+static constexpr MatrixLayout MATRIX_LAYOUT = {
+  MATRIX_WIDTH, MATRIX_HEIGHT, MATRIX_SERPENTINE != 0, MATRIX_ROTATION
+};
+
+/**
+ * Strip index of the pixel at (x, y) in `layout`, computed the long way.
+ * Only used to build XY_TABLE at compile time.
+ */
+constexpr uint16_t matrix_index(const MatrixLayout &layout, uint16_t x, uint16_t y) {
+  uint16_t px = x, py = y;
+
+  // Undo the rotation to get back to the panel as wired.
+  switch (layout.rotation) {
+    case 90:
+      px = y;
+      py = layout.height - 1 - x;
+      break;
+    case 180:
+      px = layout.width - 1 - x;
+      py = layout.height - 1 - y;
+      break;
+    case 270:
+      px = layout.width - 1 - y;
+      py = x;
+      break;
+  }
+
+  if (layout.serpentine && (py & 1)) {
+    px = layout.width - 1 - px;
+  }
+
+  return py * layout.width + px;
+}
+
+template <uint16_t COLS, uint16_t ROWS>
+struct XYTable {
+  uint16_t index[COLS * ROWS];
+};
+
+constexpr XYTable<MATRIX_COLS, MATRIX_ROWS> make_xy_table() {
+  XYTable<MATRIX_COLS, MATRIX_ROWS> table = {};
+  for (uint16_t y = 0; y < MATRIX_ROWS; y++) {
+    for (uint16_t x = 0; x < MATRIX_COLS; x++) {
+      table.index[y * MATRIX_COLS + x] = matrix_index(MATRIX_LAYOUT, x, y);
+    }
+  }
+  return table;
+}
+
+static constexpr XYTable<MATRIX_COLS, MATRIX_ROWS> XY_TABLE PROGMEM = make_xy_table();
+
+/**
+ * Strip index of the pixel at (x, y): a single load from the table in flash.
+ * Coordinates aren't checked, see LedControl for the clipped primitives.
+ */
+inline uint16_t XY(uint16_t x, uint16_t y) {
+  return pgm_read_word(&XY_TABLE.index[y * MATRIX_COLS + x]);
+}
+
+#endif // __LED_MATRIX_H__
@@ -0,0 +1,152 @@
+#ifndef __LED_PARTICLES_H__
+#define __LED_PARTICLES_H__
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+// Positions and velocities are fixed point numbers with this many fractional
+// bits, i.e. in 1/256ths of a pixel (per frame for velocities).
+#define PARTICLE_FRAC_BITS 8
+#define PARTICLE_ONE (1 << PARTICLE_FRAC_BITS)
+
+/**
+ * Fixed capacity pool of particles moving along the strip, for effects that
+ * need moving objects.
+ *
+ * Particles are stored as a structure of arrays and kept densely packed:
+ * spawning appends at the end and a dead particle is replaced by the last
+ * one, so both are O(1) and the update and splat passes only ever walk live
+ * particles. All the storage is part of the pool, nothing is allocated after
+ * construction.
+ *
+ * Every particle has a brightness that goes down by its `fade` every frame,
+ * the particle is recycled once it reaches zero or when it leaves the strip.
+ */
+template <uint16_t CAPACITY>
+class ParticlePool {
+public:
+  void clear() {
+    count = 0;
+  }
+
+  uint16_t size() const {
+    return count;
+  }
+
+  bool full() const {
+    return count == CAPACITY;
+  }
+
+  /**
+   * Adds a particle at `pos` moving by `vel` every frame. Returns false
+   * (and drops the particle) when the pool is full.
+   */
+  bool spawn(int32_t pos, int16_t vel, const CRGB color, uint8_t fade, uint8_t brightness = 255) {
+    if (full()) return false;
+
+    positions[count] = pos;
+    velocities[count] = vel;
+    colors[count] = color;
+    fades[count] = fade;
+    brightnesses[count] = brightness;
+    count++;
+    return true;
+  }
+
+  int32_t position(uint16_t i) const {
+    return positions[i];
+  }
+
+  int16_t velocity(uint16_t i) const {
+    return velocities[i];
+  }
+
+  const CRGB &color(uint16_t i) const {
+    return colors[i];
+  }
+
+  // Recycles particle `i`. The last particle takes its place.
+  void kill(uint16_t i) {
+    count--;
+    positions[i] = positions[count];
+    velocities[i] = velocities[count];
+    colors[i] = colors[count];
+    fades[i] = fades[count];
+    brightnesses[i] = brightnesses[count];
+  }
+
+  /**
+   * Moves every particle by its velocity, applies `gravity` to the velocity
+   * (in 1/256ths of a pixel per frame, per frame) and fades it, recycling
+   * the ones that die or leave the strip.
+   */
+  void update(uint16_t num_leds, int16_t gravity = 0) {
+    const int32_t min_pos = -PARTICLE_ONE;
+    const int32_t max_pos = (int32_t)num_leds * PARTICLE_ONE;
+
+    for (uint16_t i = 0; i < count;) {
+      velocities[i] += gravity;
+      positions[i] += velocities[i];
+
+      if (brightnesses[i] <= fades[i] || positions[i] <= min_pos || positions[i] >= max_pos) {
+        // Don't advance: the last particle has just been moved to `i`.
+        kill(i);
+        continue;
+      }
+
+      brightnesses[i] -= fades[i];
+      i++;
+    }
+  }
+
+  /**
+   * Adds every particle to `leds`. Particles sitting between two pixels are
+   * split across both in proportion to how close they are to each of them,
+   * so that slow particles move smoothly instead of jumping pixel to pixel.
+   */
+  void splat(CRGB *leds, uint16_t num_leds) const {
+    for (uint16_t i = 0; i < count; i++) {
+      const int32_t pixel = positions[i] >> PARTICLE_FRAC_BITS;
+      const uint8_t frac = positions[i] & (PARTICLE_ONE - 1);
+
+      CRGB c = colors[i];
+      c.nscale8_video(brightnesses[i]);
+
+      if (pixel >= 0 && pixel < num_leds) {
+        leds[pixel] += CRGB(c).nscale8(255 - frac);
+      }
+      if (pixel + 1 >= 0 && pixel + 1 < num_leds) {
+        leds[pixel + 1] += CRGB(c).nscale8(frac);
+      }
+    }
+  }
+
+private:
+  uint16_t count = 0;
+
+  int32_t positions[CAPACITY];
+  int16_t velocities[CAPACITY];
+  CRGB colors[CAPACITY];
+  uint8_t fades[CAPACITY];
+  uint8_t brightnesses[CAPACITY];
+};
+
+// Integer square root, rounded down.
+inline uint32_t particle_isqrt(uint32_t v) {
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+
+  while (bit > v) bit >>= 2;
+  while (bit != 0) {
+    if (v >= root + bit) {
+      v -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+#endif // __LED_PARTICLES_H__
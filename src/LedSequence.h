@@ -0,0 +1,416 @@
+#ifndef __LED_SEQUENCE_H__
+#define __LED_SEQUENCE_H__
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <LittleFS.h>
+
+/**
+ * Precomputed frame sequences ("light shows") stored on LittleFS.
+ *
+ * The file format is produced by tools/seq_encode.py (and by SequenceWriter
+ * on the device). All multi-byte values are little endian.
+ *
+ *   header:  "LBSQ" | version (u8) | reserved (u8) | led count (u16) |
+ *            frame count (u32)
+ *   frame:   flags (u8) | duration in ms (u16) | ops...
+ *
+ * A frame is a stream of ops that together cover exactly `led count` pixels.
+ * Each op is a single control byte where the two most significant bits are
+ * the op type and the remaining six bits are the pixel count minus one (so an
+ * op covers 1..64 pixels):
+ *
+ *   00 skip:     leave the pixels as they are (black in a keyframe)
+ *   01 run:      followed by one RGB triplet repeated for every pixel
+ *   10 literal:  followed by one RGB triplet per pixel
+ *
+ * Keyframes (flag bit 0) don't depend on the previous frame. The first frame
+ * is always a keyframe so that playback can loop back to it.
+ */
+
+#define SEQUENCE_PATH "/sequence.lbs"
+#define SEQUENCE_UPLOAD_PATH "/sequence.tmp"
+#define SEQUENCE_BACKUP_PATH "/sequence.bak"
+
+#define SEQUENCE_MAGIC "LBSQ"
+#define SEQUENCE_VERSION 1
+#define SEQUENCE_HEADER_BYTES 12
+
+#define SEQUENCE_FLAG_KEYFRAME 0x01
+
+#define SEQUENCE_OP_SKIP 0x00
+#define SEQUENCE_OP_RUN 0x40
+#define SEQUENCE_OP_LITERAL 0x80
+#define SEQUENCE_OP_MASK 0xC0
+#define SEQUENCE_OP_MAX_COUNT 64
+
+// Size of the read-ahead buffer. Frames are decoded straight from this buffer
+// into the led array, so the file never has to fit in RAM.
+#define SEQUENCE_READ_AHEAD_BYTES 64
+
+// Size of the write buffer of SequenceWriter.
+#define SEQUENCE_WRITE_BUFFER_BYTES 64
+
+// How far playback may fall behind the sequence's own timing before frames
+// are dropped instead of played back to back.
+#define SEQUENCE_MAX_LAG_MS 250
+
+class SequenceReader {
+public:
+  SequenceReader() {}
+
+  ~SequenceReader() {
+    close();
+  }
+
+  bool open(const char *path) {
+    close();
+
+    file = LittleFS.open(path, "r");
+    if (!file) {
+      #ifdef ENABLE_SERIAL_DEBUG
+        Serial.print("Sequence not found: ");
+        Serial.println(path);
+      #endif
+      return false;
+    }
+
+    uint8_t header[SEQUENCE_HEADER_BYTES];
+    if (file.read(header, sizeof(header)) != sizeof(header) ||
+        memcmp(header, SEQUENCE_MAGIC, 4) != 0 ||
+        header[4] != SEQUENCE_VERSION) {
+      #ifdef ENABLE_SERIAL_DEBUG
+        Serial.print("Invalid sequence file: ");
+        Serial.println(path);
+      #endif
+      close();
+      return false;
+    }
+
+    led_count = header[6] | (header[7] << 8);
+    frame_count = header[8] | (header[9] << 8) | (header[10] << 16) | ((uint32_t)header[11] << 24);
+    if (led_count == 0 || frame_count == 0) {
+      close();
+      return false;
+    }
+
+    frame_idx = 0;
+    buf_len = buf_pos = 0;
+    return true;
+  }
+
+  void close() {
+    if (file) {
+      file.close();
+    }
+    buf_len = buf_pos = 0;
+  }
+
+  bool is_open() {
+    return (bool)file;
+  }
+
+  uint16_t get_led_count() {
+    return led_count;
+  }
+
+  uint32_t get_frame_count() {
+    return frame_count;
+  }
+
+  bool rewind() {
+    frame_idx = 0;
+    buf_len = buf_pos = 0;
+    return file.seek(SEQUENCE_HEADER_BYTES, SeekSet);
+  }
+
+  /**
+   * Continues decoding from frame `index`, which starts at `offset` in the
+   * file. The file has no index of its own: offsets come from the caller
+   * (see position() and SequenceWriter::size()), and the frame has to be a
+   * keyframe for it to decode on its own.
+   */
+  bool seek_frame(uint32_t index, uint32_t offset) {
+    if (index >= frame_count || offset < SEQUENCE_HEADER_BYTES) {
+      return false;
+    }
+    frame_idx = index;
+    buf_len = buf_pos = 0;
+    return file.seek(offset, SeekSet);
+  }
+
+  /**
+   * Decodes the next frame into `leds`, looping back to the first frame at
+   * the end of the sequence. Pixels past `num_leds` are decoded and dropped.
+   *
+   * Returns how long the frame should be displayed for (in ms), or 0 if the
+   * file is corrupt.
+   */
+  uint16_t next_frame(CRGB *leds, uint16_t num_leds) {
+    if (frame_idx >= frame_count && !rewind()) {
+      return 0;
+    }
+
+    uint8_t frame_header[3];
+    if (!read(frame_header, sizeof(frame_header))) {
+      return 0;
+    }
+
+    const bool keyframe = frame_header[0] & SEQUENCE_FLAG_KEYFRAME;
+    const uint16_t duration_ms = frame_header[1] | (frame_header[2] << 8);
+
+    uint16_t pos = 0;
+    while (pos < led_count) {
+      uint8_t ctrl;
+      if (!read(&ctrl, 1)) {
+        return 0;
+      }
+
+      const uint8_t count = (ctrl & ~SEQUENCE_OP_MASK) + 1;
+      if (pos + count > led_count) {
+        return 0;
+      }
+
+      switch (ctrl & SEQUENCE_OP_MASK) {
+        case SEQUENCE_OP_SKIP:
+          if (keyframe) {
+            fill_range(leds, num_leds, pos, count, CRGB::Black);
+          }
+          break;
+        case SEQUENCE_OP_RUN: {
+          CRGB color;
+          if (!read(color.raw, 3)) {
+            return 0;
+          }
+          fill_range(leds, num_leds, pos, count, color);
+          break;
+        }
+        case SEQUENCE_OP_LITERAL:
+          for (uint8_t i = 0; i < count; i++) {
+            CRGB color;
+            if (!read(color.raw, 3)) {
+              return 0;
+            }
+            if (pos + i < num_leds) {
+              leds[pos + i] = color;
+            }
+          }
+          break;
+        default:
+          return 0;
+      }
+
+      pos += count;
+    }
+
+    frame_idx++;
+
+    // A zero duration is reserved to signal errors.
+    return duration_ms > 0 ? duration_ms : 1;
+  }
+
+  // Current offset in the file, used to report the number of bytes per frame.
+  uint32_t position() {
+    return file.position() - (buf_len - buf_pos);
+  }
+
+private:
+  File file;
+  uint16_t led_count = 0;
+  uint32_t frame_count = 0;
+  uint32_t frame_idx = 0;
+
+  uint8_t buf[SEQUENCE_READ_AHEAD_BYTES];
+  uint8_t buf_len = 0;
+  uint8_t buf_pos = 0;
+
+  bool read(uint8_t *dst, uint8_t len) {
+    while (len > 0) {
+      if (buf_pos == buf_len) {
+        buf_len = file.read(buf, sizeof(buf));
+        buf_pos = 0;
+        if (buf_len == 0) {
+          return false;
+        }
+      }
+
+      const uint8_t n = std::min(len, (uint8_t)(buf_len - buf_pos));
+      memcpy(dst, &buf[buf_pos], n);
+      buf_pos += n;
+      dst += n;
+      len -= n;
+    }
+
+    return true;
+  }
+
+  inline void fill_range(CRGB *leds, uint16_t num_leds,
+                         uint16_t first, uint8_t count, const CRGB color) {
+    if (first >= num_leds) return;
+    std::fill_n(&leds[first], std::min((uint16_t)count, (uint16_t)(num_leds - first)), color);
+  }
+};
+
+/**
+ * Encodes frames into a sequence file, the same way tools/seq_encode.py does.
+ * Frames are keyframes, unless the previous frame is passed along: pixels
+ * that didn't change are then skipped. Only keyframes decode without the
+ * frames before them, and starting playback there still takes their offset,
+ * which the file doesn't store: note size() before writing the frame, and
+ * pass it to SequenceReader::seek_frame().
+ *
+ * The frame count goes in the header up front: a file with fewer frames
+ * fails to decode at the end, so write to a temporary path and rename it once
+ * close() succeeds.
+ */
+class SequenceWriter {
+public:
+  SequenceWriter() {}
+
+  ~SequenceWriter() {
+    close();
+  }
+
+  bool open(const char *path, uint16_t led_count, uint32_t frame_count) {
+    close();
+
+    file = LittleFS.open(path, "w");
+    if (!file) return false;
+
+    this->led_count = led_count;
+    this->frame_count = frame_count;
+    frames_written = 0;
+    buf_len = 0;
+    ok = true;
+
+    const uint8_t header[SEQUENCE_HEADER_BYTES] = {
+      SEQUENCE_MAGIC[0], SEQUENCE_MAGIC[1], SEQUENCE_MAGIC[2], SEQUENCE_MAGIC[3],
+      SEQUENCE_VERSION, 0,
+      (uint8_t)led_count, (uint8_t)(led_count >> 8),
+      (uint8_t)frame_count, (uint8_t)(frame_count >> 8),
+      (uint8_t)(frame_count >> 16), (uint8_t)(frame_count >> 24),
+    };
+    write(header, sizeof(header));
+    return ok;
+  }
+
+  /**
+   * Closes the file. Returns true if every frame announced in the header has
+   * been written successfully.
+   */
+  bool close() {
+    if (!file) return false;
+
+    flush();
+    file.close();
+    return ok && frames_written == frame_count;
+  }
+
+  bool is_open() {
+    return (bool)file;
+  }
+
+  uint32_t get_frames_written() {
+    return frames_written;
+  }
+
+  /**
+   * Writes `leds` as the next frame. With `previous`, the frame that comes
+   * before it, it's written as a delta frame. The first frame is always a
+   * keyframe.
+   */
+  bool write_frame(const CRGB *leds, uint16_t duration_ms, const CRGB *previous = nullptr) {
+    if (!file || !ok || frames_written == frame_count) return false;
+
+    if (frames_written == 0) {
+      previous = nullptr;
+    }
+    const uint8_t frame_header[3] = {
+      (uint8_t)(previous == nullptr ? SEQUENCE_FLAG_KEYFRAME : 0),
+      (uint8_t)duration_ms, (uint8_t)(duration_ms >> 8)
+    };
+    write(frame_header, sizeof(frame_header));
+
+    // What a skip leaves there: black in a keyframe, the previous frame
+    // otherwise.
+    auto skipped = [&](uint16_t i) {
+      return previous == nullptr ? !leds[i] : leds[i] == previous[i];
+    };
+
+    uint16_t i = 0;
+    while (i < led_count) {
+      if (skipped(i)) {
+        uint16_t j = i + 1;
+        while (j < led_count && j - i < SEQUENCE_OP_MAX_COUNT && skipped(j)) j++;
+        write_op(SEQUENCE_OP_SKIP, j - i);
+        i = j;
+        continue;
+      }
+
+      const uint16_t run = run_length(leds, i);
+      if (run >= 2) {
+        write_op(SEQUENCE_OP_RUN, run);
+        write(leds[i].raw, 3);
+        i += run;
+        continue;
+      }
+
+      // Literal: stop as soon as something cheaper can take over.
+      uint16_t j = i + 1;
+      while (j < led_count && j - i < SEQUENCE_OP_MAX_COUNT && !skipped(j) && run_length(leds, j) < 3) j++;
+      write_op(SEQUENCE_OP_LITERAL, j - i);
+      for (; i < j; i++) {
+        write(leds[i].raw, 3);
+      }
+    }
+
+    frames_written++;
+    return ok;
+  }
+
+  // Bytes written so far (including the ones still buffered).
+  uint32_t size() {
+    return file.size() + buf_len;
+  }
+
+private:
+  File file;
+  uint16_t led_count = 0;
+  uint32_t frame_count = 0;
+  uint32_t frames_written = 0;
+  bool ok = false;
+
+  uint8_t buf[SEQUENCE_WRITE_BUFFER_BYTES];
+  uint8_t buf_len = 0;
+
+  uint16_t run_length(const CRGB *leds, uint16_t i) {
+    uint16_t j = i + 1;
+    while (j < led_count && j - i < SEQUENCE_OP_MAX_COUNT && leds[j] == leds[i]) j++;
+    return j - i;
+  }
+
+  inline void write_op(uint8_t op, uint8_t count) {
+    const uint8_t ctrl = op | (count - 1);
+    write(&ctrl, 1);
+  }
+
+  void write(const uint8_t *src, uint8_t len) {
+    if (buf_len + len > sizeof(buf)) {
+      flush();
+    }
+    memcpy(&buf[buf_len], src, len);
+    buf_len += len;
+  }
+
+  void flush() {
+    if (buf_len > 0 && file.write(buf, buf_len) != buf_len) {
+      #ifdef ENABLE_SERIAL_DEBUG
+        Serial.println(F("Sequence write failed (filesystem full?)"));
+      #endif
+      ok = false;
+    }
+    buf_len = 0;
+  }
+};
+
+#endif // __LED_SEQUENCE_H__
@@ -0,0 +1,183 @@
+#ifndef __LED_SYNC_H__
+#define __LED_SYNC_H__
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#include "LedManager.h"
+#include "SyncClock.h"
+
+/**
+ * Keeps several ledboxes showing the same frames.
+ *
+ * The leader broadcasts a beacon over UDP multicast a few times per second
+ * with its clock, its current effect and the effect's state (for the effects
+ * that aren't a pure function of time). Followers discipline their clock on
+ * the leader's (see SyncClock.h), switch to the same effect and adopt its
+ * state. Since all animations and the frame timer run on the shared clock,
+ * frames end up being rendered at the same time on every device.
+ *
+ * Select the role at build time with -DSYNC_MODE=SYNC_LEADER or
+ * -DSYNC_MODE=SYNC_FOLLOWER.
+ */
+
+#define SYNC_OFF 0
+#define SYNC_LEADER 1
+#define SYNC_FOLLOWER 2
+
+#ifndef SYNC_MODE
+#  define SYNC_MODE SYNC_OFF
+#endif
+
+#define SYNC_MULTICAST_ADDRESS IPAddress(239, 76, 66, 83)
+#define SYNC_PORT 4210
+#define SYNC_BEACON_INTERVAL_MS 250
+
+#define SYNC_MAGIC "LBSY"
+#define SYNC_VERSION 1
+#define SYNC_MAX_STATE_BYTES 16
+
+/**
+ * Beacon sent by the leader. Multi-byte values are little endian (which is
+ * the native order of the ESP8266).
+ */
+struct __attribute__((packed)) SyncBeacon {
+  char magic[4];
+  uint8_t version;
+  int8_t effect;
+  uint8_t state_len;
+  uint8_t reserved;
+  uint32_t seq;
+  uint64_t leader_us;
+  uint8_t state[SYNC_MAX_STATE_BYTES];
+};
+
+#define SYNC_BEACON_HEADER_BYTES (sizeof(SyncBeacon) - SYNC_MAX_STATE_BYTES)
+
+/**
+ * Fills in `beacon` for the leader's current effect, whose state is saved
+ * into it. Returns its size on the wire. The timestamp is left for the
+ * caller to take as late as possible.
+ */
+inline size_t sync_beacon_encode(SyncBeacon &beacon, uint32_t seq, int8_t effect, LedAnim *anim) {
+  memcpy(beacon.magic, SYNC_MAGIC, sizeof(beacon.magic));
+  beacon.version = SYNC_VERSION;
+  beacon.effect = effect;
+  beacon.reserved = 0;
+  beacon.seq = seq;
+  beacon.leader_us = 0;
+  beacon.state_len = anim->save_sync_state(beacon.state, SYNC_MAX_STATE_BYTES);
+  return SYNC_BEACON_HEADER_BYTES + beacon.state_len;
+}
+
+// Whether the `len` bytes read into `beacon` are a beacon this build
+// understands, state included.
+inline bool sync_beacon_valid(const SyncBeacon &beacon, int len) {
+  return len >= (int)SYNC_BEACON_HEADER_BYTES &&
+         memcmp(beacon.magic, SYNC_MAGIC, sizeof(beacon.magic)) == 0 &&
+         beacon.version == SYNC_VERSION &&
+         beacon.state_len <= len - (int)SYNC_BEACON_HEADER_BYTES;
+}
+
+/**
+ * `Mode` defaults to SYNC_MODE; only the native tests run both roles in the
+ * same program, each with their own clock.
+ */
+template <uint8_t Mode = SYNC_MODE>
+class LedSync {
+public:
+  LedSync() {}
+
+  void begin(LedManager *led_mgr, SyncClock *clock = &sync_clock) {
+    this->led_mgr = led_mgr;
+    this->clock = clock;
+  }
+
+  void handle() {
+    if constexpr (Mode != SYNC_OFF) {
+      HeapScope heap_scope(HeapTag::Sync);
+
+      if (WiFi.status() != WL_CONNECTED) {
+        listening = false;
+        return;
+      }
+
+      if (!listening) {
+        listening = udp.beginMulticast(WiFi.localIP(), SYNC_MULTICAST_ADDRESS, SYNC_PORT);
+        #ifdef ENABLE_SERIAL_DEBUG
+          Serial.print("Sync: ");
+          Serial.println(listening ? "joined multicast group" : "couldn't join multicast group");
+        #endif
+        if (!listening) return;
+      }
+
+      if constexpr (Mode == SYNC_LEADER) {
+        send_beacon();
+      } else {
+        receive_beacons();
+      }
+    }
+  }
+
+private:
+  LedManager *led_mgr = nullptr;
+  SyncClock *clock = &sync_clock;
+  WiFiUDP udp;
+  bool listening = false;
+
+  uint32_t seq = 0;
+  uint32_t last_beacon_ms = 0;
+
+  void send_beacon() {
+    const uint32_t now = millis();
+    if (now - last_beacon_ms < SYNC_BEACON_INTERVAL_MS) return;
+    last_beacon_ms = now;
+
+    SyncBeacon beacon;
+    const size_t len = sync_beacon_encode(beacon, seq++, led_mgr->get_effect(), led_mgr->get_animation());
+    // Take the timestamp last so that it's as close as possible to the
+    // packet leaving.
+    beacon.leader_us = clock->now_us();
+
+    udp.beginPacketMulticast(SYNC_MULTICAST_ADDRESS, SYNC_PORT, WiFi.localIP());
+    udp.write((const uint8_t *)&beacon, len);
+    udp.endPacket();
+  }
+
+  void receive_beacons() {
+    while (udp.parsePacket() > 0) {
+      const uint64_t local_us = clock->local_us();
+
+      SyncBeacon beacon;
+      const int len = udp.read((uint8_t *)&beacon, sizeof(beacon));
+      if (!sync_beacon_valid(beacon, len)) {
+        continue;
+      }
+
+      ClockEstimator *estimator = clock->get_estimator();
+      estimator->add_sample(beacon.leader_us, local_us);
+
+      if (beacon.effect != led_mgr->get_effect()) {
+        #ifdef ENABLE_SERIAL_DEBUG
+          Serial.print("Sync: following leader to effect ");
+          Serial.println(beacon.effect);
+        #endif
+        led_mgr->set_effect(beacon.effect);
+      }
+      led_mgr->get_animation()->load_sync_state(beacon.state, beacon.state_len);
+
+      #ifdef ENABLE_SERIAL_DEBUG
+        if (beacon.seq % 64 == 0) {
+          Serial.print("Sync: offset ");
+          Serial.print((int32_t)(estimator->get_offset_us() / 1000));
+          Serial.print("ms, drift ");
+          Serial.print(estimator->get_drift_ppb());
+          Serial.println("ppb");
+        }
+      #endif
+    }
+  }
+};
+
+#endif // __LED_SYNC_H__
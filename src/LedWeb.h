@@ -6,11 +6,16 @@
 #include <ESP8266WebServer.h>
 #include <ESP8266mDNS.h>
 #include <ArduinoJson.h>
+#include <LittleFS.h>
 
 #include "MicroUtil.h"
+#include "LedApi.h"
+#include "LedApiOps.h"
 #include "html/html.h"
 #include "LedManager.h"
 #include "LedControl.h"
+#include "LedSequence.h"
+#include "HeapTrack.h"
 
 #define WIFI_HOSTNAME QUOTE(_WIFI_HOSTNAME)
 #ifndef _WIFI_SSID
@@ -26,7 +31,8 @@
 #  define WIFI_PASS QUOTE(_WIFI_PASS)
 #endif
 
-#define JSON_BUFFER_CAPACITY_BYTES 200
+// Pages are copied from flash to the network in chunks of this size.
+#define HTML_CHUNK_BYTES 256
 
 class LedWeb {
 public:
@@ -38,9 +44,13 @@ public:
   }
 
   void handle() {
-    reset_wifi_if_not_connected();
+    {
+      HeapScope heap_scope(HeapTag::Wifi);
+      reset_wifi_if_not_connected();
+    }
     if (!connected) return;
 
+    HeapScope heap_scope(HeapTag::Web);
     server->handleClient();
   }
 
@@ -53,40 +63,35 @@ public:
     // Effectively disable CORS on every request.
     server->sendHeader("Access-Control-Allow-Origin", "*");
 
-    switch(shash(server->uri().c_str())) {
-      case shash("/"):
-        serve_static(PAGE_MAIN);
-        break;
+    const String &uri = server->uri();
+    switch(shash_n(uri.c_str(), uri.length())) {
       case shash("/api"):
-        // "plain" is a special argument in post requests to access the raw body
-        if (server->hasArg("plain")) {
-          const String body = server->arg("plain");
-          DeserializationError err = deserializeJson(doc, body);
-          if (err) {
-            #ifdef ENABLE_SERIAL_DEBUG
-              Serial.print(F("JSON deserialization failed: "));
-              Serial.println(err.c_str());
-            #endif
-
-            serve_server_error();
-          }
-          handle_api_request();
+        handle_api_request();
+        break;
+      default: {
+        const HtmlPage *page = find_page(uri.c_str());
+        if (page != nullptr) {
+          serve_page(*page);
         } else {
-          serve_bad_request();
+          serve_static("Not Found", 404);
         }
-        break;
-      default:
-        serve_static("Not Found", 404);
+      }
     }
   }
 
 private:
+  // The API ops call the handle_* methods below.
+  typedef LedApiOps<LedWeb> ApiOps;
+  friend ApiOps;
+
   LedManager* led_mgr = nullptr;
   long last_connection_attempt = -1;
   bool connected = false;
 
   ESP8266WebServer *server = nullptr;
-  DynamicJsonDocument doc = DynamicJsonDocument(JSON_BUFFER_CAPACITY_BYTES);
+  File upload_file;
+  bool upload_ok = false;
+  StaticJsonDocument<JSON_BUFFER_CAPACITY_BYTES> doc;
 
   void wifi_setup(uint32_t delay_ms = 30000) {
     const uint32_t now = millis();
@@ -141,8 +146,17 @@ private:
 
           server = new ESP8266WebServer(80);
           server->onNotFound(std::bind(&LedWeb::handle_not_found, this));
-          server->on("/", HTTP_GET, std::bind(&LedWeb::handle_request, this));
+          for (uint8_t i = 0; i < HTML_PAGE_COUNT; i++) {
+            server->on(HTML_PAGES[i].path, HTTP_GET, std::bind(&LedWeb::handle_request, this));
+          }
           server->on("/api", HTTP_POST, std::bind(&LedWeb::handle_request, this));
+          server->on("/sequence", HTTP_POST,
+                     std::bind(&LedWeb::handle_sequence_uploaded, this),
+                     std::bind(&LedWeb::handle_sequence_upload, this));
+
+          // Only the headers listed here are retained by the server.
+          static const char *collected_headers[] = { "If-None-Match", "Accept-Encoding" };
+          server->collectHeaders(collected_headers, 2);
           server->begin();
         }
         connected = true;
@@ -160,6 +174,49 @@ private:
     server->send(http_code, mime_type, content);
   }
 
+  const HtmlPage *find_page(const char *path) {
+    for (uint8_t i = 0; i < HTML_PAGE_COUNT; i++) {
+      if (strcmp(HTML_PAGES[i].path, path) == 0) {
+        return &HTML_PAGES[i];
+      }
+    }
+    return nullptr;
+  }
+
+  /**
+   * Serves a pre-compressed page straight from flash. The browser is asked
+   * to always revalidate, which costs a 304 with no body as long as the page
+   * (and therefore its ETag) hasn't changed. Pages are only stored gzipped:
+   * clients that refuse gzip get a 406.
+   */
+  void serve_page(const HtmlPage &page) {
+    if (server->hasHeader("Accept-Encoding") &&
+        !accepts_gzip(server->header("Accept-Encoding").c_str())) {
+      serve_static("Not Acceptable", 406);
+      return;
+    }
+
+    server->sendHeader("ETag", page.etag);
+    server->sendHeader("Cache-Control", "no-cache");
+    server->sendHeader("Vary", "Accept-Encoding");
+
+    if (etag_matches(server->header("If-None-Match").c_str(), page.etag)) {
+      server->send(304);
+      return;
+    }
+
+    server->sendHeader("Content-Encoding", "gzip");
+    server->setContentLength(page.length);
+    server->send(200, page.mime_type, "");
+
+    uint8_t chunk[HTML_CHUNK_BYTES];
+    for (size_t offset = 0; offset < page.length; offset += sizeof(chunk)) {
+      const size_t len = std::min(sizeof(chunk), page.length - offset);
+      memcpy_P(chunk, page.content + offset, len);
+      server->sendContent((const char *)chunk, len);
+    }
+  }
+
   void serve_server_error() {
     serve_static("Server Error", 500);
   }
@@ -178,34 +235,155 @@ private:
   }
 
   void handle_api_request() {
-    const char* op = doc["op"]; // e.g. "fill_solid"
+    // "plain" is a special argument in post requests to access the raw body
+    if (!server->hasArg("plain")) {
+      serve_bad_request();
+      return;
+    }
 
-    switch(shash(op)) {
-      case shash("fill_solid"):
-        handle_fill_solid();
+    #ifdef ENABLE_SERIAL_DEBUG
+      const uint32_t start_us = micros();
+    #endif
+
+    // The body is parsed in place: the server owns the buffer and throws it
+    // away once the request is served, so we let ArduinoJson's zero-copy mode
+    // point straight into it rather than copying the body or its strings.
+    const String &body = server->arg("plain");
+    DeserializationError err = deserializeJson(doc, const_cast<char *>(body.c_str()), body.length());
+    if (err) {
+      #ifdef ENABLE_SERIAL_DEBUG
+        Serial.print(F("JSON deserialization failed: "));
+        Serial.println(err.c_str());
+      #endif
+      serve_bad_request();
+      return;
+    }
+
+    const char *op_name = doc["op"]; // e.g. "fill_solid"
+    const ApiOp<ApiOps::Handler> *op = ApiOps::find(op_name);
+    if (op == nullptr) {
+      #ifdef ENABLE_SERIAL_DEBUG
+        Serial.print(F("Invalid op requested: "));
+        Serial.println(op_name);
+      #endif
+      serve_bad_request();
+      return;
+    }
+
+    const ApiField *invalid_field = api_validate(doc.as<JsonObjectConst>(), *op);
+    if (invalid_field != nullptr) {
+      #ifdef ENABLE_SERIAL_DEBUG
+        Serial.print(F("Invalid or missing field for "));
+        Serial.print(op->name);
+        Serial.print(F(": "));
+        Serial.println(invalid_field->name);
+      #endif
+      serve_bad_request();
+      return;
+    }
+
+    #ifdef ENABLE_SERIAL_DEBUG
+      Serial.print(op->name);
+      Serial.print(F(": parsed and dispatched in "));
+      Serial.print(micros() - start_us);
+      Serial.println("us");
+    #endif
+
+    (this->*(op->handler))();
+  }
+
+  /**
+   * Streams a sequence upload (multipart/form-data) straight to LittleFS as
+   * it arrives, one buffer at a time. The upload goes to a temporary file so
+   * a failed upload doesn't clobber the sequence currently stored.
+   */
+  void handle_sequence_upload() {
+    HTTPUpload &upload = server->upload();
+
+    switch (upload.status) {
+      case UPLOAD_FILE_START:
+        upload_file = LittleFS.open(SEQUENCE_UPLOAD_PATH, "w");
+        upload_ok = (bool)upload_file;
         break;
-      case shash("status"):
-        handle_status();
+      case UPLOAD_FILE_WRITE:
+        if (upload_ok && upload_file.write(upload.buf, upload.currentSize) != upload.currentSize) {
+          #ifdef ENABLE_SERIAL_DEBUG
+            Serial.println(F("Sequence upload: write failed (filesystem full?)"));
+          #endif
+          upload_ok = false;
+        }
         break;
-      case shash("reboot"):
-        api_response_success();
-        // wait 1 seconds before actually killing the system so that we
-        // can serve the response
-        delay(1000);
-        ESP.restart();
+      case UPLOAD_FILE_END:
+        upload_file.close();
         break;
-      case shash("set_brightness"):
-        handle_brightness();
+      case UPLOAD_FILE_ABORTED:
+        upload_file.close();
+        LittleFS.remove(SEQUENCE_UPLOAD_PATH);
+        upload_ok = false;
         break;
-      default:
-        #ifdef ENABLE_SERIAL_DEBUG
-          Serial.print(F("Invalid op requested: "));
-          Serial.println(op);
-        #endif
-        serve_bad_request();
     }
   }
 
+  void handle_sequence_uploaded() {
+    server->sendHeader("Access-Control-Allow-Origin", "*");
+
+    if (!upload_ok) {
+      LittleFS.remove(SEQUENCE_UPLOAD_PATH);
+      serve_server_error();
+      return;
+    }
+    upload_ok = false;
+
+    SequenceReader probe;
+    if (!probe.open(SEQUENCE_UPLOAD_PATH)) {
+      LittleFS.remove(SEQUENCE_UPLOAD_PATH);
+      serve_bad_request();
+      return;
+    }
+    probe.close();
+
+    // The sequence animation keeps the file open while playing: swap it out
+    // before replacing the file. Nothing is drawn in between as we're still
+    // inside the main loop.
+    const int8_t previous_effect = led_mgr->get_effect();
+    led_mgr->set_effect(AnimEffect::Initial);
+    if (!replace_sequence()) {
+      LittleFS.remove(SEQUENCE_UPLOAD_PATH);
+      led_mgr->set_effect(previous_effect);
+      serve_server_error();
+      return;
+    }
+    led_mgr->set_effect(AnimEffect::Sequence);
+
+    api_response_success();
+  }
+
+  /**
+   * Moves the upload over the stored sequence. LittleFS renames over an
+   * existing file in one step; should that fail, the stored sequence is set
+   * aside first and put back if the upload still can't be moved, so there's
+   * always a sequence to play.
+   */
+  bool replace_sequence() {
+    if (LittleFS.rename(SEQUENCE_UPLOAD_PATH, SEQUENCE_PATH)) {
+      return true;
+    }
+    if (!LittleFS.exists(SEQUENCE_PATH)) {
+      return false;
+    }
+
+    LittleFS.remove(SEQUENCE_BACKUP_PATH);
+    if (!LittleFS.rename(SEQUENCE_PATH, SEQUENCE_BACKUP_PATH)) {
+      return false;
+    }
+    if (!LittleFS.rename(SEQUENCE_UPLOAD_PATH, SEQUENCE_PATH)) {
+      LittleFS.rename(SEQUENCE_BACKUP_PATH, SEQUENCE_PATH);
+      return false;
+    }
+    LittleFS.remove(SEQUENCE_BACKUP_PATH);
+    return true;
+  }
+
   inline void api_response_success() {
     serve_static("{ \"success\": true }", 200, "application/json");
   }
@@ -222,11 +400,6 @@ private:
     const int range_start = doc["range_start"] | 0;
     const int range_size = doc["range_size"] | NUM_LEDS;
 
-    if (!doc["color"].is<JsonArray>() || doc["color"].as<JsonArray>().size() != 3) {
-      serve_bad_request();
-      return;
-    }
-
     JsonArray color = doc["color"];
     const uint8_t color_r = color[0];
     const uint8_t color_g = color[1];
@@ -239,16 +412,82 @@ private:
     api_response_success();
   }
 
-  void handle_brightness() {
-    if (!doc["value"].is<int>()) {
+  void handle_fill_gradient() {
+    const int range_start = doc["range_start"] | 0;
+    const int range_size = doc["range_size"] | NUM_LEDS;
+    const char *space = doc["space"] | "rgb";
+
+    JsonArrayConst colors = doc["colors"];
+    const uint8_t stop_count = colors.size();
+    LedControl *led_ctrl = led_mgr->get_control();
+
+    if (strcmp(space, "hsv") == 0) {
+      CHSV stops[API_TRIPLET_LIST_MAX];
+      for (uint8_t i = 0; i < stop_count; i++) {
+        stops[i] = CHSV(colors[i][0].as<uint8_t>(), colors[i][1].as<uint8_t>(), colors[i][2].as<uint8_t>());
+      }
+      led_ctrl->fill_gradient(stops, stop_count, range_start, range_size);
+    } else if (strcmp(space, "rgb") == 0) {
+      CRGB stops[API_TRIPLET_LIST_MAX];
+      for (uint8_t i = 0; i < stop_count; i++) {
+        stops[i] = CRGB(colors[i][0].as<uint8_t>(), colors[i][1].as<uint8_t>(), colors[i][2].as<uint8_t>());
+      }
+      led_ctrl->fill_gradient(stops, stop_count, range_start, range_size);
+    } else {
       serve_bad_request();
       return;
     }
+    led_ctrl->commit();
+
+    api_response_success();
+  }
+
+  void handle_fill_rainbow() {
+    uint16_t range_start = doc["range_start"] | 0;
+    uint16_t range_size = doc["range_size"] | NUM_LEDS;
+    const uint8_t initial_hue = doc["initial_hue"] | 0;
+    // Defaults to exactly one rainbow over the part of the range that's on
+    // the strip.
+    LedControl::clamp_range(range_start, range_size);
+    const uint16_t hue_step = doc["hue_step"] | (int32_t)fill_rainbow_step(range_size);
+
+    LedControl *led_ctrl = led_mgr->get_control();
+    led_ctrl->fill_rainbow(initial_hue, hue_step, range_start, range_size);
+    led_ctrl->commit();
+
+    api_response_success();
+  }
+
+  void handle_brightness() {
     uint8_t value = doc["value"] | 0;
     led_mgr->get_control()->set_brightness(value);
     api_response_success();
   }
 
+  void handle_set_param() {
+    const char *name = doc["name"];
+    const int32_t value = doc["value"];
+
+    if (!led_mgr->get_animation()->set_param(name, value)) {
+      #ifdef ENABLE_SERIAL_DEBUG
+        Serial.print(F("set_param: not supported by the current effect: "));
+        Serial.println(name);
+      #endif
+      serve_bad_request();
+      return;
+    }
+
+    api_response_success();
+  }
+
+  void handle_reboot() {
+    api_response_success();
+    // wait 1 seconds before actually killing the system so that we
+    // can serve the response
+    delay(1000);
+    ESP.restart();
+  }
+
   void handle_status() {
     LedControl *led_ctrl = this->led_mgr->get_control();
 
@@ -270,6 +509,37 @@ private:
 
     serve_static(output.c_str(), 200, "application/json");
   }
+
+  void handle_heap_stats() {
+    StaticJsonDocument<JSON_OBJECT_SIZE(9) + JSON_OBJECT_SIZE((size_t)HeapTag::Count) +
+                       (size_t)HeapTag::Count * JSON_OBJECT_SIZE(3)> response;
+
+    response["free"] = ESP.getFreeHeap();
+    response["min_free"] = HeapTrack::get_min_free_heap();
+    response["max_block"] = ESP.getMaxFreeBlockSize();
+    response["min_max_block"] = HeapTrack::get_min_max_block();
+    response["fragmentation"] = ESP.getHeapFragmentation();
+    response["steady_state"] = HeapTrack::is_steady_state();
+    response["render_allocs"] = HeapTrack::get_violations();
+    // Per tag allocs - frees isn't what a tag holds, see HeapTagStats.
+    response["live_blocks"] = HeapTrack::get_live_blocks();
+
+    JsonObject tags = response.createNestedObject("tags");
+    for (uint8_t i = 0; i < (uint8_t)HeapTag::Count; i++) {
+      const HeapTagStats &stats = HeapTrack::get_stats((HeapTag)i);
+
+      // Tag names are static strings: ArduinoJson stores the pointer only.
+      JsonObject tag = tags.createNestedObject(HeapTrack::tag_name((HeapTag)i));
+      tag["allocs"] = stats.allocs;
+      tag["frees"] = stats.frees;
+      tag["bytes"] = stats.bytes;
+    }
+
+    String output;
+    serializeJson(response, output);
+
+    serve_static(output.c_str(), 200, "application/json");
+  }
 };
 
 #endif // __LED_WEB_H__
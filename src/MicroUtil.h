@@ -1,11 +1,108 @@
 #ifndef __MICROUTIL_H__
 #define __MICROUTIL_H__
 
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
 #define Q(x) #x
 #define QUOTE(x) Q(x)
 
+/**
+ * String hash for switching on strings at compile time. It recurses once per
+ * character: hash strings received at runtime with shash_n() instead.
+ */
 extern constexpr unsigned int shash(const char* str, int h = 0) {
   return !str[h] ? 5381 : (shash(str, h + 1) * 33) ^ str[h];
 }
 
+/**
+ * Same hash as shash() over the first `len` characters of `str`, computed
+ * iteratively so that long input can't run the stack out.
+ */
+inline unsigned int shash_n(const char *str, size_t len) {
+  unsigned int h = 5381;
+  while (len > 0) {
+    len--;
+    h = (h * 33) ^ str[len];
+  }
+  return h;
+}
+
+/**
+ * Returns true when `etag` (including its quotes) is listed in the value of an
+ * If-None-Match header. Weak validators ("W/") compare equal to strong ones
+ * as per RFC 7232 and "*" matches anything.
+ */
+inline bool etag_matches(const char *if_none_match, const char *etag) {
+  const size_t etag_len = strlen(etag);
+  const char *p = if_none_match;
+
+  while (*p) {
+    while (*p == ' ' || *p == ',') p++;
+    if (*p == '*') return true;
+    if (p[0] == 'W' && p[1] == '/') p += 2;
+
+    const char *end = p;
+    while (*end && *end != ',') end++;
+
+    const char *last = end;
+    while (last > p && last[-1] == ' ') last--;
+
+    if ((size_t)(last - p) == etag_len && strncmp(p, etag, etag_len) == 0) {
+      return true;
+    }
+    p = end;
+  }
+
+  return false;
+}
+
+/**
+ * Returns true when the value of an Accept-Encoding header allows a gzip
+ * response: gzip (or x-gzip) or "*" is listed with a non-zero quality, and
+ * gzip isn't explicitly refused with "q=0". An empty value only accepts
+ * identity; a request without the header accepts anything (RFC 7231), which
+ * is for the caller to tell apart.
+ */
+inline bool accepts_gzip(const char *accept_encoding) {
+  // -1 until listed, then whether the quality is non-zero.
+  int8_t gzip = -1;
+  int8_t any = -1;
+  const char *p = accept_encoding;
+
+  while (*p) {
+    while (*p == ' ' || *p == ',') p++;
+    if (!*p) break;
+
+    const char *coding = p;
+    while (*p && *p != ',' && *p != ';' && *p != ' ') p++;
+    const size_t coding_len = p - coding;
+
+    // Parameters: only the quality matters, and only whether it's zero.
+    bool accepted = true;
+    while (*p && *p != ',') {
+      while (*p == ' ' || *p == ';') p++;
+      if ((p[0] == 'q' || p[0] == 'Q') && p[1] == '=') {
+        p += 2;
+        accepted = false;
+        for (; *p && *p != ',' && *p != ';' && *p != ' '; p++) {
+          if (*p >= '1' && *p <= '9') accepted = true;
+        }
+      } else {
+        while (*p && *p != ',' && *p != ';') p++;
+      }
+    }
+
+    if ((coding_len == 4 && strncasecmp(coding, "gzip", 4) == 0) ||
+        (coding_len == 6 && strncasecmp(coding, "x-gzip", 6) == 0)) {
+      gzip = accepted;
+    } else if (coding_len == 1 && *coding == '*') {
+      any = accepted;
+    }
+  }
+
+  return gzip >= 0 ? gzip : any > 0;
+}
+
 #endif // __MICROUTIL_H__
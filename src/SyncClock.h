@@ -0,0 +1,150 @@
+#ifndef __SYNC_CLOCK_H__
+#define __SYNC_CLOCK_H__
+
+#include <Arduino.h>
+#include <stdint.h>
+
+// Number of beacons the estimator looks at before updating the clock.
+#define SYNC_WINDOW_SAMPLES 8
+
+// Errors larger than this aren't slewed away: the clock is stepped instead.
+#define SYNC_STEP_THRESHOLD_US 50000
+
+// Crystals on these boards are usually within +-50ppm, anything past this is
+// a bad estimate.
+#define SYNC_MAX_DRIFT_PPB 500000
+
+/**
+ * Estimates the offset and drift of the local clock from a reference clock,
+ * given (reference time, local receive time) samples.
+ *
+ * Delays between the reference taking its timestamp and the sample being
+ * processed only ever make samples look late, so within each window of
+ * samples the one with the largest reference - local difference is taken as
+ * the measurement. Measurements are then fed into a proportional-integral
+ * loop that slews the offset and learns the drift.
+ *
+ * This has no dependencies on the board so it can be exercised on a host.
+ */
+class ClockEstimator {
+public:
+  void reset() {
+    locked = false;
+    window_count = 0;
+  }
+
+  bool is_locked() const {
+    return locked;
+  }
+
+  int64_t get_offset_us() const {
+    return offset_us;
+  }
+
+  int32_t get_drift_ppb() const {
+    return drift_ppb;
+  }
+
+  int64_t to_reference(int64_t local_us) const {
+    if (!locked) return local_us;
+    return local_us + offset_us + (local_us - ref_local_us) * drift_ppb / 1000000000LL;
+  }
+
+  void add_sample(int64_t reference_us, int64_t local_us) {
+    const int64_t sample = reference_us - local_us;
+    if (window_count == 0 || sample > best_sample_us) {
+      best_sample_us = sample;
+      best_local_us = local_us;
+    }
+
+    // Lock on the very first sample so that followers start roughly in sync
+    // straight away, the estimate gets refined from there.
+    if (++window_count < SYNC_WINDOW_SAMPLES && locked) {
+      return;
+    }
+
+    window_count = 0;
+    update(best_sample_us, best_local_us);
+  }
+
+private:
+  bool locked = false;
+  int64_t offset_us = 0;
+  int64_t ref_local_us = 0;
+  int32_t drift_ppb = 0;
+
+  uint8_t window_count = 0;
+  int64_t best_sample_us = 0;
+  int64_t best_local_us = 0;
+
+  void update(int64_t measured_us, int64_t at_local_us) {
+    const int64_t elapsed_us = at_local_us - ref_local_us;
+    const int64_t predicted_us = offset_us + elapsed_us * drift_ppb / 1000000000LL;
+    const int64_t error_us = measured_us - predicted_us;
+
+    if (!locked || elapsed_us <= 0 ||
+        error_us > SYNC_STEP_THRESHOLD_US || error_us < -SYNC_STEP_THRESHOLD_US) {
+      offset_us = measured_us;
+      ref_local_us = at_local_us;
+      drift_ppb = 0;
+      locked = true;
+      return;
+    }
+
+    // Fold half of the error into the offset and a small fraction of the
+    // frequency error it implies into the drift: measurements are jittery
+    // and the drift of a crystal only changes slowly (with temperature).
+    int64_t drift = drift_ppb + error_us * 1000000000LL / elapsed_us / 32;
+    drift = std::max(std::min(drift, (int64_t)SYNC_MAX_DRIFT_PPB), (int64_t)-SYNC_MAX_DRIFT_PPB);
+    drift_ppb = drift;
+
+    offset_us = predicted_us + error_us / 2;
+    ref_local_us = at_local_us;
+  }
+};
+
+/**
+ * The timebase every animation runs on. Standalone it's just the local
+ * clock; when following another ledbox (see LedSync.h) it tracks the
+ * leader's clock so that animations on both devices line up.
+ */
+class SyncClock {
+public:
+  // micros() extended to 64 bits so that it never wraps.
+  uint64_t local_us() {
+    const uint32_t now = micros();
+    if (now < last_micros) {
+      micros_high++;
+    }
+    last_micros = now;
+    return ((uint64_t)micros_high << 32) | now;
+  }
+
+  uint64_t now_us() {
+    return estimator.to_reference(local_us());
+  }
+
+  uint32_t now_ms() {
+    return now_us() / 1000;
+  }
+
+  ClockEstimator *get_estimator() {
+    return &estimator;
+  }
+
+private:
+  ClockEstimator estimator;
+  uint32_t last_micros = 0;
+  uint32_t micros_high = 0;
+};
+
+SyncClock sync_clock;
+
+// FastLED's time based helpers (beatsin*, EVERY_N_*) read the time through
+// this function when built with USE_GET_MILLISECOND_TIMER. Animations use
+// GET_MILLIS() for the same reason.
+uint32_t get_millisecond_timer() {
+  return sync_clock.now_ms();
+}
+
+#endif // __SYNC_CLOCK_H__
@@ -1,9 +1,12 @@
 #include <Arduino.h>
 #include <buttonctrl.h>
+#include <LittleFS.h>
 
 #include "LedManager.h"
 #include "LedWeb.h"
+#include "LedSync.h"
 #include "RotaryEncoder.h"
+#include "HeapTrack.h"
 
 #ifndef NUM_LEDS
 #  error "NUM_LEDS must be defined at build time"
@@ -15,6 +18,7 @@ LedManager led_manager;
 RotaryEncoder<D1, D2> encoder;
 ButtonCtrl<D3, HIGH, INPUT_PULLUP> encoder_button(800);
 LedWeb led_web;
+LedSync<> led_sync;
 
 void setup() {
   Serial.begin(9600);
@@ -22,10 +26,18 @@ void setup() {
 
   while(!Serial) { }
 
+  if (!LittleFS.begin()) {
+    Serial.println(F("Couldn't mount LittleFS."));
+  }
+
   encoder.begin();
   encoder_button.begin();
   led_manager.begin();
   led_web.begin(&led_manager);
+  led_sync.begin(&led_manager);
+
+  // Everything that's needed for rendering has been allocated by now.
+  HeapTrack::arm_steady_state();
 
   Serial.println(F("System start OK."));
 }
@@ -59,4 +71,7 @@ void loop() {
 
   led_manager.handle();
   led_web.handle();
+  led_sync.handle();
+
+  HeapTrack::sample();
 }
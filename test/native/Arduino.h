@@ -0,0 +1,148 @@
+#ifndef __NATIVE_ARDUINO_H__
+#define __NATIVE_ARDUINO_H__
+
+/**
+ * Just enough of the Arduino core for the board independent headers in src/
+ * to build on a host (see [env:native] in platformio.ini).
+ *
+ * Time is simulated: micros() and millis() read `native_micros`, which only
+ * moves when a test moves it, so tests involving the clock are reproducible.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#define PROGMEM
+#define IRAM_ATTR
+#define F(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define memcpy_P memcpy
+
+#define A0 17
+
+#define DEC 10
+#define HEX 16
+
+/**
+ * Arduino's String, over std::string: it allocates from the heap (through
+ * the wrapped malloc) much like the real one does.
+ */
+class String {
+public:
+  String(const char *s = "") : str(s != nullptr ? s : "") {}
+  String(const char *s, size_t len) : str(s, len) {}
+  String(int value, uint8_t base = DEC) : String((long)value, base) {}
+  String(unsigned int value, uint8_t base = DEC) : String((unsigned long)value, base) {}
+  String(long value, uint8_t base = DEC) {
+    if (base == DEC) {
+      str = std::to_string(value);
+    } else {
+      *this = String((unsigned long)value, base);
+    }
+  }
+  String(unsigned long value, uint8_t base = DEC) {
+    do {
+      const uint8_t digit = value % base;
+      str.insert(str.begin(), digit < 10 ? '0' + digit : 'a' + digit - 10);
+      value /= base;
+    } while (value > 0);
+  }
+
+  const char *c_str() const {
+    return str.c_str();
+  }
+
+  unsigned int length() const {
+    return str.length();
+  }
+
+  String substring(unsigned int from, unsigned int to = UINT32_MAX) const {
+    from = std::min<size_t>(from, str.length());
+    to = std::min<size_t>(to, str.length());
+    return from < to ? String(str.c_str() + from, to - from) : String();
+  }
+
+  String &operator+=(const String &other) {
+    str += other.str;
+    return *this;
+  }
+
+  friend String operator+(String a, const String &b) {
+    return a += b;
+  }
+
+  bool operator==(const String &other) const {
+    return str == other.str;
+  }
+
+  bool equalsIgnoreCase(const String &other) const {
+    return str.length() == other.str.length() && strcasecmp(c_str(), other.c_str()) == 0;
+  }
+
+private:
+  std::string str;
+};
+
+/**
+ * The bits of the ESP object used by the firmware. Heap figures are made up,
+ * and restarting only counts restarts.
+ */
+class EspClass {
+public:
+  uint32_t restarts = 0;
+
+  void restart() {
+    restarts++;
+  }
+
+  uint32_t getFreeHeap() {
+    return 40 * 1024;
+  }
+
+  uint16_t getMaxFreeBlockSize() {
+    return 32 * 1024;
+  }
+
+  uint8_t getHeapFragmentation() {
+    return 20;
+  }
+};
+
+inline EspClass ESP;
+
+inline uint32_t native_micros = 0;
+
+inline void native_advance_us(uint32_t us) {
+  native_micros += us;
+}
+
+inline uint32_t micros() {
+  return native_micros;
+}
+
+inline uint32_t millis() {
+  return native_micros / 1000;
+}
+
+inline void delay(uint32_t ms) {
+  native_advance_us(ms * 1000);
+}
+
+inline void yield() {}
+
+// What analogRead(A0) returns, 10 bits.
+inline uint16_t native_analog_value = 512;
+
+inline int analogRead(uint8_t pin) {
+  return native_analog_value;
+}
+
+#endif // __NATIVE_ARDUINO_H__
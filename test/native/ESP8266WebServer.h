@@ -0,0 +1,236 @@
+#ifndef __NATIVE_ESP8266WEBSERVER_H__
+#define __NATIVE_ESP8266WEBSERVER_H__
+
+/**
+ * Stand-in for ESP8266WebServer, see Arduino.h next to it. There's no
+ * socket: a test queues a request with native_http(), handleClient() runs the
+ * handler registered for it, and what the handler sent ends up in
+ * `native_http_response`.
+ *
+ * As with the real server, only the request headers listed with
+ * collectHeaders() are visible to handlers.
+ */
+
+#include <Arduino.h>
+
+#include <functional>
+#include <utility>
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+enum HTTPUploadStatus { UPLOAD_FILE_START, UPLOAD_FILE_WRITE, UPLOAD_FILE_END, UPLOAD_FILE_ABORTED };
+
+#define HTTP_UPLOAD_BUFLEN 2048
+
+struct HTTPUpload {
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  size_t contentLength;
+  uint8_t buf[HTTP_UPLOAD_BUFLEN];
+};
+
+typedef std::vector<std::pair<String, String>> NativeHttpHeaders;
+
+struct NativeHttpRequest {
+  HTTPMethod method = HTTP_GET;
+  String uri;
+  NativeHttpHeaders headers;
+
+  // The raw body of a POST request, the "plain" argument.
+  bool has_body = false;
+  String body;
+
+  // A file upload (multipart/form-data), and whether the client goes away
+  // before it's complete.
+  bool has_upload = false;
+  std::vector<uint8_t> upload;
+  bool upload_aborted = false;
+};
+
+struct NativeHttpResponse {
+  // 0 until the handler sends something.
+  int code = 0;
+  String content_type;
+  NativeHttpHeaders headers;
+  // Content passed to send(), followed by everything sent with sendContent().
+  String content;
+  // As set with setContentLength(), SIZE_MAX if it wasn't.
+  size_t content_length = SIZE_MAX;
+};
+
+inline NativeHttpRequest native_http_request;
+inline NativeHttpResponse native_http_response;
+inline bool native_http_pending = false;
+
+/**
+ * Queues a request for the next handleClient() and forgets the last
+ * response. Returns the request so that headers or an upload can be added.
+ */
+inline NativeHttpRequest &native_http(HTTPMethod method, const char *uri, const char *body = nullptr) {
+  native_http_request = NativeHttpRequest();
+  native_http_request.method = method;
+  native_http_request.uri = uri;
+  if (body != nullptr) {
+    native_http_request.has_body = true;
+    native_http_request.body = body;
+  }
+  native_http_response = NativeHttpResponse();
+  native_http_pending = true;
+  return native_http_request;
+}
+
+// A header of the last response, nullptr if it wasn't sent.
+inline const String *native_http_header(const char *name) {
+  for (const auto &header : native_http_response.headers) {
+    if (header.first.equalsIgnoreCase(name)) return &header.second;
+  }
+  return nullptr;
+}
+
+class ESP8266WebServer {
+public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  explicit ESP8266WebServer(int port = 80) {}
+
+  void begin() {}
+
+  void close() {}
+
+  void on(const String &uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn = nullptr) {
+    routes.push_back({ uri, method, fn, ufn });
+  }
+
+  void onNotFound(THandlerFunction fn) {
+    not_found = fn;
+  }
+
+  void collectHeaders(const char *header_keys[], const size_t header_keys_count) {
+    collected.clear();
+    for (size_t i = 0; i < header_keys_count; i++) {
+      collected.push_back(header_keys[i]);
+    }
+  }
+
+  void handleClient() {
+    if (!native_http_pending) return;
+    native_http_pending = false;
+
+    const NativeHttpRequest &request = native_http_request;
+    for (const Route &route : routes) {
+      if (route.uri == request.uri && (route.method == HTTP_ANY || route.method == request.method)) {
+        if (route.ufn && request.has_upload) {
+          run_upload(route.ufn);
+        }
+        route.fn();
+        return;
+      }
+    }
+    if (not_found) {
+      not_found();
+    }
+  }
+
+  const String &uri() const {
+    return native_http_request.uri;
+  }
+
+  HTTPMethod method() const {
+    return native_http_request.method;
+  }
+
+  HTTPUpload &upload() {
+    return current_upload;
+  }
+
+  bool hasArg(const String &name) const {
+    return name == "plain" && native_http_request.has_body;
+  }
+
+  const String &arg(const String &name) const {
+    return hasArg(name) ? native_http_request.body : empty;
+  }
+
+  bool hasHeader(const String &name) const {
+    return find_header(name) != nullptr;
+  }
+
+  const String &header(const String &name) const {
+    const String *value = find_header(name);
+    return value != nullptr ? *value : empty;
+  }
+
+  void sendHeader(const String &name, const String &value, bool first = false) {
+    native_http_response.headers.push_back({ name, value });
+  }
+
+  void setContentLength(const size_t content_length) {
+    native_http_response.content_length = content_length;
+  }
+
+  void send(int code, const char *content_type = nullptr, const String &content = String()) {
+    native_http_response.code = code;
+    native_http_response.content_type = content_type;
+    native_http_response.content = content;
+  }
+
+  void sendContent(const char *content, size_t size) {
+    native_http_response.content += String(content, size);
+  }
+
+private:
+  struct Route {
+    String uri;
+    HTTPMethod method;
+    THandlerFunction fn;
+    THandlerFunction ufn;
+  };
+
+  std::vector<Route> routes;
+  THandlerFunction not_found;
+  std::vector<String> collected;
+  HTTPUpload current_upload;
+  const String empty;
+
+  const String *find_header(const String &name) const {
+    bool is_collected = false;
+    for (const String &key : collected) {
+      is_collected |= key.equalsIgnoreCase(name);
+    }
+    if (!is_collected) return nullptr;
+
+    for (const auto &header : native_http_request.headers) {
+      if (header.first.equalsIgnoreCase(name)) return &header.second;
+    }
+    return nullptr;
+  }
+
+  // Hands the upload to `ufn` one buffer at a time, as the real server does.
+  void run_upload(const THandlerFunction &ufn) {
+    const std::vector<uint8_t> &data = native_http_request.upload;
+
+    current_upload.status = UPLOAD_FILE_START;
+    current_upload.totalSize = 0;
+    current_upload.currentSize = 0;
+    current_upload.contentLength = data.size();
+    ufn();
+
+    for (size_t offset = 0; offset < data.size(); offset += HTTP_UPLOAD_BUFLEN) {
+      current_upload.status = UPLOAD_FILE_WRITE;
+      current_upload.currentSize = std::min<size_t>(HTTP_UPLOAD_BUFLEN, data.size() - offset);
+      memcpy(current_upload.buf, data.data() + offset, current_upload.currentSize);
+      current_upload.totalSize += current_upload.currentSize;
+      ufn();
+    }
+
+    current_upload.status = native_http_request.upload_aborted ? UPLOAD_FILE_ABORTED : UPLOAD_FILE_END;
+    current_upload.currentSize = 0;
+    ufn();
+  }
+};
+
+#endif // __NATIVE_ESP8266WEBSERVER_H__
@@ -0,0 +1,62 @@
+#ifndef __NATIVE_ESP8266WIFI_H__
+#define __NATIVE_ESP8266WIFI_H__
+
+/**
+ * Stand-in for the ESP8266 WiFi station, see Arduino.h next to it. There's
+ * no network: tests pick the status the firmware sees.
+ */
+
+#include <Arduino.h>
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+class IPAddress {
+public:
+  IPAddress() : IPAddress(0, 0, 0, 0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{ a, b, c, d } {}
+
+  bool operator==(const IPAddress &other) const {
+    return memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+  }
+
+  uint8_t operator[](uint8_t i) const {
+    return bytes[i];
+  }
+
+private:
+  uint8_t bytes[4];
+};
+
+// What WiFi.status() returns.
+inline wl_status_t native_wifi_status = WL_CONNECTED;
+
+class ESP8266WiFiClass {
+public:
+  bool hostname(const char *name) {
+    return true;
+  }
+
+  wl_status_t begin(const char *ssid, const char *pass) {
+    return native_wifi_status;
+  }
+
+  wl_status_t status() {
+    return native_wifi_status;
+  }
+
+  IPAddress localIP() {
+    return IPAddress(192, 168, 4, 2);
+  }
+};
+
+inline ESP8266WiFiClass WiFi;
+
+#endif // __NATIVE_ESP8266WIFI_H__
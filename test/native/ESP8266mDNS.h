@@ -0,0 +1,17 @@
+#ifndef __NATIVE_ESP8266MDNS_H__
+#define __NATIVE_ESP8266MDNS_H__
+
+// Stand-in for the mDNS responder, see Arduino.h next to it.
+
+#include <Arduino.h>
+
+class MDNSResponder {
+public:
+  bool begin(const char *hostname) {
+    return true;
+  }
+};
+
+inline MDNSResponder MDNS;
+
+#endif // __NATIVE_ESP8266MDNS_H__
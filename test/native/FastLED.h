@@ -0,0 +1,365 @@
+#ifndef __NATIVE_FASTLED_H__
+#define __NATIVE_FASTLED_H__
+
+/**
+ * Host stand-in for the parts of FastLED used by src/, see Arduino.h next to
+ * it. The color types and the math helpers follow FastLED's own C
+ * implementations (with FASTLED_SCALE8_FIXED, its default) so that kernels
+ * built on them can be checked on a host. Nothing is ever sent anywhere:
+ * FastLED.show() only counts frames.
+ */
+
+#include <Arduino.h>
+
+#ifdef USE_GET_MILLISECOND_TIMER
+  uint32_t get_millisecond_timer();
+#  define GET_MILLIS get_millisecond_timer
+#else
+#  define GET_MILLIS millis
+#endif
+
+inline uint8_t scale8(uint8_t i, uint8_t scale) {
+  return ((uint16_t)i * (1 + (uint16_t)scale)) >> 8;
+}
+
+inline uint8_t scale8_video(uint8_t i, uint8_t scale) {
+  return (((uint16_t)i * scale) >> 8) + ((i && scale) ? 1 : 0);
+}
+
+inline uint16_t scale16(uint16_t i, uint16_t scale) {
+  return ((uint32_t)i * (1 + (uint32_t)scale)) >> 16;
+}
+
+inline uint16_t scale16by8(uint16_t i, uint8_t scale) {
+  return ((uint32_t)i * (1 + scale)) >> 8;
+}
+
+inline uint8_t qadd8(uint8_t i, uint8_t j) {
+  const uint16_t t = i + j;
+  return t > 255 ? 255 : t;
+}
+
+inline uint8_t qsub8(uint8_t i, uint8_t j) {
+  return i > j ? i - j : 0;
+}
+
+inline int16_t sin16(uint16_t theta) {
+  static const uint16_t base[] = { 0, 6393, 12539, 18204, 23170, 27245, 30273, 32137 };
+  static const uint8_t slope[] = { 49, 48, 44, 38, 31, 23, 14, 4 };
+
+  uint16_t offset = (theta & 0x3FFF) >> 3;
+  if (theta & 0x4000) offset = 2047 - offset;
+
+  const uint8_t section = offset / 256;
+  const uint8_t secoffset8 = (uint8_t)offset / 2;
+  int16_t y = slope[section] * secoffset8 + base[section];
+  if (theta & 0x8000) y = -y;
+  return y;
+}
+
+inline uint8_t sin8(uint8_t theta) {
+  return (sin16(theta << 8) >> 8) + 128;
+}
+
+inline uint16_t beat88(uint16_t beats_per_minute_88, uint32_t timebase = 0) {
+  return ((GET_MILLIS() - timebase) * beats_per_minute_88 * 280) >> 16;
+}
+
+inline uint16_t beat16(uint16_t beats_per_minute, uint32_t timebase = 0) {
+  if (beats_per_minute < 256) beats_per_minute <<= 8;
+  return beat88(beats_per_minute, timebase);
+}
+
+inline uint8_t beat8(uint16_t beats_per_minute, uint32_t timebase = 0) {
+  return beat16(beats_per_minute, timebase) >> 8;
+}
+
+inline uint16_t beatsin88(uint16_t beats_per_minute_88, uint16_t lowest = 0, uint16_t highest = 65535) {
+  const uint16_t beatsin = sin16(beat88(beats_per_minute_88)) + 32768;
+  return lowest + scale16(beatsin, highest - lowest);
+}
+
+inline uint16_t beatsin16(uint16_t beats_per_minute, uint16_t lowest = 0, uint16_t highest = 65535) {
+  const uint16_t beatsin = sin16(beat16(beats_per_minute)) + 32768;
+  return lowest + scale16(beatsin, highest - lowest);
+}
+
+inline uint8_t beatsin8(uint16_t beats_per_minute, uint8_t lowest = 0, uint8_t highest = 255) {
+  return lowest + scale8(sin8(beat8(beats_per_minute)), highest - lowest);
+}
+
+inline uint16_t native_rand16_seed = 1337;
+
+inline void random16_set_seed(uint16_t seed) {
+  native_rand16_seed = seed;
+}
+
+inline uint16_t random16() {
+  native_rand16_seed = native_rand16_seed * 2053 + 13849;
+  return native_rand16_seed;
+}
+
+inline uint16_t random16(uint16_t lim) {
+  return ((uint32_t)random16() * lim) >> 16;
+}
+
+inline uint16_t random16(uint16_t min, uint16_t lim) {
+  return min + random16(lim - min);
+}
+
+inline uint8_t random8() {
+  const uint16_t r = random16();
+  return (uint8_t)(r + (r >> 8));
+}
+
+inline uint8_t random8(uint8_t lim) {
+  return ((uint16_t)random8() * lim) >> 8;
+}
+
+inline uint8_t random8(uint8_t min, uint8_t lim) {
+  return min + random8(lim - min);
+}
+
+struct CHSV {
+  union {
+    struct {
+      union { uint8_t hue; uint8_t h; };
+      union { uint8_t sat; uint8_t s; };
+      union { uint8_t val; uint8_t v; };
+    };
+    uint8_t raw[3];
+  };
+
+  CHSV() : hue(0), sat(0), val(0) {}
+  CHSV(uint8_t h, uint8_t s, uint8_t v) : hue(h), sat(s), val(v) {}
+};
+
+struct CRGB;
+inline void hsv2rgb_rainbow(const CHSV &hsv, CRGB &rgb);
+
+struct CRGB {
+  union {
+    struct {
+      union { uint8_t r; uint8_t red; };
+      union { uint8_t g; uint8_t green; };
+      union { uint8_t b; uint8_t blue; };
+    };
+    uint8_t raw[3];
+  };
+
+  enum HTMLColorCode : uint32_t {
+    Aqua = 0x00FFFF,
+    Black = 0x000000,
+    Blue = 0x0000FF,
+    DeepSkyBlue = 0x00BFFF,
+    Lime = 0x00FF00,
+    Magenta = 0xFF00FF,
+    Orange = 0xFFA500,
+    Red = 0xFF0000,
+    White = 0xFFFFFF,
+  };
+
+  CRGB() : r(0), g(0), b(0) {}
+  CRGB(uint8_t r, uint8_t g, uint8_t b) : r(r), g(g), b(b) {}
+  CRGB(uint32_t colorcode) : r(colorcode >> 16), g(colorcode >> 8), b(colorcode) {}
+  CRGB(HTMLColorCode colorcode) : CRGB((uint32_t)colorcode) {}
+  CRGB(const CHSV &hsv) { hsv2rgb_rainbow(hsv, *this); }
+
+  inline CRGB &operator+=(const CRGB &o) {
+    r = qadd8(r, o.r);
+    g = qadd8(g, o.g);
+    b = qadd8(b, o.b);
+    return *this;
+  }
+
+  inline CRGB &operator|=(const CRGB &o) {
+    r = std::max(r, o.r);
+    g = std::max(g, o.g);
+    b = std::max(b, o.b);
+    return *this;
+  }
+
+  inline CRGB &nscale8(uint8_t scale) {
+    r = scale8(r, scale);
+    g = scale8(g, scale);
+    b = scale8(b, scale);
+    return *this;
+  }
+
+  inline CRGB &nscale8_video(uint8_t scale) {
+    r = scale8_video(r, scale);
+    g = scale8_video(g, scale);
+    b = scale8_video(b, scale);
+    return *this;
+  }
+
+  inline uint8_t getAverageLight() const {
+    return scale8(r, 85) + scale8(g, 85) + scale8(b, 85);
+  }
+
+  inline explicit operator bool() const {
+    return r || g || b;
+  }
+
+  inline bool operator==(const CRGB &o) const {
+    return r == o.r && g == o.g && b == o.b;
+  }
+
+  inline bool operator!=(const CRGB &o) const {
+    return !(*this == o);
+  }
+};
+
+// FastLED's "rainbow" conversion, with its default yellow boost (Y1).
+inline void hsv2rgb_rainbow(const CHSV &hsv, CRGB &rgb) {
+  const uint8_t hue = hsv.hue;
+  uint8_t sat = hsv.sat;
+  uint8_t val = hsv.val;
+
+  const uint8_t offset8 = (hue & 0x1F) << 3;
+  const uint8_t third = scale8(offset8, 256 / 3);
+  const uint8_t twothirds = scale8(offset8, (256 * 2) / 3);
+  uint8_t r, g, b;
+
+  switch (hue >> 5) {
+    case 0: r = 255 - third; g = third; b = 0; break;
+    case 1: r = 171; g = 85 + third; b = 0; break;
+    case 2: r = 171 - twothirds; g = 170 + third; b = 0; break;
+    case 3: r = 0; g = 255 - third; b = third; break;
+    case 4: r = 0; g = 171 - twothirds; b = 85 + twothirds; break;
+    case 5: r = third; g = 0; b = 255 - third; break;
+    case 6: r = 85 + third; g = 0; b = 171 - third; break;
+    default: r = 170 + third; g = 0; b = 85 - third; break;
+  }
+
+  if (sat != 255) {
+    if (sat == 0) {
+      r = g = b = 255;
+    } else {
+      uint8_t desat = 255 - sat;
+      desat = scale8_video(desat, desat);
+      const uint8_t satscale = 255 - desat;
+      r = scale8(r, satscale) + desat;
+      g = scale8(g, satscale) + desat;
+      b = scale8(b, satscale) + desat;
+    }
+  }
+
+  if (val != 255) {
+    val = scale8_video(val, val);
+    r = scale8(r, val);
+    g = scale8(g, val);
+    b = scale8(b, val);
+    if (val == 0) r = g = b = 0;
+  }
+
+  rgb.r = r;
+  rgb.g = g;
+  rgb.b = b;
+}
+
+inline void fill_solid(CRGB *leds, int num_leds, const CRGB &color) {
+  std::fill_n(leds, num_leds, color);
+}
+
+inline void fadeToBlackBy(CRGB *leds, uint16_t num_leds, uint8_t fade_by) {
+  for (uint16_t i = 0; i < num_leds; i++) {
+    leds[i].nscale8(255 - fade_by);
+  }
+}
+
+inline CRGB HeatColor(uint8_t temperature) {
+  const uint8_t t192 = scale8_video(temperature, 191);
+  const uint8_t heatramp = (t192 & 0x3F) << 2;
+
+  if (t192 & 0x80) return CRGB(255, 255, heatramp);
+  if (t192 & 0x40) return CRGB(255, heatramp, 0);
+  return CRGB(heatramp, 0, 0);
+}
+
+enum TBlendType { NOBLEND = 0, LINEARBLEND = 1 };
+
+struct CRGBPalette16 {
+  CRGB entries[16];
+
+  CRGBPalette16(std::initializer_list<uint32_t> codes) {
+    uint8_t i = 0;
+    for (uint32_t code : codes) {
+      if (i < 16) entries[i++] = CRGB(code);
+    }
+  }
+
+  // Gradient through four evenly spaced colors.
+  CRGBPalette16(const CRGB &c1, const CRGB &c2, const CRGB &c3, const CRGB &c4) {
+    const CRGB stops[] = { c1, c2, c3, c4 };
+    for (uint8_t i = 0; i < 16; i++) {
+      const uint16_t pos = i * 3 * 256 / 15;
+      const uint8_t k = std::min(pos >> 8, 2);
+      const uint8_t frac = pos - (k << 8);
+      for (uint8_t c = 0; c < 3; c++) {
+        entries[i].raw[c] = stops[k].raw[c] + (((int16_t)stops[k + 1].raw[c] - stops[k].raw[c]) * frac) / 256;
+      }
+    }
+  }
+};
+
+inline CRGB ColorFromPalette(const CRGBPalette16 &pal, uint8_t index, uint8_t brightness = 255,
+                             TBlendType blend_type = LINEARBLEND) {
+  const uint8_t hi4 = index >> 4;
+  const uint8_t lo4 = index & 0x0F;
+  CRGB color = pal.entries[hi4];
+
+  if (blend_type == LINEARBLEND && lo4) {
+    const CRGB &next = pal.entries[(hi4 + 1) & 0x0F];
+    const uint8_t f2 = lo4 << 4;
+    const uint8_t f1 = 255 - f2;
+    for (uint8_t c = 0; c < 3; c++) {
+      color.raw[c] = scale8(color.raw[c], f1) + scale8(next.raw[c], f2);
+    }
+  }
+
+  if (brightness != 255) {
+    color.nscale8_video(brightness);
+  }
+  return color;
+}
+
+enum EOrder { RGB = 0012, GRB = 0102 };
+enum LEDColorCorrection : uint32_t { TypicalSMD5050 = 0xFFB0F0 };
+#define DISABLE_DITHER 0x00
+
+template <uint8_t PIN, EOrder ORDER>
+class WS2812B {};
+
+class CLEDController {
+public:
+  CLEDController &setCorrection(LEDColorCorrection correction) { return *this; }
+};
+
+class CFastLED {
+public:
+  template <template <uint8_t, EOrder> class CHIPSET, uint8_t PIN, EOrder ORDER>
+  CLEDController &addLeds(CRGB *leds, int num_leds) {
+    this->leds = leds;
+    this->num_leds = num_leds;
+    return controller;
+  }
+
+  void setBrightness(uint8_t scale) { brightness = scale; }
+  uint8_t getBrightness() { return brightness; }
+  void setDither(uint8_t dither_mode) {}
+  void show() { show_count++; }
+
+  // Host only: what was last registered with addLeds and shown.
+  CRGB *leds = nullptr;
+  int num_leds = 0;
+  uint32_t show_count = 0;
+
+private:
+  CLEDController controller;
+  uint8_t brightness = 255;
+};
+
+inline CFastLED FastLED;
+
+#endif // __NATIVE_FASTLED_H__
@@ -0,0 +1,145 @@
+#ifndef __NATIVE_LITTLEFS_H__
+#define __NATIVE_LITTLEFS_H__
+
+/**
+ * In-memory stand-in for LittleFS, see Arduino.h next to it. Files live in a
+ * map of byte vectors: reading and seeking never allocate, so code whose
+ * steady state is checked for allocations can read from it.
+ */
+
+#include <Arduino.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+// Host only: bytes read from any file, to check how much code reads.
+inline uint64_t native_fs_bytes_read = 0;
+
+// Host only: size of the filesystem, as reported by info(). Writes aren't
+// held to it.
+inline size_t native_fs_total_bytes = 1024 * 1024;
+
+struct FSInfo {
+  size_t totalBytes;
+  size_t usedBytes;
+  size_t blockSize;
+  size_t pageSize;
+  size_t maxOpenFiles;
+  size_t maxPathLength;
+};
+
+class File {
+public:
+  File() {}
+  explicit File(std::shared_ptr<std::vector<uint8_t>> data) : data(data) {}
+
+  explicit operator bool() const {
+    return data != nullptr;
+  }
+
+  size_t read(uint8_t *buf, size_t size) {
+    if (!data || pos >= data->size()) return 0;
+
+    size = std::min(size, data->size() - pos);
+    memcpy(buf, data->data() + pos, size);
+    pos += size;
+    native_fs_bytes_read += size;
+    return size;
+  }
+
+  size_t write(const uint8_t *buf, size_t size) {
+    if (!data) return 0;
+
+    data->insert(data->end(), buf, buf + size);
+    pos = data->size();
+    return size;
+  }
+
+  bool seek(uint32_t offset, SeekMode mode = SeekSet) {
+    if (!data) return false;
+
+    const size_t base = mode == SeekSet ? 0 : (mode == SeekCur ? pos : data->size());
+    if (base + offset > data->size()) return false;
+    pos = base + offset;
+    return true;
+  }
+
+  size_t position() const {
+    return pos;
+  }
+
+  size_t size() const {
+    return data ? data->size() : 0;
+  }
+
+  void close() {
+    data = nullptr;
+    pos = 0;
+  }
+
+private:
+  std::shared_ptr<std::vector<uint8_t>> data;
+  size_t pos = 0;
+};
+
+class NativeFS {
+public:
+  File open(const char *path, const char *mode) {
+    if (mode[0] == 'w') {
+      files[path] = std::make_shared<std::vector<uint8_t>>();
+    } else if (mode[0] == 'a') {
+      if (!exists(path)) files[path] = std::make_shared<std::vector<uint8_t>>();
+    } else if (!exists(path)) {
+      return File();
+    }
+
+    File f(files[path]);
+    if (mode[0] == 'a') f.seek(0, SeekEnd);
+    return f;
+  }
+
+  bool exists(const char *path) {
+    return files.count(path) > 0;
+  }
+
+  bool remove(const char *path) {
+    return files.erase(path) > 0;
+  }
+
+  bool rename(const char *from, const char *to) {
+    auto it = files.find(from);
+    if (it == files.end()) return false;
+
+    files[to] = it->second;
+    files.erase(from);
+    return true;
+  }
+
+  bool info(FSInfo &info) {
+    info = FSInfo();
+    info.totalBytes = native_fs_total_bytes;
+    for (const auto &file : files) {
+      info.usedBytes += file.second->size();
+    }
+    info.blockSize = 8192;
+    info.pageSize = 256;
+    info.maxOpenFiles = 5;
+    info.maxPathLength = 32;
+    return true;
+  }
+
+  // Host only: drops every file.
+  void format() {
+    files.clear();
+  }
+
+private:
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+};
+
+inline NativeFS LittleFS;
+
+#endif // __NATIVE_LITTLEFS_H__
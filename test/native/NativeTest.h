@@ -0,0 +1,88 @@
+#ifndef __NATIVE_TEST_H__
+#define __NATIVE_TEST_H__
+
+/**
+ * Shared by the native test suites: timing of benchmarks and allocation
+ * counting. Every suite includes it, as it also brings in the malloc
+ * wrappers the [env:native] link flags expect (see HeapTrack.h).
+ *
+ * Benchmarks print their results and only fail past a budget, scaled down by
+ * NATIVE_HOST_SPEEDUP from what the ESP8266 (at 80MHz) can afford: host
+ * timings are indicative, what they catch is a change of complexity.
+ */
+
+#include <stdio.h>
+
+#include <chrono>
+#include <new>
+
+#include <unity.h>
+
+#include "HeapTrack.h"
+
+// How much faster than the ESP8266 a host is assumed to be, at the very
+// least.
+#define NATIVE_HOST_SPEEDUP 20
+
+// Time available to render and show one frame on the device.
+#define NATIVE_FRAME_BUDGET_NS (16 * 1000 * 1000)
+
+/**
+ * Runs `fn` `iterations` times and returns the average time it took, in ns.
+ */
+template <typename Fn>
+double bench_ns(uint32_t iterations, Fn fn) {
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iterations; i++) {
+    fn();
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+inline void bench_report(const char *name, double ns, const char *unit = "call") {
+  char msg[128];
+  snprintf(msg, sizeof(msg), "%s: %.1f ns/%s", name, ns, unit);
+  TEST_MESSAGE(msg);
+}
+
+// The firmware links libstdc++ statically so operator new ends up in the
+// wrapped malloc; on a host it lives in a shared library, so route it there
+// explicitly.
+void *operator new(size_t size) {
+  void *ptr = malloc(size);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t size) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void *ptr, size_t size) noexcept {
+  free(ptr);
+}
+
+// Allocations made so far, whatever their tag.
+inline uint32_t total_allocs() {
+  uint32_t allocs = 0;
+  for (uint8_t i = 0; i < (uint8_t)HeapTag::Count; i++) {
+    allocs += HeapTrack::get_stats((HeapTag)i).allocs;
+  }
+  return allocs;
+}
+
+#endif // __NATIVE_TEST_H__
@@ -0,0 +1,101 @@
+#ifndef __NATIVE_WIFIUDP_H__
+#define __NATIVE_WIFIUDP_H__
+
+/**
+ * Stand-in for WiFiUDP, see Arduino.h next to it: multicast over a loopback
+ * shared by every socket in the program. A packet sent to a group reaches
+ * every other socket that joined it on that port, `native_udp_latency_us`
+ * of simulated time later.
+ */
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#include <deque>
+
+inline uint32_t native_udp_latency_us = 0;
+
+class WiFiUDP;
+inline std::vector<WiFiUDP *> native_udp_sockets;
+
+class WiFiUDP {
+public:
+  WiFiUDP() {
+    native_udp_sockets.push_back(this);
+  }
+
+  ~WiFiUDP() {
+    native_udp_sockets.erase(std::find(native_udp_sockets.begin(), native_udp_sockets.end(), this));
+  }
+
+  uint8_t beginMulticast(IPAddress interface_addr, IPAddress multicast, uint16_t port) {
+    group = multicast;
+    group_port = port;
+    joined = true;
+    return 1;
+  }
+
+  void stop() {
+    joined = false;
+    queue.clear();
+  }
+
+  int beginPacketMulticast(IPAddress multicast, uint16_t port, IPAddress interface_addr, int ttl = 1) {
+    out_group = multicast;
+    out_port = port;
+    out.clear();
+    return 1;
+  }
+
+  size_t write(const uint8_t *buffer, size_t size) {
+    out.insert(out.end(), buffer, buffer + size);
+    return size;
+  }
+
+  int endPacket() {
+    for (WiFiUDP *socket : native_udp_sockets) {
+      if (socket != this && socket->joined && socket->group == out_group && socket->group_port == out_port) {
+        socket->queue.push_back({ micros() + native_udp_latency_us, out });
+      }
+    }
+    return 1;
+  }
+
+  // Moves on to the next packet that has arrived, returns its size.
+  int parsePacket() {
+    current.clear();
+    read_pos = 0;
+    if (queue.empty() || (int32_t)(micros() - queue.front().arrival_us) < 0) return 0;
+
+    current = queue.front().data;
+    queue.pop_front();
+    return current.size();
+  }
+
+  int read(uint8_t *buffer, size_t len) {
+    len = std::min(len, current.size() - read_pos);
+    memcpy(buffer, current.data() + read_pos, len);
+    read_pos += len;
+    return len;
+  }
+
+private:
+  struct Packet {
+    uint32_t arrival_us;
+    std::vector<uint8_t> data;
+  };
+
+  bool joined = false;
+  IPAddress group;
+  uint16_t group_port = 0;
+  std::deque<Packet> queue;
+
+  std::vector<uint8_t> current;
+  size_t read_pos = 0;
+
+  IPAddress out_group;
+  uint16_t out_port = 0;
+  std::vector<uint8_t> out;
+};
+
+#endif // __NATIVE_WIFIUDP_H__
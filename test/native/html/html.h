@@ -0,0 +1,33 @@
+#ifndef __HTML_H__
+#define __HTML_H__
+
+/**
+ * Stand-in for the pages gen_html.py embeds in the firmware (src/html/html.h,
+ * generated when building for the board), see Arduino.h next to it. The
+ * content is made up, only its size and the way it's served matter.
+ */
+
+#include <Arduino.h>
+
+struct HtmlPage {
+  const char *path;
+  const char *mime_type;
+  const char *etag;
+  // gzip compressed page content, stored in PROGMEM
+  const uint8_t *content;
+  size_t length;
+};
+
+// More than one chunk (see HTML_CHUNK_BYTES in LedWeb.h), not a whole number
+// of them.
+inline const uint8_t PAGE_MAIN_HTML[600] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03,
+};
+
+inline const HtmlPage HTML_PAGES[] = {
+  { "/", "text/html", "\"0123456789abcdef\"", PAGE_MAIN_HTML, sizeof(PAGE_MAIN_HTML) },
+};
+
+#define HTML_PAGE_COUNT 1
+
+#endif // __HTML_H__
@@ -0,0 +1,240 @@
+#define NUM_LEDS 60
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "NativeTest.h"
+#include "LedApiOps.h"
+
+// Stands in for LedWeb: records which handler ran.
+struct FakeApi {
+  const char *called = nullptr;
+
+  void handle_fill_solid() { called = "fill_solid"; }
+  void handle_fill_gradient() { called = "fill_gradient"; }
+  void handle_fill_rainbow() { called = "fill_rainbow"; }
+  void handle_status() { called = "status"; }
+  void handle_reboot() { called = "reboot"; }
+  void handle_brightness() { called = "set_brightness"; }
+  void handle_set_param() { called = "set_param"; }
+  void handle_heap_stats() { called = "heap_stats"; }
+};
+
+typedef LedApiOps<FakeApi> Ops;
+typedef ApiOp<Ops::Handler> Op;
+
+#define OP_COUNT (sizeof(Ops::OPS) / sizeof(Ops::OPS[0]))
+
+static StaticJsonDocument<JSON_BUFFER_CAPACITY_BYTES> doc;
+static char body[512];
+
+/**
+ * What LedWeb::handle_api_request() does before running the handler: parses
+ * the request in place, looks the op up and validates the request against
+ * its schema. Returns the op, or nullptr for a bad request.
+ */
+static const Op *parse_request(const char *request, const ApiField **invalid_field = nullptr) {
+  const size_t len = strlen(request);
+  memcpy(body, request, len + 1);
+
+  if (deserializeJson(doc, body, len)) return nullptr;
+
+  const Op *op = Ops::find(doc["op"]);
+  if (op == nullptr) return nullptr;
+
+  const ApiField *invalid = api_validate(doc.as<JsonObjectConst>(), *op);
+  if (invalid_field != nullptr) *invalid_field = invalid;
+  return invalid == nullptr ? op : nullptr;
+}
+
+static bool valid(const char *request) {
+  return parse_request(request) != nullptr;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_shash_n_matches_shash() {
+  static constexpr const char *strings[] = { "", "a", "/api", "fill_solid", "heap_stats", "\xff\x80 signed" };
+
+  for (const char *s : strings) {
+    TEST_ASSERT_EQUAL_UINT32(shash(s), shash_n(s, strlen(s)));
+  }
+  TEST_ASSERT_EQUAL_UINT32(shash("/api"), shash_n("/api/more", 4));
+}
+
+void test_every_op_is_found() {
+  for (size_t i = 0; i < OP_COUNT; i++) {
+    TEST_ASSERT_EQUAL_PTR(&Ops::OPS[i], Ops::find(Ops::OPS[i].name));
+  }
+}
+
+void test_unknown_ops_are_rejected() {
+  TEST_ASSERT_NULL(Ops::find(nullptr));
+  TEST_ASSERT_NULL(Ops::find(""));
+  TEST_ASSERT_NULL(Ops::find("fill"));
+  TEST_ASSERT_NULL(Ops::find("fill_solid_"));
+  TEST_ASSERT_NULL(Ops::find("FILL_SOLID"));
+  TEST_ASSERT_NULL(Ops::find("no_such_op"));
+}
+
+void test_long_op_names_are_rejected() {
+  // Long enough to run the stack out if it was hashed recursively.
+  static char name[16 * 1024];
+  memset(name, 'a', sizeof(name) - 1);
+  name[sizeof(name) - 1] = '\0';
+  TEST_ASSERT_NULL(Ops::find(name));
+
+  // Valid prefix.
+  memcpy(name, "status", 6);
+  TEST_ASSERT_NULL(Ops::find(name));
+
+  name[API_OP_NAME_MAX + 1] = '\0';
+  TEST_ASSERT_NULL(Ops::find(name));
+}
+
+void test_index_refuses_long_op_names() {
+  static constexpr ApiOp<Ops::Handler> ops[] = {
+    { "status", &FakeApi::handle_status, API_NO_FIELDS },
+    { "a_name_longer_than_16", &FakeApi::handle_reboot, API_NO_FIELDS },
+  };
+  static constexpr ApiOpIndex<2> index = make_api_op_index<2>(ops);
+  static_assert(index.seed == 0, "Op names longer than API_OP_NAME_MAX must be refused");
+}
+
+void test_dispatch() {
+  FakeApi api;
+
+  for (size_t i = 0; i < OP_COUNT; i++) {
+    const Op *op = Ops::find(Ops::OPS[i].name);
+    TEST_ASSERT_NOT_NULL(op);
+    (api.*(op->handler))();
+    TEST_ASSERT_EQUAL_STRING(Ops::OPS[i].name, api.called);
+  }
+}
+
+void test_bad_json() {
+  TEST_ASSERT_FALSE(valid(""));
+  TEST_ASSERT_FALSE(valid("{\"op\":"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"status\""));
+  TEST_ASSERT_FALSE(valid("{}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":12}"));
+}
+
+void test_validate_int() {
+  TEST_ASSERT_TRUE(valid("{\"op\":\"set_brightness\",\"value\":0}"));
+  TEST_ASSERT_TRUE(valid("{\"op\":\"set_brightness\",\"value\":255}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"set_brightness\"}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"set_brightness\",\"value\":256}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"set_brightness\",\"value\":-1}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"set_brightness\",\"value\":1.5}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"set_brightness\",\"value\":\"10\"}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"set_brightness\",\"value\":[10]}"));
+
+  TEST_ASSERT_TRUE(valid("{\"op\":\"set_param\",\"name\":\"seed\",\"value\":-2147483648}"));
+  TEST_ASSERT_TRUE(valid("{\"op\":\"set_param\",\"name\":\"seed\",\"value\":2147483647}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"set_param\",\"name\":\"seed\",\"value\":2147483648}"));
+}
+
+void test_validate_triplet() {
+  const ApiField *invalid = nullptr;
+
+  TEST_ASSERT_TRUE(valid("{\"op\":\"fill_solid\",\"color\":[0,128,255]}"));
+  TEST_ASSERT_TRUE(valid("{\"op\":\"fill_solid\",\"color\":[1,2,3],\"range_start\":59,\"range_size\":60}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"fill_solid\",\"color\":[1,2]}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"fill_solid\",\"color\":[1,2,3,4]}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"fill_solid\",\"color\":[1,2,256]}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"fill_solid\",\"color\":[1,2,\"3\"]}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"fill_solid\",\"color\":{\"r\":1}}"));
+
+  TEST_ASSERT_NULL(parse_request("{\"op\":\"fill_solid\",\"color\":[1,2,3],\"range_start\":60}", &invalid));
+  TEST_ASSERT_NOT_NULL(invalid);
+  TEST_ASSERT_EQUAL_STRING("range_start", invalid->name);
+
+  TEST_ASSERT_NULL(parse_request("{\"op\":\"fill_solid\",\"range_size\":1}", &invalid));
+  TEST_ASSERT_EQUAL_STRING("color", invalid->name);
+}
+
+void test_validate_triplet_list() {
+  TEST_ASSERT_TRUE(valid("{\"op\":\"fill_gradient\",\"colors\":[[0,0,0],[255,255,255]]}"));
+  TEST_ASSERT_TRUE(valid("{\"op\":\"fill_gradient\",\"space\":\"hsv\",\"colors\":"
+                         "[[0,0,0],[1,1,1],[2,2,2],[3,3,3],[4,4,4],[5,5,5],[6,6,6],[7,7,7]]}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"fill_gradient\",\"colors\":[[0,0,0]]}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"fill_gradient\",\"colors\":"
+                          "[[0,0,0],[1,1,1],[2,2,2],[3,3,3],[4,4,4],[5,5,5],[6,6,6],[7,7,7],[8,8,8]]}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"fill_gradient\",\"colors\":[[0,0,0],[1,1]]}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"fill_gradient\",\"colors\":[0,0,0]}"));
+}
+
+void test_validate_text() {
+  TEST_ASSERT_TRUE(valid("{\"op\":\"set_param\",\"name\":\"c\",\"value\":1}"));
+  TEST_ASSERT_TRUE(valid("{\"op\":\"set_param\",\"name\":\"sixteen_chars_xx\",\"value\":1}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"set_param\",\"name\":\"\",\"value\":1}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"set_param\",\"name\":\"seventeen_chars_x\",\"value\":1}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"set_param\",\"name\":12,\"value\":1}"));
+  TEST_ASSERT_FALSE(valid("{\"op\":\"fill_gradient\",\"space\":\"hsva\",\"colors\":[[0,0,0],[1,1,1]]}"));
+}
+
+void test_unknown_fields_are_ignored() {
+  TEST_ASSERT_TRUE(valid("{\"op\":\"status\",\"color\":\"whatever\"}"));
+  TEST_ASSERT_TRUE(valid("{\"op\":\"set_brightness\",\"value\":3,\"extra\":[1,2,3]}"));
+}
+
+// Time to parse, look up, validate and dispatch a typical request for every
+// op to its handler, and the allocations it makes (none). test_web times the
+// same through LedWeb, with the real handlers.
+void test_bench_requests() {
+  FakeApi api;
+
+  static const char *requests[] = {
+    "{\"op\":\"fill_solid\",\"color\":[255,128,0],\"range_start\":10,\"range_size\":20}",
+    "{\"op\":\"fill_gradient\",\"space\":\"hsv\",\"colors\":[[0,255,255],[96,255,255],[160,255,255],[224,255,255]]}",
+    "{\"op\":\"fill_rainbow\",\"initial_hue\":32,\"hue_step\":512}",
+    "{\"op\":\"status\"}",
+    "{\"op\":\"reboot\"}",
+    "{\"op\":\"set_brightness\",\"value\":128}",
+    "{\"op\":\"set_param\",\"name\":\"cooling\",\"value\":80}",
+    "{\"op\":\"heap_stats\"}",
+  };
+  static_assert(sizeof(requests) / sizeof(requests[0]) == OP_COUNT, "One request per op");
+
+  for (size_t i = 0; i < OP_COUNT; i++) {
+    const Op *op = parse_request(requests[i]);
+    TEST_ASSERT_EQUAL_PTR(&Ops::OPS[i], op);
+
+    const uint32_t allocs = total_allocs();
+    const double ns = bench_ns(20000, [&]() {
+      (api.*(parse_request(requests[i])->handler))();
+    });
+    TEST_ASSERT_EQUAL_STRING(op->name, api.called);
+    const uint32_t request_allocs = total_allocs() - allocs;
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%s: %.0f ns/request, %u bytes, %u allocations",
+             op->name, ns, (unsigned)strlen(requests[i]), request_allocs);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_EQUAL_UINT32(0, request_allocs);
+    // Well within a frame, requests are served between two of them.
+    TEST_ASSERT_LESS_THAN(NATIVE_FRAME_BUDGET_NS / 16 / NATIVE_HOST_SPEEDUP, ns);
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_shash_n_matches_shash);
+  RUN_TEST(test_every_op_is_found);
+  RUN_TEST(test_unknown_ops_are_rejected);
+  RUN_TEST(test_long_op_names_are_rejected);
+  RUN_TEST(test_index_refuses_long_op_names);
+  RUN_TEST(test_dispatch);
+  RUN_TEST(test_bad_json);
+  RUN_TEST(test_validate_int);
+  RUN_TEST(test_validate_triplet);
+  RUN_TEST(test_validate_triplet_list);
+  RUN_TEST(test_validate_text);
+  RUN_TEST(test_unknown_fields_are_ignored);
+  RUN_TEST(test_bench_requests);
+  return UNITY_END();
+}
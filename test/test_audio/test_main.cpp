@@ -0,0 +1,419 @@
+#include <Arduino.h>
+#include <FastLED.h>
+
+#include "NativeTest.h"
+#include "AudioInput.h"
+
+#include <complex>
+
+// Beats of the synthesized track.
+#define TRACK_BPM 120
+#define TRACK_BEATS 16
+#define TRACK_RATE 16000
+
+/**
+ * 16 bit PCM audio, mono or mixed down to mono, as read from a WAV file.
+ */
+struct Wav {
+  uint32_t rate = 0;
+  std::vector<int16_t> samples;
+
+  // Sample at a time, in us from the start.
+  int16_t at_us(uint64_t us) const {
+    const uint64_t i = us * rate / 1000000;
+    return i < samples.size() ? samples[i] : 0;
+  }
+
+  uint64_t duration_us() const {
+    return (uint64_t)samples.size() * 1000000 / rate;
+  }
+};
+
+static uint32_t le32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t le16(const uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+
+/**
+ * Parses a RIFF WAVE file holding 16 bit PCM. Returns false for anything
+ * else.
+ */
+static bool parse_wav(const std::vector<uint8_t> &data, Wav &wav) {
+  if (data.size() < 12 || memcmp(&data[0], "RIFF", 4) != 0 || memcmp(&data[8], "WAVE", 4) != 0) {
+    return false;
+  }
+
+  uint16_t channels = 0, bits = 0;
+  for (size_t pos = 12; pos + 8 <= data.size();) {
+    const uint8_t *chunk = &data[pos];
+    const uint32_t len = le32(chunk + 4);
+    if (pos + 8 + len > data.size()) return false;
+
+    if (memcmp(chunk, "fmt ", 4) == 0 && len >= 16) {
+      if (le16(chunk + 8) != 1) return false;
+      channels = le16(chunk + 10);
+      wav.rate = le32(chunk + 12);
+      bits = le16(chunk + 22);
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      if (channels == 0 || bits != 16 || wav.rate == 0) return false;
+
+      const uint32_t frames = len / (2 * channels);
+      wav.samples.resize(frames);
+      for (uint32_t i = 0; i < frames; i++) {
+        int32_t sum = 0;
+        for (uint16_t c = 0; c < channels; c++) {
+          sum += (int16_t)le16(chunk + 8 + (i * channels + c) * 2);
+        }
+        wav.samples[i] = sum / channels;
+      }
+      return true;
+    }
+    pos += 8 + len + (len & 1);
+  }
+  return false;
+}
+
+static void put32(std::vector<uint8_t> &out, uint32_t v) {
+  for (int i = 0; i < 4; i++) out.push_back(v >> (8 * i));
+}
+
+static void put16(std::vector<uint8_t> &out, uint16_t v) {
+  out.push_back(v);
+  out.push_back(v >> 8);
+}
+
+/**
+ * A WAV file of a kick drum (a short decaying 60Hz thump) on every beat over
+ * a quieter pad of higher notes, the kind of input the effects react to.
+ * Stereo, so that the mixdown gets exercised too.
+ */
+static std::vector<uint8_t> synthesize_track() {
+  const uint32_t beat_samples = TRACK_RATE * 60 / TRACK_BPM;
+  const uint32_t frames = beat_samples * TRACK_BEATS;
+
+  std::vector<uint8_t> out;
+  out.insert(out.end(), { 'R', 'I', 'F', 'F' });
+  put32(out, 36 + frames * 4);
+  out.insert(out.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+  put32(out, 16);
+  put16(out, 1);
+  put16(out, 2);
+  put32(out, TRACK_RATE);
+  put32(out, TRACK_RATE * 4);
+  put16(out, 4);
+  put16(out, 16);
+  out.insert(out.end(), { 'd', 'a', 't', 'a' });
+  put32(out, frames * 4);
+
+  for (uint32_t i = 0; i < frames; i++) {
+    const double t = (double)i / TRACK_RATE;
+    const double beat_t = (double)(i % beat_samples) / TRACK_RATE;
+    const double kick = exp(-beat_t * 25) * sin(2 * M_PI * 60 * beat_t);
+    const double pad = 0.08 * (sin(2 * M_PI * 440 * t) + sin(2 * M_PI * 660 * t));
+    put16(out, (int16_t)(20000 * (kick + pad)));
+    put16(out, (int16_t)(20000 * (kick - pad)));
+  }
+  return out;
+}
+
+/**
+ * What the microphone module feeds A0 for a sample: biased at half scale,
+ * 10 bits.
+ */
+static uint16_t to_adc(int16_t sample) {
+  return (uint16_t)((sample + 32768) >> 6);
+}
+
+struct Onsets {
+  std::vector<uint64_t> at_us;
+  uint32_t buffers = 0;
+};
+
+/**
+ * Plays `wav` into AudioInput the way the firmware polls it: a poll every
+ * `poll_interval_us`, plus a stall of `stall_us` every frame (rendering and
+ * FastLED.show()). Returns when the onsets were seen.
+ */
+static Onsets play(const Wav &wav, uint32_t poll_interval_us, uint32_t stall_us) {
+  AudioAnalyzer analyzer;
+  AudioFeatures features;
+  Onsets onsets;
+
+  analyzer.reset();
+  native_micros = 0;
+  AudioInput::begin();
+  while (AudioInput::read() != NULL) {}
+
+  uint32_t next_frame_us = 16000;
+  while (native_micros < wav.duration_us()) {
+    native_analog_value = to_adc(wav.at_us(native_micros));
+    AudioInput::poll();
+
+    const int16_t *samples = AudioInput::read();
+    if (samples != NULL) {
+      analyzer.process(samples, features);
+      onsets.buffers++;
+      if (features.onset) onsets.at_us.push_back(native_micros);
+    }
+
+    native_advance_us(poll_interval_us);
+    if (stall_us > 0 && native_micros >= next_frame_us) {
+      native_advance_us(stall_us);
+      next_frame_us += 16000;
+    }
+  }
+  return onsets;
+}
+
+/**
+ * Magnitudes of the windowed spectrum in double precision, scaled like
+ * audio_fft()'s output (1/AUDIO_FFT_SIZE).
+ */
+static void reference_spectrum(const double *signal, double *mag) {
+  for (uint16_t k = 0; k < AUDIO_FFT_SIZE / 2; k++) {
+    std::complex<double> sum = 0;
+    for (uint16_t n = 0; n < AUDIO_FFT_SIZE; n++) {
+      const double w = 0.5 - 0.5 * cos(2 * M_PI * n / AUDIO_FFT_SIZE);
+      sum += signal[n] * w * std::polar(1.0, -2 * M_PI * k * n / AUDIO_FFT_SIZE);
+    }
+    mag[k] = std::abs(sum) / AUDIO_FFT_SIZE;
+  }
+}
+
+/**
+ * Runs the fixed-point pipeline up to the band energies on `signal` (in
+ * Q15 units) and the same in double precision, and returns the largest band
+ * error relative to the loudest band.
+ */
+static double band_error(const double *signal, uint16_t *bands = nullptr) {
+  int16_t re[AUDIO_FFT_SIZE], im[AUDIO_FFT_SIZE];
+  uint16_t mag[AUDIO_FFT_SIZE / 2], fixed_bands[AUDIO_BANDS];
+  double ref_mag[AUDIO_FFT_SIZE / 2], ref_bands[AUDIO_BANDS];
+
+  for (uint16_t n = 0; n < AUDIO_FFT_SIZE; n++) {
+    re[n] = (int16_t)lround(signal[n]);
+    im[n] = 0;
+  }
+  audio_window(re);
+  audio_fft(re, im);
+  audio_magnitudes(re, im, mag);
+  audio_band_energies(mag, fixed_bands);
+
+  reference_spectrum(signal, ref_mag);
+  double loudest = 0;
+  for (uint8_t b = 0; b < AUDIO_BANDS; b++) {
+    double sum = 0;
+    for (uint8_t i = AUDIO_BAND_EDGES[b]; i < AUDIO_BAND_EDGES[b + 1]; i++) {
+      sum += ref_mag[i];
+    }
+    ref_bands[b] = sum / (AUDIO_BAND_EDGES[b + 1] - AUDIO_BAND_EDGES[b]);
+    loudest = std::max(loudest, ref_bands[b]);
+  }
+
+  double error = 0;
+  for (uint8_t b = 0; b < AUDIO_BANDS; b++) {
+    error = std::max(error, fabs(fixed_bands[b] - ref_bands[b]) / loudest);
+  }
+  if (bands != nullptr) memcpy(bands, fixed_bands, sizeof(fixed_bands));
+  return error;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_fft_matches_dft() {
+  int16_t re[AUDIO_FFT_SIZE], im[AUDIO_FFT_SIZE];
+  double signal[AUDIO_FFT_SIZE];
+
+  random16_set_seed(1);
+  for (uint16_t n = 0; n < AUDIO_FFT_SIZE; n++) {
+    signal[n] = 12000 * sin(2 * M_PI * 5 * n / AUDIO_FFT_SIZE) +
+                6000 * cos(2 * M_PI * 23 * n / AUDIO_FFT_SIZE) +
+                (int16_t)(random16() % 4096) - 2048;
+    re[n] = (int16_t)lround(signal[n]);
+    im[n] = 0;
+  }
+  audio_fft(re, im);
+
+  double max_error = 0;
+  for (uint16_t k = 0; k < AUDIO_FFT_SIZE; k++) {
+    std::complex<double> sum = 0;
+    for (uint16_t n = 0; n < AUDIO_FFT_SIZE; n++) {
+      sum += signal[n] * std::polar(1.0, -2 * M_PI * k * n / AUDIO_FFT_SIZE);
+    }
+    sum /= AUDIO_FFT_SIZE;
+    max_error = std::max(max_error, std::abs(sum - std::complex<double>(re[k], im[k])));
+  }
+
+  char msg[64];
+  snprintf(msg, sizeof(msg), "max FFT error: %.2f LSB", max_error);
+  TEST_MESSAGE(msg);
+  // Rounding of each of the 7 stages, a few LSB in all.
+  TEST_ASSERT_TRUE(max_error < 8);
+  // The two tones, halved by the real to complex split, give or take the
+  // noise.
+  TEST_ASSERT_INT_WITHIN(300, -6000, im[5]);
+  TEST_ASSERT_INT_WITHIN(300, 3000, re[23]);
+}
+
+void test_band_energies_match_reference() {
+  double signal[AUDIO_FFT_SIZE];
+
+  random16_set_seed(2);
+  double worst = 0;
+  for (uint8_t round = 0; round < 16; round++) {
+    const double f1 = 1 + random16() % 60 + (random16() % 100) / 100.0;
+    const double f2 = 1 + random16() % 60 + (random16() % 100) / 100.0;
+    for (uint16_t n = 0; n < AUDIO_FFT_SIZE; n++) {
+      signal[n] = 14000 * sin(2 * M_PI * f1 * n / AUDIO_FFT_SIZE) +
+                  7000 * sin(2 * M_PI * f2 * n / AUDIO_FFT_SIZE + 1);
+    }
+    worst = std::max(worst, band_error(signal));
+  }
+
+  char msg[64];
+  snprintf(msg, sizeof(msg), "max band error: %.1f%% of the loudest band", worst * 100);
+  TEST_MESSAGE(msg);
+  // Alpha max plus beta min is within ~7%, quantization adds a little.
+  TEST_ASSERT_TRUE(worst < 0.08);
+}
+
+void test_tone_lands_in_its_band() {
+  double signal[AUDIO_FFT_SIZE];
+  uint16_t bands[AUDIO_BANDS];
+
+  for (uint8_t b = 0; b < AUDIO_BANDS; b++) {
+    // Middle of the band, in bins.
+    const double bin = (AUDIO_BAND_EDGES[b] + AUDIO_BAND_EDGES[b + 1] - 1) / 2.0;
+    for (uint16_t n = 0; n < AUDIO_FFT_SIZE; n++) {
+      signal[n] = 16000 * sin(2 * M_PI * bin * n / AUDIO_FFT_SIZE);
+    }
+    band_error(signal, bands);
+
+    const uint16_t *loudest = std::max_element(bands, bands + AUDIO_BANDS);
+    TEST_ASSERT_EQUAL(b, loudest - bands);
+  }
+}
+
+void test_wav_is_parsed() {
+  Wav wav;
+  TEST_ASSERT_TRUE(parse_wav(synthesize_track(), wav));
+  TEST_ASSERT_EQUAL_UINT32(TRACK_RATE, wav.rate);
+  TEST_ASSERT_EQUAL_UINT32(TRACK_RATE * 60 / TRACK_BPM * TRACK_BEATS, wav.samples.size());
+
+  std::vector<uint8_t> bad = synthesize_track();
+  bad[20] = 3;  // IEEE float
+  TEST_ASSERT_FALSE(parse_wav(bad, wav));
+}
+
+// Sampling has to keep the rate of the input, polled or not.
+void test_poll_keeps_the_sample_rate() {
+  native_micros = 0;
+  AudioInput::begin();
+  while (AudioInput::read() != NULL) {}
+
+  uint32_t buffers = 0;
+  for (uint32_t ms = 0; ms < 1024; ms++) {
+    // A 3ms stall every 16ms.
+    native_advance_us(ms % 16 == 0 ? 3000 : 1000);
+    AudioInput::poll();
+    if (AudioInput::read() != NULL) buffers++;
+  }
+  // 1024 + 64 * 2ms at 4kHz, in buffers of 128.
+  TEST_ASSERT_INT_WITHIN(1, (1024 + 64 * 2) * AUDIO_SAMPLE_RATE / 1000 / AUDIO_FFT_SIZE, buffers);
+}
+
+void test_beats_of_wav_are_detected() {
+  Wav wav;
+  TEST_ASSERT_TRUE(parse_wav(synthesize_track(), wav));
+  const uint64_t beat_us = 60ull * 1000000 / TRACK_BPM;
+  const uint64_t buffer_us = (uint64_t)AUDIO_FFT_SIZE * AUDIO_SAMPLE_PERIOD_US;
+
+  // Ideal sampling, then the way the firmware polls: every 100us or so, with
+  // the loop away rendering for 4ms of every frame.
+  const uint32_t stalls[] = { 0, 4000 };
+  for (uint32_t stall_us : stalls) {
+    const Onsets onsets = play(wav, stall_us == 0 ? AUDIO_SAMPLE_PERIOD_US : 100, stall_us);
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%ums stalls: %u onsets for %u beats in %u buffers",
+             stall_us / 1000, (unsigned)onsets.at_us.size(), TRACK_BEATS, onsets.buffers);
+    TEST_MESSAGE(msg);
+
+    // Every beat is reported once, by the buffer the kick lands in or the
+    // next one.
+    TEST_ASSERT_EQUAL_UINT32(TRACK_BEATS, onsets.at_us.size());
+    for (uint64_t at_us : onsets.at_us) {
+      const uint64_t since_beat_us = at_us % beat_us;
+      TEST_ASSERT_TRUE(since_beat_us <= 2 * buffer_us + stall_us);
+    }
+  }
+}
+
+// Reports what the analyzer makes of a recording:
+//   AUDIO_WAV_FILE=track.wav pio test -e native -f test_audio
+void test_wav_file() {
+  const char *path = getenv("AUDIO_WAV_FILE");
+  if (path == nullptr) {
+    TEST_IGNORE_MESSAGE("Set AUDIO_WAV_FILE to analyze a 16 bit PCM WAV file");
+  }
+
+  FILE *f = fopen(path, "rb");
+  TEST_ASSERT_NOT_NULL(f);
+  std::vector<uint8_t> data;
+  uint8_t buf[4096];
+  for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) {
+    data.insert(data.end(), buf, buf + n);
+  }
+  fclose(f);
+
+  Wav wav;
+  TEST_ASSERT_TRUE(parse_wav(data, wav));
+  const Onsets onsets = play(wav, 100, 4000);
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "%s: %.1fs, %u buffers, %u onsets (%.0f per minute)",
+           path, wav.duration_us() / 1e6, onsets.buffers, (unsigned)onsets.at_us.size(),
+           onsets.at_us.size() * 60e6 / wav.duration_us());
+  TEST_MESSAGE(msg);
+}
+
+// One buffer completes every 32ms; its analysis shares the loop with
+// rendering.
+void test_bench_process() {
+  AudioAnalyzer analyzer;
+  AudioFeatures features;
+  int16_t samples[AUDIO_FFT_SIZE];
+
+  analyzer.reset();
+  random16_set_seed(3);
+  for (uint16_t n = 0; n < AUDIO_FFT_SIZE; n++) {
+    samples[n] = (int16_t)(16384 + 8000 * sin(2 * M_PI * 7 * n / AUDIO_FFT_SIZE) + random16() % 2048);
+  }
+
+  const uint32_t allocs = total_allocs();
+  const double ns = bench_ns(10000, [&]() {
+    analyzer.process(samples, features);
+  });
+  bench_report("AudioAnalyzer::process", ns, "buffer");
+
+  TEST_ASSERT_EQUAL_UINT32(allocs, total_allocs());
+  TEST_ASSERT_TRUE(ns < NATIVE_FRAME_BUDGET_NS / 8 / NATIVE_HOST_SPEEDUP);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_fft_matches_dft);
+  RUN_TEST(test_band_energies_match_reference);
+  RUN_TEST(test_tone_lands_in_its_band);
+  RUN_TEST(test_wav_is_parsed);
+  RUN_TEST(test_poll_keeps_the_sample_rate);
+  RUN_TEST(test_beats_of_wav_are_detected);
+  RUN_TEST(test_wav_file);
+  RUN_TEST(test_bench_process);
+  return UNITY_END();
+}
@@ -0,0 +1,274 @@
+#define NUM_LEDS 60
+#define ENABLE_CYCLE_CACHE
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <LittleFS.h>
+
+#include "NativeTest.h"
+#include "LedCycleCache.h"
+#include "LedManager.h"
+
+#define WAVE_CACHE_PATH "/cycle2_wave.lbs"
+#define WAVE_INDEX_PATH "/cycle2_wave.idx"
+#define WAVE_KEYFRAMES ((WAVE_CYCLE_FRAMES + CYCLE_CACHE_KEYFRAME_INTERVAL - 1) / CYCLE_CACHE_KEYFRAME_INTERVAL)
+
+// Most a frame can take in the file: its header, then a literal op for every
+// SEQUENCE_OP_MAX_COUNT leds.
+#define MAX_FRAME_BYTES (3 + NUM_LEDS * 3 + (NUM_LEDS + SEQUENCE_OP_MAX_COUNT - 1) / SEQUENCE_OP_MAX_COUNT)
+// Reading the next frame reads whole read ahead buffers.
+#define MAX_NEXT_BYTES (MAX_FRAME_BYTES + SEQUENCE_READ_AHEAD_BYTES)
+// Any other reads at most a keyframe interval of frames, and an offset.
+#define MAX_DRAW_BYTES (CYCLE_CACHE_KEYFRAME_INTERVAL * MAX_FRAME_BYTES + SEQUENCE_READ_AHEAD_BYTES + 4)
+
+static CRGB leds[NUM_LEDS];
+static CRGB expected[NUM_LEDS];
+static LedControl control(leds);
+
+static WaveAnim wave;
+static CycleCache cache;
+
+// Builds the cache of `anim` from scratch, or opens it if it's there.
+static void build(LedAnim &anim, CycleCache &cache = cache) {
+  cache.begin(&anim, 0);
+  for (uint32_t i = 0; i < WAVE_CYCLE_FRAMES && !cache.is_ready(); i++) {
+    cache.build_slice(CYCLE_CACHE_SETTLE_MS + i);
+  }
+  TEST_ASSERT_TRUE(cache.is_ready());
+}
+
+static uint32_t file_count() {
+  uint32_t count = 0;
+  for (const char *path : { WAVE_CACHE_PATH, WAVE_INDEX_PATH, CYCLE_CACHE_TMP_PATH, CYCLE_CACHE_INDEX_TMP_PATH }) {
+    count += LittleFS.exists(path);
+  }
+  return count;
+}
+
+static uint32_t file_size(const char *path) {
+  return LittleFS.open(path, "r").size();
+}
+
+static uint32_t frame_time(uint16_t frame) {
+  return (uint32_t)frame * WAVE_CYCLE_FRAME_MS;
+}
+
+static void assert_frame(uint16_t frame) {
+  wave.draw_cycle_frame(expected, frame);
+  TEST_ASSERT_EQUAL_MEMORY(expected, leds, sizeof(leds));
+}
+
+void setUp() {
+  LittleFS.format();
+  wave.begin(&control);
+}
+
+void tearDown() {
+  cache.end();
+}
+
+// The same frames, minute after minute. The clock only goes forward.
+void test_live_is_the_cycle() {
+  for (uint32_t minute = 0; minute < 3; minute++) {
+    for (uint16_t frame : { 0, 1, 700, WAVE_CYCLE_FRAMES - 1 }) {
+      native_micros = (minute * WAVE_CYCLE_MS + frame_time(frame)) * 1000;
+      wave.draw();
+      assert_frame(frame);
+    }
+  }
+}
+
+void test_cached_frames_match_live() {
+  build(wave);
+  TEST_ASSERT_EQUAL_UINT32(WAVE_KEYFRAMES * 4, file_size(WAVE_INDEX_PATH));
+  // Delta frames.
+  TEST_ASSERT_TRUE(file_size(WAVE_CACHE_PATH) < WAVE_CYCLE_FRAMES * MAX_FRAME_BYTES);
+
+  // In order, then all over the place.
+  for (uint16_t frame = 0; frame < WAVE_CYCLE_FRAMES; frame++) {
+    TEST_ASSERT_TRUE(cache.draw(leds, frame_time(frame)));
+    assert_frame(frame);
+  }
+  for (uint16_t i = 0; i < WAVE_CYCLE_FRAMES; i++) {
+    const uint16_t frame = (i * 997) % WAVE_CYCLE_FRAMES;
+    TEST_ASSERT_TRUE(cache.draw(leds, frame_time(frame) + WAVE_CYCLE_MS * 3));
+    assert_frame(frame);
+  }
+}
+
+// Whatever frame is due, drawing it decodes at most from the keyframe before
+// it, and only the frame itself when it's the next one.
+void test_draw_decodes_from_keyframe() {
+  build(wave);
+  // Played back from the file, as after switching effects.
+  cache.end();
+  build(wave);
+
+  const uint16_t frames[] = {
+    WAVE_CYCLE_FRAMES - 1, 0, 1, 2, 900, 10, 11, 31, 33, 32, WAVE_CYCLE_FRAMES - 1
+  };
+  for (uint16_t frame : frames) {
+    const uint64_t before = native_fs_bytes_read;
+    TEST_ASSERT_TRUE(cache.draw(leds, frame_time(frame)));
+    TEST_ASSERT_TRUE(native_fs_bytes_read - before <= MAX_DRAW_BYTES);
+    assert_frame(frame);
+  }
+  for (uint16_t frame = 0; frame < 3 * CYCLE_CACHE_KEYFRAME_INTERVAL; frame++) {
+    const uint64_t before = native_fs_bytes_read;
+    TEST_ASSERT_TRUE(cache.draw(leds, frame_time(frame)));
+    TEST_ASSERT_TRUE(native_fs_bytes_read - before <= MAX_NEXT_BYTES);
+    assert_frame(frame);
+  }
+
+  // The same frame again doesn't read anything.
+  const uint64_t before = native_fs_bytes_read;
+  TEST_ASSERT_TRUE(cache.draw(leds, frame_time(3 * CYCLE_CACHE_KEYFRAME_INTERVAL - 1) + 1));
+  TEST_ASSERT_EQUAL_UINT64(before, native_fs_bytes_read);
+}
+
+void test_missing_index_rebuilds() {
+  build(wave);
+  cache.end();
+
+  LittleFS.remove(WAVE_INDEX_PATH);
+  cache.begin(&wave, 0);
+  TEST_ASSERT_FALSE(cache.is_ready());
+  TEST_ASSERT_FALSE(LittleFS.exists(WAVE_CACHE_PATH));
+
+  build(wave);
+  TEST_ASSERT_TRUE(LittleFS.exists(WAVE_CACHE_PATH));
+  TEST_ASSERT_TRUE(LittleFS.exists(WAVE_INDEX_PATH));
+}
+
+// Selecting the effect doesn't write anything, until it has been on for a
+// while.
+void test_waits_to_settle() {
+  cache.begin(&wave, 1000);
+  cache.build_slice(1000 + CYCLE_CACHE_SETTLE_MS - 1);
+  TEST_ASSERT_EQUAL_UINT32(0, file_count());
+
+  cache.end();
+  cache.begin(&wave, 1000);
+  cache.build_slice(1000 + CYCLE_CACHE_SETTLE_MS);
+  TEST_ASSERT_EQUAL_UINT32(2, file_count());
+
+  // A cache that's not complete is thrown away.
+  cache.end();
+  TEST_ASSERT_EQUAL_UINT32(0, file_count());
+}
+
+void test_no_room_draws_live() {
+  const size_t total_bytes = native_fs_total_bytes;
+  native_fs_total_bytes = WAVE_CYCLE_FRAMES * MAX_FRAME_BYTES + CYCLE_CACHE_FS_RESERVE_BYTES;
+
+  cache.begin(&wave, 0);
+  for (uint32_t i = 0; i < WAVE_CYCLE_FRAMES; i++) {
+    cache.build_slice(CYCLE_CACHE_SETTLE_MS + i);
+  }
+  TEST_ASSERT_FALSE(cache.is_ready());
+  TEST_ASSERT_FALSE(cache.draw(leds, 0));
+  TEST_ASSERT_EQUAL_UINT32(0, file_count());
+
+  native_fs_total_bytes = total_bytes;
+}
+
+// Not rebuilt after it turned out corrupt, until reboot.
+void test_corrupt_cache_not_retried() {
+  static CycleCache cache;
+  build(wave, cache);
+  cache.end();
+
+  // Keep a bit of the first frame.
+  File file = LittleFS.open(WAVE_CACHE_PATH, "r");
+  std::vector<uint8_t> data(SEQUENCE_HEADER_BYTES + 20);
+  file.read(data.data(), data.size());
+  file.close();
+  LittleFS.open(WAVE_CACHE_PATH, "w").write(data.data(), data.size());
+
+  cache.begin(&wave, 0);
+  TEST_ASSERT_TRUE(cache.is_ready());
+  TEST_ASSERT_FALSE(cache.draw(leds, frame_time(5)));
+  TEST_ASSERT_FALSE(cache.is_ready());
+  TEST_ASSERT_EQUAL_UINT32(0, file_count());
+
+  cache.begin(&wave, 0);
+  cache.build_slice(CYCLE_CACHE_SETTLE_MS);
+  TEST_ASSERT_FALSE(cache.is_ready());
+  TEST_ASSERT_EQUAL_UINT32(0, file_count());
+}
+
+// Between frames, LedManager builds a slice at most, and not as rendering.
+void test_manager_builds_a_slice_per_frame() {
+  static LedManager mgr;
+  mgr.begin();
+  mgr.set_effect(AnimEffect::Wave);
+  HeapTrack::arm_steady_state();
+  const uint32_t render_allocs = HeapTrack::get_stats(HeapTag::Render).allocs;
+
+  auto run_frames = [](uint32_t frames) {
+    for (uint32_t i = 0; i < frames * 4; i++) {
+      native_advance_us(FRAME_INTERVAL_MS * 1000 / 4);
+      mgr.handle();
+    }
+  };
+  const uint32_t build_frames = WAVE_CYCLE_FRAMES / CYCLE_CACHE_SLICE_FRAMES;
+  run_frames(CYCLE_CACHE_SETTLE_MS / FRAME_INTERVAL_MS + build_frames - 2);
+  TEST_ASSERT_TRUE(LittleFS.exists(CYCLE_CACHE_TMP_PATH));
+  TEST_ASSERT_FALSE(LittleFS.exists(WAVE_CACHE_PATH));
+  run_frames(4);
+  TEST_ASSERT_TRUE(LittleFS.exists(WAVE_CACHE_PATH));
+
+  TEST_ASSERT_EQUAL_UINT32(render_allocs, HeapTrack::get_stats(HeapTag::Render).allocs);
+  TEST_ASSERT_EQUAL_UINT32(0, HeapTrack::get_violations());
+
+  // Played back from there, as of the last frame.
+  run_frames(1);
+  const uint32_t shown_ms = GET_MILLIS() / FRAME_INTERVAL_MS * FRAME_INTERVAL_MS;
+  wave.draw_cycle_frame(expected, (shown_ms / WAVE_CYCLE_FRAME_MS) % WAVE_CYCLE_FRAMES);
+  TEST_ASSERT_EQUAL_MEMORY(expected, mgr.get_control()->leds, sizeof(expected));
+  mgr.set_effect(AnimEffect::Solid);
+}
+
+void test_bench_live_vs_cached() {
+  build(wave);
+
+  uint16_t frame = 0;
+  const double live_ns = bench_ns(WAVE_CYCLE_FRAMES * 2, [&]() {
+    wave.draw_cycle_frame(leds, frame);
+    frame = (frame + 1) % WAVE_CYCLE_FRAMES;
+  });
+
+  const uint32_t allocs = total_allocs();
+  frame = 0;
+  const double cached_ns = bench_ns(WAVE_CYCLE_FRAMES * 2, [&]() {
+    cache.draw(leds, frame_time(frame));
+    frame = (frame + 1) % WAVE_CYCLE_FRAMES;
+  });
+  TEST_ASSERT_EQUAL_UINT32(allocs, total_allocs());
+
+  bench_report("wave live", live_ns, "frame");
+  bench_report("wave cached", cached_ns, "frame");
+
+  char msg[96];
+  snprintf(msg, sizeof(msg), "wave cache: %u frames, %u bytes + %u bytes of index",
+           WAVE_CYCLE_FRAMES, file_size(WAVE_CACHE_PATH), file_size(WAVE_INDEX_PATH));
+  TEST_MESSAGE(msg);
+
+  // It's only worth it if decoding is well below rendering.
+  TEST_ASSERT_TRUE(cached_ns < live_ns / 2);
+  TEST_ASSERT_TRUE(cached_ns < NATIVE_FRAME_BUDGET_NS / 8 / NATIVE_HOST_SPEEDUP);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_live_is_the_cycle);
+  RUN_TEST(test_cached_frames_match_live);
+  RUN_TEST(test_draw_decodes_from_keyframe);
+  RUN_TEST(test_missing_index_rebuilds);
+  RUN_TEST(test_waits_to_settle);
+  RUN_TEST(test_no_room_draws_live);
+  RUN_TEST(test_corrupt_cache_not_retried);
+  RUN_TEST(test_manager_builds_a_slice_per_frame);
+  RUN_TEST(test_bench_live_vs_cached);
+  return UNITY_END();
+}
@@ -0,0 +1,141 @@
+#define NUM_LEDS 1000
+#define LED_HIGH_BIT_DEPTH
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+#include "NativeTest.h"
+#include "LedControl.h"
+
+// What the high bit depth pipeline adds per led, as documented.
+static_assert(sizeof(CRGB16) + 2 * sizeof(CRGB) == 12, "leds16, output and residual");
+static_assert(sizeof(LedControl) >= 12 * NUM_LEDS && sizeof(LedControl) < 12 * NUM_LEDS + 64,
+              "LedControl's per led cost changed, update LedControl.h and platformio.ini");
+
+// Frames over which the output is averaged: any error carried by the
+// residual is at most 1 step, so this is within 1/256 of a step.
+#define AVERAGE_FRAMES 256
+
+static CRGB16 src16[NUM_LEDS];
+static CRGB src8[NUM_LEDS];
+static CRGB dst[NUM_LEDS];
+static CRGB residual[NUM_LEDS];
+
+/**
+ * Average 8 bit output of `value` at `scale` over AVERAGE_FRAMES frames, in
+ * 1/256ths of a step.
+ */
+static uint32_t average_output(uint16_t value, uint16_t scale) {
+  uint8_t r = 0;
+  uint32_t sum = 0;
+  for (uint16_t f = 0; f < AVERAGE_FRAMES; f++) {
+    sum += dither_channel(value, scale, r);
+  }
+  return sum * 256 / AVERAGE_FRAMES;
+}
+
+void setUp() {
+  std::fill_n(residual, NUM_LEDS, CRGB::Black);
+}
+
+void tearDown() {}
+
+void test_average_matches_16_bits() {
+  random16_set_seed(1);
+  for (uint16_t i = 0; i < 2000; i++) {
+    const uint16_t value = random16();
+    const uint16_t scale = random16();
+    const uint32_t exact = ((uint32_t)value * scale) >> 16;
+
+    TEST_ASSERT_UINT32_WITHIN(1, exact, average_output(value, scale));
+  }
+}
+
+void test_extremes() {
+  // Full scale stays at 255 on every frame, black at 0.
+  uint8_t r = 0;
+  for (uint16_t f = 0; f < 16; f++) {
+    TEST_ASSERT_EQUAL_UINT8(255, dither_channel(65535, 65535, r));
+  }
+  r = 0;
+  for (uint16_t f = 0; f < 16; f++) {
+    TEST_ASSERT_EQUAL_UINT8(0, dither_channel(0, 65535, r));
+    TEST_ASSERT_EQUAL_UINT8(0, dither_channel(65535, 0, r));
+  }
+}
+
+// What dithering is for: levels between two 8 bit steps still show, as a
+// mix of both.
+void test_levels_below_one_step() {
+  // A quarter of a step.
+  TEST_ASSERT_UINT32_WITHIN(1, 64, average_output(64, 65535));
+  // 8 bit 1 at 1/3 brightness.
+  const uint32_t third = average_output(257, 21845);
+  TEST_ASSERT_UINT32_WITHIN(1, 85, third);
+
+  uint8_t r = 0;
+  bool on = false, off = false;
+  for (uint16_t f = 0; f < 8; f++) {
+    const uint8_t v = dither_channel(257, 21845, r);
+    TEST_ASSERT_TRUE(v <= 1);
+    on |= v == 1;
+    off |= v == 0;
+  }
+  TEST_ASSERT_TRUE(on && off);
+}
+
+void test_channels_and_pixels_are_independent() {
+  for (uint16_t i = 0; i < NUM_LEDS; i++) {
+    src16[i] = CRGB16(i * 65, 65535 - i * 65, 32768);
+  }
+
+  uint32_t sums[NUM_LEDS][3] = {};
+  for (uint16_t f = 0; f < AVERAGE_FRAMES; f++) {
+    dither_output(src16, dst, residual, NUM_LEDS, 40000);
+    for (uint16_t i = 0; i < NUM_LEDS; i++) {
+      for (uint8_t c = 0; c < 3; c++) sums[i][c] += dst[i].raw[c];
+    }
+  }
+
+  for (uint16_t i = 0; i < NUM_LEDS; i++) {
+    for (uint8_t c = 0; c < 3; c++) {
+      const uint32_t exact = ((uint32_t)dither_channel_value(src16[i], c) * 40000) >> 16;
+      TEST_ASSERT_UINT32_WITHIN(1, exact, sums[i][c] * 256 / AVERAGE_FRAMES);
+    }
+  }
+}
+
+// The output pass runs on every frame over the whole strip.
+void test_bench_dither_output() {
+  random16_set_seed(2);
+  for (uint16_t i = 0; i < NUM_LEDS; i++) {
+    src16[i] = CRGB16(random16(), random16(), random16());
+    src8[i] = CRGB(random8(), random8(), random8());
+  }
+
+  const uint32_t allocs = total_allocs();
+  uint16_t scale = 0;
+  const double ns16 = bench_ns(2000, [&]() {
+    dither_output(src16, dst, residual, NUM_LEDS, scale += 7);
+  });
+  bench_report("dither_output CRGB16 x1000", ns16, "frame");
+
+  const double ns8 = bench_ns(2000, [&]() {
+    dither_output(src8, dst, residual, NUM_LEDS, scale += 7);
+  });
+  bench_report("dither_output CRGB x1000", ns8, "frame");
+
+  TEST_ASSERT_EQUAL_UINT32(allocs, total_allocs());
+  TEST_ASSERT_TRUE(ns16 < NATIVE_FRAME_BUDGET_NS / 8 / NATIVE_HOST_SPEEDUP);
+  TEST_ASSERT_TRUE(ns8 < NATIVE_FRAME_BUDGET_NS / 8 / NATIVE_HOST_SPEEDUP);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_average_matches_16_bits);
+  RUN_TEST(test_extremes);
+  RUN_TEST(test_levels_below_one_step);
+  RUN_TEST(test_channels_and_pixels_are_independent);
+  RUN_TEST(test_bench_dither_output);
+  return UNITY_END();
+}
@@ -0,0 +1,82 @@
+#include <Arduino.h>
+
+#include "NativeTest.h"
+#include "MicroUtil.h"
+
+// What LedWeb::serve_page() answers with a 304 to: the ETag of a page
+// generated by gen_html.py, quotes included.
+#define ETAG "\"0123456789abcdef\""
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_exact_match() {
+  TEST_ASSERT_TRUE(etag_matches(ETAG, ETAG));
+}
+
+void test_no_header() {
+  TEST_ASSERT_FALSE(etag_matches("", ETAG));
+}
+
+void test_other_etag() {
+  TEST_ASSERT_FALSE(etag_matches("\"fedcba9876543210\"", ETAG));
+  // Prefixes and unquoted values don't match.
+  TEST_ASSERT_FALSE(etag_matches("\"0123456789abcde\"", ETAG));
+  TEST_ASSERT_FALSE(etag_matches("\"0123456789abcdef0\"", ETAG));
+  TEST_ASSERT_FALSE(etag_matches("0123456789abcdef", ETAG));
+}
+
+void test_list() {
+  TEST_ASSERT_TRUE(etag_matches("\"aaaa\", " ETAG, ETAG));
+  TEST_ASSERT_TRUE(etag_matches(ETAG ",\"aaaa\"", ETAG));
+  TEST_ASSERT_TRUE(etag_matches("\"aaaa\" ,  " ETAG "  , \"bbbb\"", ETAG));
+  TEST_ASSERT_FALSE(etag_matches("\"aaaa\", \"bbbb\"", ETAG));
+}
+
+void test_weak_validator() {
+  TEST_ASSERT_TRUE(etag_matches("W/" ETAG, ETAG));
+  TEST_ASSERT_TRUE(etag_matches("\"aaaa\", W/" ETAG, ETAG));
+}
+
+void test_wildcard() {
+  TEST_ASSERT_TRUE(etag_matches("*", ETAG));
+}
+
+// What LedWeb::serve_page() checks before sending a gzipped page.
+void test_accepts_gzip() {
+  TEST_ASSERT_TRUE(accepts_gzip("gzip"));
+  TEST_ASSERT_TRUE(accepts_gzip("gzip, deflate, br"));
+  TEST_ASSERT_TRUE(accepts_gzip("deflate ,GZIP;q=0.5"));
+  TEST_ASSERT_TRUE(accepts_gzip("x-gzip"));
+  TEST_ASSERT_TRUE(accepts_gzip("*"));
+  TEST_ASSERT_TRUE(accepts_gzip("br;q=1.0, *;q=0.1"));
+}
+
+void test_refuses_gzip() {
+  // Only identity.
+  TEST_ASSERT_FALSE(accepts_gzip(""));
+  TEST_ASSERT_FALSE(accepts_gzip("identity"));
+  TEST_ASSERT_FALSE(accepts_gzip("deflate, br"));
+  // Listed, but with a zero quality.
+  TEST_ASSERT_FALSE(accepts_gzip("gzip;q=0"));
+  TEST_ASSERT_FALSE(accepts_gzip("gzip ; q=0.000, br"));
+  TEST_ASSERT_FALSE(accepts_gzip("*;q=0"));
+  // Explicitly refused wins over the wildcard.
+  TEST_ASSERT_FALSE(accepts_gzip("*, gzip;q=0"));
+  // Not a prefix match.
+  TEST_ASSERT_FALSE(accepts_gzip("gzipped"));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_exact_match);
+  RUN_TEST(test_no_header);
+  RUN_TEST(test_other_etag);
+  RUN_TEST(test_list);
+  RUN_TEST(test_weak_validator);
+  RUN_TEST(test_wildcard);
+  RUN_TEST(test_accepts_gzip);
+  RUN_TEST(test_refuses_gzip);
+  return UNITY_END();
+}
@@ -0,0 +1,324 @@
+#define NUM_LEDS 4000
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+#include "NativeTest.h"
+#include "LedControl.h"
+
+// Largest difference from a per-pixel conversion, on any channel, where
+// pixels are interpolated in RGB rather than converted (see LedFill.h).
+#define RAMP_MAX_ERROR 5
+
+static CRGB leds[NUM_LEDS];
+static CRGB expected[NUM_LEDS];
+static LedControl control(leds);
+
+/**
+ * The per-pixel versions the kernels replace. Not inlined: on the device
+ * FastLED's conversion is in its own translation unit, so it can't be
+ * specialized for a constant saturation and value either.
+ */
+__attribute__((noipa))
+static void hsv_per_pixel(CRGB *dst, uint16_t len, int32_t hue, int32_t hue_step,
+                          int32_t sat, int32_t sat_step, int32_t val, int32_t val_step) {
+  for (uint16_t i = 0; i < len; i++) {
+    dst[i] = CHSV((hue >> 8) & 0xFF, sat >> 8, val >> 8);
+    hue += hue_step;
+    sat += sat_step;
+    val += val_step;
+  }
+}
+
+static void rainbow_per_pixel(CRGB *dst, uint16_t len, uint8_t hue, uint16_t hue_step) {
+  hsv_per_pixel(dst, len, (int32_t)hue << 8, hue_step, 255 << 8, 0, 255 << 8, 0);
+}
+
+// Same segments and fixed point steps as fill_gradient_ramp().
+__attribute__((noipa))
+static void hsv_gradient_per_pixel(CRGB *dst, uint16_t len, const CHSV *stops, uint8_t stop_count) {
+  uint16_t start = 0;
+  for (uint8_t k = 0; k + 1 < stop_count; k++) {
+    const uint16_t end = (uint32_t)(k + 1) * (len - 1) / (stop_count - 1);
+    const int32_t seg = end - start;
+    if (seg > 0) {
+      const CHSV &a = stops[k];
+      const CHSV &b = stops[k + 1];
+      hsv_per_pixel(&dst[start], seg,
+                    (int32_t)a.hue << 8, (int32_t)(int8_t)(b.hue - a.hue) * 256 / seg,
+                    (int32_t)a.sat << 8, ((int32_t)b.sat - a.sat) * 256 / seg,
+                    (int32_t)a.val << 8, ((int32_t)b.val - a.val) * 256 / seg);
+    }
+    start = end;
+  }
+  dst[len - 1] = stops[stop_count - 1];
+}
+
+static uint8_t max_error(const CRGB *a, const CRGB *b, uint16_t len) {
+  uint8_t worst = 0;
+  for (uint16_t i = 0; i < len; i++) {
+    for (uint8_t c = 0; c < 3; c++) {
+      worst = std::max(worst, (uint8_t)abs(a[i].raw[c] - b[i].raw[c]));
+    }
+  }
+  return worst;
+}
+
+static double mean_error(const CRGB *a, const CRGB *b, uint16_t len) {
+  uint32_t sum = 0;
+  for (uint16_t i = 0; i < len; i++) {
+    for (uint8_t c = 0; c < 3; c++) {
+      sum += abs(a[i].raw[c] - b[i].raw[c]);
+    }
+  }
+  return (double)sum / (3 * len);
+}
+
+static void assert_untouched(uint16_t first, uint16_t count) {
+  for (uint16_t i = 0; i < NUM_LEDS; i++) {
+    if (i < first || i >= first + count) {
+      TEST_ASSERT_FALSE(leds[i]);
+    }
+  }
+}
+
+void setUp() {
+  std::fill_n(leds, NUM_LEDS, CRGB::Black);
+}
+
+void tearDown() {}
+
+void test_rainbow_matches_per_pixel() {
+  static const uint16_t lengths[] = { 1, 2, 7, 60, 333, 1000, NUM_LEDS };
+
+  for (uint16_t len : lengths) {
+    const uint16_t steps[] = { fill_rainbow_step(len), 1, 16, 100, 3000, 40000, 65535 };
+    for (uint16_t step : steps) {
+      for (uint8_t hue : { 0, 31, 32, 200 }) {
+        setUp();
+        control.fill_rainbow(hue, step, 0, len);
+        rainbow_per_pixel(expected, len, hue, step);
+
+        TEST_ASSERT_TRUE(max_error(leds, expected, len) <= RAMP_MAX_ERROR);
+        TEST_ASSERT_TRUE(mean_error(leds, expected, len) < 1);
+        // The first pixel is always converted.
+        TEST_ASSERT_TRUE(leds[0] == expected[0]);
+        assert_untouched(0, len);
+      }
+    }
+  }
+}
+
+// Whole hues per pixel, as FastLED's own fill_rainbow does.
+void test_rainbow_whole_hue_steps() {
+  for (uint16_t delta = 1; delta <= 8; delta++) {
+    control.fill_rainbow(17, delta * 256);
+    rainbow_per_pixel(expected, NUM_LEDS, 17, delta * 256);
+    TEST_ASSERT_TRUE(max_error(leds, expected, NUM_LEDS) <= 1);
+  }
+}
+
+// What the API does without a hue step: one rainbow over the part of the
+// range that's on the strip, however far past the end it was asked to go.
+void test_default_step_is_one_rainbow() {
+  uint16_t first = NUM_LEDS - 100, count = 500;
+  LedControl::clamp_range(first, count);
+  TEST_ASSERT_EQUAL_UINT16(100, count);
+
+  const uint16_t step = fill_rainbow_step(count);
+  control.fill_rainbow(0, step, first, count);
+  assert_untouched(first, count);
+
+  // Most of the way around the wheel, short of the first hue again.
+  const uint32_t last_hue = ((uint32_t)(count - 1) * step) >> 8;
+  TEST_ASSERT_TRUE(last_hue >= 250 && last_hue <= 255);
+  rainbow_per_pixel(expected, count, 0, step);
+  TEST_ASSERT_TRUE(max_error(&leds[first], expected, count) <= RAMP_MAX_ERROR);
+
+  TEST_ASSERT_EQUAL_UINT16(65535, fill_rainbow_step(0));
+  TEST_ASSERT_EQUAL_UINT16(65535, fill_rainbow_step(1));
+  TEST_ASSERT_EQUAL_UINT16(65, fill_rainbow_step(1000));
+}
+
+void test_hsv_gradient_matches_per_pixel() {
+  static const CHSV stops[] = {
+    CHSV(10, 255, 255), CHSV(200, 120, 180), CHSV(90, 255, 60), CHSV(250, 0, 255),
+  };
+
+  for (uint16_t len : { 2, 5, 60, 333, 1000, NUM_LEDS }) {
+    for (uint8_t stop_count = 2; stop_count <= 4; stop_count++) {
+      setUp();
+      control.fill_gradient(stops, stop_count, 0, len);
+      hsv_gradient_per_pixel(expected, len, stops, stop_count);
+
+      TEST_ASSERT_TRUE(max_error(leds, expected, len) <= RAMP_MAX_ERROR);
+      TEST_ASSERT_TRUE(mean_error(leds, expected, len) < 2.5);
+      // Stops land exactly on their pixel at both ends, as long as there
+      // are enough pixels for them all.
+      if (len >= stop_count) {
+        TEST_ASSERT_TRUE(leds[0] == CRGB(stops[0]));
+      }
+      TEST_ASSERT_TRUE(leds[len - 1] == CRGB(stops[stop_count - 1]));
+      assert_untouched(0, len);
+    }
+  }
+}
+
+void test_rgb_gradient_matches_lerp() {
+  static const CRGB stops[] = {
+    CRGB(255, 0, 0), CRGB(0, 0, 255), CRGB(10, 200, 30), CRGB(255, 255, 255),
+  };
+
+  for (uint16_t len : { 4, 5, 60, 333, 1000, NUM_LEDS }) {
+    setUp();
+    control.fill_gradient(stops, 4, 0, len);
+
+    for (uint8_t k = 0; k < 3; k++) {
+      const uint16_t start = (uint32_t)k * (len - 1) / 3;
+      const uint16_t end = (uint32_t)(k + 1) * (len - 1) / 3;
+      for (uint16_t i = start; i < end; i++) {
+        const double f = (double)(i - start) / (end - start);
+        for (uint8_t c = 0; c < 3; c++) {
+          const double exact = stops[k].raw[c] + (stops[k + 1].raw[c] - stops[k].raw[c]) * f;
+          TEST_ASSERT_TRUE(fabs(leds[i].raw[c] - exact) <= 1);
+        }
+      }
+    }
+    TEST_ASSERT_TRUE(leds[0] == stops[0]);
+    TEST_ASSERT_TRUE(leds[len - 1] == stops[3]);
+  }
+}
+
+// Best of a few runs of bench_ns(), for comparisons that have to hold.
+template <typename Fn>
+static double best_ns(uint32_t iterations, Fn fn) {
+  double best = bench_ns(iterations, fn);
+  for (uint8_t run = 1; run < 5; run++) {
+    best = std::min(best, bench_ns(iterations, fn));
+  }
+  return best;
+}
+
+// Whether fill_gradient_ramp() ramps every segment of the gradient.
+static bool gradient_uses_ramp(uint16_t len, const CHSV *stops, uint8_t stop_count) {
+  bool ramps = true;
+  uint16_t start = 0;
+  for (uint8_t k = 0; k + 1 < stop_count; k++) {
+    const uint16_t end = (uint32_t)(k + 1) * (len - 1) / (stop_count - 1);
+    const int32_t seg = end - start;
+    const CHSV &a = stops[k];
+    const CHSV &b = stops[k + 1];
+    ramps &= fill_hsv_uses_ramp((int32_t)(int8_t)(b.hue - a.hue) * 256 / seg,
+                                ((int32_t)b.sat - a.sat) * 256 / seg,
+                                ((int32_t)b.val - a.val) * 256 / seg);
+    start = end;
+  }
+  return ramps;
+}
+
+/**
+ * Times both fills against their per-pixel versions. Where the kernels ramp
+ * they have to be faster. Elsewhere they convert every pixel too, and only
+ * have to keep up.
+ */
+static void bench_fill(const char *name, uint16_t len) {
+  static const CHSV stops[] = { CHSV(10, 255, 255), CHSV(200, 120, 180), CHSV(90, 255, 60) };
+  const uint16_t step = fill_rainbow_step(len);
+  const uint32_t iterations = 2000000 / len;
+  char label[64];
+  uint8_t hue = 0;
+
+  const uint32_t allocs = total_allocs();
+  const double rainbow_ns = best_ns(iterations, [&]() {
+    control.fill_rainbow(hue++, step, 0, len);
+  });
+  const double gradient_ns = best_ns(iterations, [&]() {
+    control.fill_gradient(stops, 3, 0, len);
+  });
+  TEST_ASSERT_EQUAL_UINT32(allocs, total_allocs());
+
+  const double rainbow_ref_ns = best_ns(iterations, [&]() {
+    rainbow_per_pixel(leds, len, hue++, step);
+  });
+  const double gradient_ref_ns = best_ns(iterations, [&]() {
+    hsv_gradient_per_pixel(leds, len, stops, 3);
+  });
+
+  const bool rainbow_ramps = fill_hsv_uses_ramp(step, 0, 0);
+  const bool gradient_ramps = gradient_uses_ramp(len, stops, 3);
+
+  snprintf(label, sizeof(label), "%s fill_rainbow (%s)", name, rainbow_ramps ? "ramp" : "per pixel");
+  bench_report(label, rainbow_ns, "fill");
+  snprintf(label, sizeof(label), "%s per-pixel rainbow", name);
+  bench_report(label, rainbow_ref_ns, "fill");
+  snprintf(label, sizeof(label), "%s fill_gradient hsv (%s)", name, gradient_ramps ? "ramp" : "per pixel");
+  bench_report(label, gradient_ns, "fill");
+  snprintf(label, sizeof(label), "%s per-pixel gradient", name);
+  bench_report(label, gradient_ref_ns, "fill");
+
+  TEST_ASSERT_TRUE(rainbow_ns < rainbow_ref_ns * (rainbow_ramps ? 1 : 1.25));
+  TEST_ASSERT_TRUE(gradient_ns < gradient_ref_ns * (gradient_ramps ? 1 : 1.25));
+}
+
+void test_bench_60() {
+  // One rainbow over 60 leds, 7.5 pixels per section: converted per pixel.
+  TEST_ASSERT_FALSE(fill_hsv_uses_ramp(fill_rainbow_step(60), 0, 0));
+  bench_fill("x60", 60);
+}
+
+void test_bench_1000() {
+  bench_fill("x1000", 1000);
+}
+
+void test_bench_4000() {
+  bench_fill("x4000", NUM_LEDS);
+}
+
+// Right at FILL_MIN_RAMP_PIXELS, in every dimension, ramps still pay off.
+void test_ramp_faster_at_threshold() {
+  const int32_t hue_step = (1 << FILL_HUE_SECTION_BITS) / FILL_MIN_RAMP_PIXELS;
+  const int32_t sv_step = FILL_MAX_RAMP_SV / FILL_MIN_RAMP_PIXELS;
+  const int32_t steps[][3] = {
+    { hue_step, 0, 0 }, { -hue_step, 0, 0 }, { 10, sv_step, 0 }, { 10, 0, -sv_step },
+  };
+
+  for (const int32_t *s : steps) {
+    TEST_ASSERT_TRUE(fill_hsv_uses_ramp(s[0], s[1], s[2]));
+    TEST_ASSERT_FALSE(fill_hsv_uses_ramp(s[0] * 2, s[1] * 2, s[2] * 2));
+
+    // Saturation or value going through all of its range.
+    const uint16_t len = 255 * 256 / std::max({ 1, abs(s[1]), abs(s[2]) });
+    const int32_t sv_start = (s[1] < 0 || s[2] < 0) ? 255 << 8 : 0;
+    const int32_t sat = s[1] != 0 ? sv_start : 255 << 8;
+    const int32_t val = s[2] != 0 ? sv_start : 255 << 8;
+    const uint16_t n = std::min<uint16_t>(len, NUM_LEDS);
+
+    const double ramp_ns = best_ns(1000, [&]() {
+      fill_hsv_ramp(leds, n, 0, s[0], sat, s[1], val, s[2]);
+    });
+    const double ref_ns = best_ns(1000, [&]() {
+      hsv_per_pixel(expected, n, 0, s[0], sat, s[1], val, s[2]);
+    });
+    TEST_ASSERT_TRUE(max_error(leds, expected, n) <= RAMP_MAX_ERROR);
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "steps %d/%d/%d over %u: ramp %.0f ns, per pixel %.0f ns",
+             s[0], s[1], s[2], n, ramp_ns, ref_ns);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(ramp_ns < ref_ns);
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_rainbow_matches_per_pixel);
+  RUN_TEST(test_rainbow_whole_hue_steps);
+  RUN_TEST(test_default_step_is_one_rainbow);
+  RUN_TEST(test_hsv_gradient_matches_per_pixel);
+  RUN_TEST(test_rgb_gradient_matches_lerp);
+  RUN_TEST(test_bench_60);
+  RUN_TEST(test_bench_1000);
+  RUN_TEST(test_bench_4000);
+  RUN_TEST(test_ramp_faster_at_threshold);
+  return UNITY_END();
+}
@@ -0,0 +1,127 @@
+"""
+Host tests of gen_html.py, run from the project root with:
+
+    python3 test/test_gen_html.py
+
+When a C++ compiler is around, the generated header is also compiled against
+the native stand-ins of the Arduino core (test/native).
+"""
+
+import gzip
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import unittest
+from pathlib import Path
+
+ROOT = Path(__file__).resolve().parent.parent
+sys.path.insert(0, str(ROOT))
+
+import gen_html  # noqa: E402
+
+ARRAY_RE = re.compile(r"PAGE_(\w+)\[\] PROGMEM = \{(.*?)\};", re.DOTALL)
+ENTRY_RE = re.compile(r'\{ "([^"]*)", "([^"]*)", "\\"(\w+)\\"", PAGE_(\w+), sizeof')
+
+
+class GenHtmlTest(unittest.TestCase):
+    def setUp(self):
+        self.dir = Path(tempfile.mkdtemp())
+
+    def tearDown(self):
+        shutil.rmtree(self.dir)
+
+    def write(self, name, content):
+        path = self.dir / name
+        if isinstance(content, str):
+            path.write_text(content)
+        else:
+            path.write_bytes(content)
+
+    def generate(self):
+        header = gen_html.generate(self.dir)
+        arrays = {name: bytes(int(b, 16) for b in re.findall(r"0x([0-9a-f]{2})", body))
+                  for name, body in ARRAY_RE.findall(header)}
+        pages = {}
+        for path, mime, etag, name in ENTRY_RE.findall(header):
+            pages[path] = {"mime": mime, "etag": etag, "content": gzip.decompress(arrays[name])}
+        return header, pages
+
+    def test_same_stem_gets_distinct_symbols(self):
+        self.write("main.html", "<p>main</p>")
+        self.write("main.css", "p { color: red; }")
+        self.write("main.js", "let a = 1;")
+
+        header, pages = self.generate()
+
+        self.assertEqual(sorted(pages), ["/", "/main.css", "/main.js"])
+        for symbol in ("PAGE_MAIN_HTML", "PAGE_MAIN_CSS", "PAGE_MAIN_JS"):
+            self.assertEqual(header.count("const uint8_t %s[]" % symbol), 1)
+        self.assertIn("#define HTML_PAGE_COUNT 3", header)
+
+    def test_clashing_symbols_are_rejected(self):
+        self.write("a-b.css", "")
+        self.write("a_b.css", "")
+
+        with self.assertRaises(ValueError):
+            gen_html.generate(self.dir)
+
+    def test_binary_asset_is_embedded_as_is(self):
+        favicon = bytes(range(256)) * 4
+        self.write("main.html", "<p>main</p>")
+        self.write("favicon.ico", favicon)
+        self.write("blob.bin", b"\xff\xfe\x00<!-- not a comment -->")
+
+        _, pages = self.generate()
+
+        self.assertEqual(pages["/favicon.ico"]["content"], favicon)
+        self.assertEqual(pages["/favicon.ico"]["mime"], "image/x-icon")
+        self.assertEqual(pages["/blob.bin"]["content"], b"\xff\xfe\x00<!-- not a comment -->")
+        self.assertEqual(pages["/blob.bin"]["mime"], "application/octet-stream")
+
+    def test_text_is_minified(self):
+        self.write("main.html", "<div>\n    <!-- comment -->\n    <p>x</p>\n\n<pre>  a\n\n  b</pre>\n</div>\n")
+
+        _, pages = self.generate()
+
+        self.assertEqual(pages["/"]["content"], b"<div>\n<p>x</p><pre>  a\n\n  b</pre></div>")
+        self.assertEqual(pages["/"]["mime"], "text/html")
+
+    def test_etag_is_stable_and_follows_content(self):
+        self.write("main.html", "<p>one</p>")
+        _, first = self.generate()
+        _, again = self.generate()
+        self.write("main.html", "<p>two</p>")
+        _, changed = self.generate()
+
+        self.assertEqual(first["/"]["etag"], again["/"]["etag"])
+        self.assertNotEqual(first["/"]["etag"], changed["/"]["etag"])
+
+    @unittest.skipIf(shutil.which("g++") is None, "no C++ compiler")
+    def test_header_compiles(self):
+        self.write("main.html", "<p>main</p>")
+        self.write("main.css", "p {}")
+        self.write("favicon.ico", bytes(range(16)))
+        header_path = self.dir / "html.h"
+        header_path.write_text(gen_html.generate(self.dir))
+
+        source = self.dir / "check.cpp"
+        source.write_text('#include "html.h"\nint main() { return HTML_PAGES[HTML_PAGE_COUNT - 1].length > 0 ? 0 : 1; }\n')
+        subprocess.run(["g++", "-std=gnu++17", "-fsyntax-only", "-I", str(ROOT / "test" / "native"), str(source)],
+                       check=True)
+
+    def test_project_pages(self):
+        # The pages actually shipped go through the generator fine.
+        _, pages = self.generate_from(ROOT / gen_html.HTML_DIR)
+        self.assertIn("/", pages)
+
+    def generate_from(self, html_dir):
+        for file_path in Path(html_dir).iterdir():
+            if file_path.is_file():
+                shutil.copy(file_path, self.dir / file_path.name)
+        return self.generate()
+
+
+if __name__ == "__main__":
+    unittest.main()
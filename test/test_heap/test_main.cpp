@@ -0,0 +1,193 @@
+#define NUM_LEDS 150
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <LittleFS.h>
+
+#include "NativeTest.h"
+#include "LedManager.h"
+
+// Frames rendered with every effect. Long enough for the effects that only
+// allocate once in a while (e.g. when a cycle ends) to get there.
+#define FRAMES_PER_EFFECT 2000
+
+// Called through pointers so that the compiler can't see the pairs of
+// allocations and frees and optimize them out.
+static void *(*volatile do_malloc)(size_t) = malloc;
+static void *(*volatile do_realloc)(void *, size_t) = realloc;
+static void (*volatile do_free)(void *) = free;
+
+struct Counts {
+  uint32_t allocs;
+  uint32_t frees;
+  uint32_t live;
+
+  static Counts now() {
+    const HeapTagStats &s = HeapTrack::get_stats(HeapTag::Other);
+    return { s.allocs, s.frees, HeapTrack::get_live_blocks() };
+  }
+};
+
+static void assert_delta(const Counts &before, uint32_t allocs, uint32_t frees, int32_t live) {
+  const Counts after = Counts::now();
+  TEST_ASSERT_EQUAL_UINT32(allocs, after.allocs - before.allocs);
+  TEST_ASSERT_EQUAL_UINT32(frees, after.frees - before.frees);
+  TEST_ASSERT_EQUAL_INT32(live, (int32_t)(after.live - before.live));
+}
+
+/**
+ * A short sequence for the "sequence" effect to play, so that it renders
+ * something rather than finding no file.
+ */
+static void write_sequence() {
+  SequenceWriter writer;
+  TEST_ASSERT_TRUE(writer.open(SEQUENCE_PATH, NUM_LEDS, 30));
+
+  CRGB frame[NUM_LEDS];
+  for (uint16_t f = 0; f < 30; f++) {
+    for (uint16_t i = 0; i < NUM_LEDS; i++) {
+      frame[i] = CHSV(f * 8 + i, 255, (i + f) % 4 == 0 ? 255 : 0);
+    }
+    TEST_ASSERT_TRUE(writer.write_frame(frame, 50));
+  }
+  TEST_ASSERT_TRUE(writer.close());
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_malloc_and_free() {
+  Counts before = Counts::now();
+  void *p = do_malloc(16);
+  assert_delta(before, 1, 0, 1);
+
+  before = Counts::now();
+  do_free(p);
+  do_free(nullptr);
+  assert_delta(before, 0, 1, -1);
+}
+
+void test_realloc() {
+  // From nothing, it's a malloc.
+  Counts before = Counts::now();
+  void *p = do_realloc(nullptr, 16);
+  TEST_ASSERT_NOT_NULL(p);
+  assert_delta(before, 1, 0, 1);
+
+  // Growing allocates the new block and frees the old one, wherever the
+  // result ends up.
+  before = Counts::now();
+  p = do_realloc(p, 4096);
+  TEST_ASSERT_NOT_NULL(p);
+  assert_delta(before, 1, 1, 0);
+
+  // Down to 0 only frees.
+  before = Counts::now();
+  p = do_realloc(p, 0);
+  assert_delta(before, 0, 1, -1);
+  do_free(p);
+}
+
+void test_realloc_failure_keeps_the_block() {
+  void *p = do_malloc(16);
+
+  const Counts before = Counts::now();
+  void *q = do_realloc(p, SIZE_MAX / 2);
+  TEST_ASSERT_NULL(q);
+  // Attempted, but the old block is still there.
+  assert_delta(before, 1, 0, 0);
+
+  do_free(p);
+}
+
+void test_tags_and_live_blocks() {
+  void *p;
+  {
+    HeapScope scope(HeapTag::Web);
+    p = do_malloc(32);
+  }
+  const uint32_t web_frees = HeapTrack::get_stats(HeapTag::Web).frees;
+  const uint32_t live = HeapTrack::get_live_blocks();
+
+  // Freed under another tag: that's the one it's counted against, the live
+  // count is what shows it's gone.
+  do_free(p);
+  TEST_ASSERT_EQUAL_UINT32(web_frees, HeapTrack::get_stats(HeapTag::Web).frees);
+  TEST_ASSERT_EQUAL_UINT32(live - 1, HeapTrack::get_live_blocks());
+}
+
+// The check below relies on this: allocating while rendering is caught.
+void test_render_allocation_is_a_violation() {
+  HeapTrack::arm_steady_state();
+  {
+    HeapScope scope(HeapTag::Render);
+    do_free(do_malloc(8));
+    // operator new too (see NativeTest.h).
+    int *volatile p = new int(1);
+    delete p;
+  }
+  TEST_ASSERT_EQUAL_UINT32(2, HeapTrack::get_violations());
+}
+
+void test_rendering_does_not_allocate() {
+  LittleFS.format();
+  write_sequence();
+  native_micros = 0;
+
+  LedManager manager;
+  manager.begin();
+  HeapTrack::arm_steady_state();
+
+  for (int8_t effect = 0; effect < AnimEffect::EffectCount; effect++) {
+    if (!effect_available(effect)) continue;
+    // Switching effects allocates the new one, which is fine.
+    TEST_ASSERT_TRUE(manager.set_effect(effect));
+    const uint32_t render_allocs = HeapTrack::get_stats(HeapTag::Render).allocs;
+    const uint32_t shows = FastLED.show_count;
+
+    for (uint32_t i = 0; i < FRAMES_PER_EFFECT; i++) {
+      // A few loop iterations per frame, as on the device.
+      native_advance_us(FRAME_INTERVAL_MS * 1000 / 4);
+      manager.click();
+      manager.handle();
+    }
+
+    char msg[64];
+    snprintf(msg, sizeof(msg), "%s allocated while rendering", manager.get_animation()->name());
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(render_allocs, HeapTrack::get_stats(HeapTag::Render).allocs, msg);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, HeapTrack::get_violations(), msg);
+    // Frames were actually rendered.
+    TEST_ASSERT_TRUE(FastLED.show_count - shows >= FRAMES_PER_EFFECT / 4);
+  }
+}
+
+// The strip is a single row: Wave2D would only be Wave again.
+void test_rotation_skips_unavailable_effects() {
+  TEST_ASSERT_FALSE(effect_available(AnimEffect::Wave2D));
+
+  LedManager manager;
+  manager.begin();
+  TEST_ASSERT_FALSE(manager.set_effect(AnimEffect::Wave2D));
+
+  // Back to Solid, having gone through all the others.
+  uint8_t shown = 0;
+  do {
+    manager.next_effect();
+    TEST_ASSERT_NOT_EQUAL(AnimEffect::Wave2D, manager.get_effect());
+    shown++;
+  } while (manager.get_effect() != AnimEffect::Solid && shown <= AnimEffect::EffectCount);
+  TEST_ASSERT_EQUAL_UINT8(AnimEffect::EffectCount - 1, shown);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_malloc_and_free);
+  RUN_TEST(test_realloc);
+  RUN_TEST(test_realloc_failure_keeps_the_block);
+  RUN_TEST(test_tags_and_live_blocks);
+  RUN_TEST(test_render_allocation_is_a_violation);
+  RUN_TEST(test_rendering_does_not_allocate);
+  RUN_TEST(test_rotation_skips_unavailable_effects);
+  return UNITY_END();
+}
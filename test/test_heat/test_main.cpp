@@ -0,0 +1,142 @@
+#define NUM_LEDS 1000
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+#include "NativeTest.h"
+#include "LedAnim.h"
+
+// Longest simulation the scaling benchmark runs.
+#define MAX_CELLS 8000
+
+static CRGB leds[NUM_LEDS];
+static LedControl control(leds);
+
+// Exposes the simulation step of a heat effect.
+template <typename Anim>
+class Sim : public Anim {
+public:
+  using Anim::step;
+
+  explicit Sim(uint32_t seed) {
+    Anim::begin(&control);
+    Anim::set_param("seed", seed);
+  }
+};
+
+static uint16_t cells_a[MAX_CELLS];
+static uint16_t cells_b[MAX_CELLS];
+
+template <typename Anim>
+static void run(Sim<Anim> &sim, uint16_t *cells, uint16_t count, uint16_t steps) {
+  std::fill_n(cells, count, 0);
+  for (uint16_t s = 0; s < steps; s++) {
+    sim.step(cells, count);
+  }
+}
+
+template <typename Anim>
+static void check_deterministic() {
+  Sim<Anim> a(1234), b(1234), c(4321);
+
+  run(a, cells_a, NUM_LEDS, 500);
+  run(b, cells_b, NUM_LEDS, 500);
+  TEST_ASSERT_EQUAL_MEMORY(cells_a, cells_b, NUM_LEDS * sizeof(uint16_t));
+
+  // There's something going on at all, and it depends on the seed.
+  TEST_ASSERT_TRUE(*std::max_element(cells_a, cells_a + NUM_LEDS) > 0);
+  run(c, cells_b, NUM_LEDS, 500);
+  TEST_ASSERT_TRUE(memcmp(cells_a, cells_b, NUM_LEDS * sizeof(uint16_t)) != 0);
+
+  // Reseeding restarts the same simulation.
+  a.set_param("seed", 4321);
+  run(a, cells_a, NUM_LEDS, 500);
+  TEST_ASSERT_EQUAL_MEMORY(cells_a, cells_b, NUM_LEDS * sizeof(uint16_t));
+}
+
+/**
+ * Time of one step over `count` cells, best of a few runs so that a busy
+ * host doesn't make it look worse than it is.
+ */
+template <typename Anim>
+static double step_ns(Sim<Anim> &sim, uint16_t count) {
+  double best = 1e12;
+  for (uint8_t run = 0; run < 5; run++) {
+    best = std::min(best, bench_ns(200, [&]() {
+      sim.step(cells_a, count);
+    }));
+  }
+  return best;
+}
+
+template <typename Anim>
+static void check_scaling(const char *name) {
+  static const uint16_t counts[] = { 250, 1000, 4000, MAX_CELLS };
+  Sim<Anim> sim(1);
+  char label[48];
+  double per_cell[4];
+
+  run(sim, cells_a, MAX_CELLS, 100);
+  const uint32_t allocs = total_allocs();
+  for (uint8_t i = 0; i < 4; i++) {
+    const double ns = step_ns(sim, counts[i]);
+    per_cell[i] = ns / counts[i];
+
+    snprintf(label, sizeof(label), "%s step x%u", name, counts[i]);
+    bench_report(label, ns, "step");
+
+    if (counts[i] == 1000) {
+      // The fastest presets run 4 steps a frame.
+      TEST_ASSERT_TRUE(ns < NATIVE_FRAME_BUDGET_NS / 8 / NATIVE_HOST_SPEEDUP);
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(allocs, total_allocs());
+
+  // Linear: the time per cell doesn't grow with the number of cells.
+  for (uint8_t i = 1; i < 4; i++) {
+    TEST_ASSERT_TRUE(per_cell[i] < 2 * per_cell[0]);
+  }
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_fire_is_deterministic() {
+  check_deterministic<FireAnim>();
+}
+
+void test_diffusion_is_deterministic() {
+  check_deterministic<DiffusionAnim>();
+}
+
+void test_short_strips() {
+  Sim<FireAnim> fire(1);
+  Sim<DiffusionAnim> diffusion(1);
+
+  for (uint16_t count = 1; count <= 8; count++) {
+    cells_a[count] = 0xBEEF;
+    run(fire, cells_a, count, 200);
+    run(diffusion, cells_a, count, 200);
+    // Nothing past the end is touched.
+    TEST_ASSERT_EQUAL_UINT16(0xBEEF, cells_a[count]);
+  }
+}
+
+void test_fire_scales_linearly() {
+  check_scaling<FireAnim>("fire");
+}
+
+void test_diffusion_scales_linearly() {
+  check_scaling<DiffusionAnim>("diffusion");
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_fire_is_deterministic);
+  RUN_TEST(test_diffusion_is_deterministic);
+  RUN_TEST(test_short_strips);
+  RUN_TEST(test_fire_scales_linearly);
+  RUN_TEST(test_diffusion_scales_linearly);
+  return UNITY_END();
+}
@@ -0,0 +1,269 @@
+// The largest panel the benchmarks cover, rotated and serpentine so that
+// XY() has the most work to undo.
+#define NUM_LEDS 4096
+#define MATRIX_WIDTH 64
+#define MATRIX_HEIGHT 64
+#define MATRIX_SERPENTINE 1
+#define MATRIX_ROTATION 90
+// Drawing keeps both buffers in sync.
+#define LED_HIGH_BIT_DEPTH
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+#include "NativeTest.h"
+#include "LedControl.h"
+
+// Leds past the end of the strip, which must never be written to.
+#define GUARD_LEDS 16
+
+static CRGB leds[NUM_LEDS + GUARD_LEDS];
+static LedControl control(leds);
+
+static const uint16_t SIZES[][2] = {
+  { 1, 1 }, { 1, 7 }, { 7, 1 }, { 4, 3 }, { 5, 8 }, { 16, 16 },
+};
+
+static const uint16_t ROTATIONS[] = { 0, 90, 180, 270 };
+
+static uint16_t cols_of(const MatrixLayout &layout) {
+  return layout.rotation % 180 == 0 ? layout.width : layout.height;
+}
+
+static uint16_t rows_of(const MatrixLayout &layout) {
+  return layout.rotation % 180 == 0 ? layout.height : layout.width;
+}
+
+static void clear() {
+  std::fill_n(leds, NUM_LEDS + GUARD_LEDS, CRGB::Black);
+}
+
+// Number of lit pixels, checking that only the ones `inside` are lit and that
+// the guard past the strip is intact.
+template <typename Inside>
+static uint32_t count_lit(Inside inside) {
+  uint32_t lit = 0;
+  for (int16_t y = 0; y < MATRIX_ROWS; y++) {
+    for (int16_t x = 0; x < MATRIX_COLS; x++) {
+      if (leds[XY(x, y)]) {
+        TEST_ASSERT_TRUE(inside(x, y));
+        lit++;
+      }
+    }
+  }
+  for (uint16_t i = NUM_LEDS; i < NUM_LEDS + GUARD_LEDS; i++) {
+    TEST_ASSERT_FALSE(leds[i]);
+  }
+  return lit;
+}
+
+void setUp() {
+  clear();
+}
+
+void tearDown() {}
+
+// Every pixel of every layout maps to its own led.
+void test_layouts_are_bijective() {
+  for (const auto &size : SIZES) {
+    for (uint8_t serpentine = 0; serpentine < 2; serpentine++) {
+      for (uint16_t rotation : ROTATIONS) {
+        const MatrixLayout layout = { size[0], size[1], serpentine != 0, rotation };
+        std::vector<bool> seen(size[0] * size[1], false);
+
+        for (uint16_t y = 0; y < rows_of(layout); y++) {
+          for (uint16_t x = 0; x < cols_of(layout); x++) {
+            const uint16_t i = matrix_index(layout, x, y);
+            TEST_ASSERT_TRUE(i < seen.size());
+            TEST_ASSERT_FALSE(seen[i]);
+            seen[i] = true;
+          }
+        }
+      }
+    }
+  }
+}
+
+// A 4x3 panel wired from its top left corner, looked at in every
+// orientation:
+//
+//    0  1  2  3        0  1  2  3  (serpentine)
+//    4  5  6  7        7  6  5  4
+//    8  9 10 11        8  9 10 11
+void test_layout_corners() {
+  struct Case { bool serpentine; uint16_t rotation; uint16_t top_left, top_right, bottom_left, bottom_right; };
+  static const Case cases[] = {
+    { false, 0,   0,  3,  8, 11 },
+    { false, 90,  8,  0, 11,  3 },
+    { false, 180, 11, 8,  3,  0 },
+    { false, 270, 3, 11,  0,  8 },
+    { true,  0,   0,  3,  8, 11 },
+    { true,  90,  8,  0, 11,  3 },
+  };
+
+  for (const Case &c : cases) {
+    const MatrixLayout layout = { 4, 3, c.serpentine, c.rotation };
+    const uint16_t right = cols_of(layout) - 1, bottom = rows_of(layout) - 1;
+    TEST_ASSERT_EQUAL_UINT16(c.top_left, matrix_index(layout, 0, 0));
+    TEST_ASSERT_EQUAL_UINT16(c.top_right, matrix_index(layout, right, 0));
+    TEST_ASSERT_EQUAL_UINT16(c.bottom_left, matrix_index(layout, 0, bottom));
+    TEST_ASSERT_EQUAL_UINT16(c.bottom_right, matrix_index(layout, right, bottom));
+  }
+
+  // Odd rows run backwards.
+  const MatrixLayout serpentine = { 4, 3, true, 0 };
+  TEST_ASSERT_EQUAL_UINT16(7, matrix_index(serpentine, 0, 1));
+  TEST_ASSERT_EQUAL_UINT16(4, matrix_index(serpentine, 3, 1));
+}
+
+void test_xy_matches_layout() {
+  TEST_ASSERT_EQUAL_UINT16(64, MATRIX_COLS);
+  TEST_ASSERT_EQUAL_UINT16(64, MATRIX_ROWS);
+
+  for (uint16_t y = 0; y < MATRIX_ROWS; y++) {
+    for (uint16_t x = 0; x < MATRIX_COLS; x++) {
+      TEST_ASSERT_EQUAL_UINT16(matrix_index(MATRIX_LAYOUT, x, y), XY(x, y));
+    }
+  }
+}
+
+void test_set_xy_clips() {
+  static const int16_t outside[][2] = {
+    { -1, 0 }, { 0, -1 }, { MATRIX_COLS, 0 }, { 0, MATRIX_ROWS },
+    { INT16_MIN, INT16_MIN }, { INT16_MAX, INT16_MAX }, { 5, INT16_MAX },
+  };
+  for (const auto &p : outside) {
+    control.set_xy(p[0], p[1], CRGB::Red);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, count_lit([](int16_t, int16_t) { return false; }));
+
+  control.set_xy(MATRIX_COLS - 1, MATRIX_ROWS - 1, CRGB::Red);
+  TEST_ASSERT_EQUAL_UINT32(1, count_lit([](int16_t x, int16_t y) {
+    return x == MATRIX_COLS - 1 && y == MATRIX_ROWS - 1;
+  }));
+}
+
+void test_fill_rect_clips() {
+  // Sticking out of the top left corner.
+  control.fill_rect(-2, -3, 5, 6, CRGB::Red);
+  TEST_ASSERT_EQUAL_UINT32(9, count_lit([](int16_t x, int16_t y) { return x < 3 && y < 3; }));
+
+  // Out of the bottom right one, sized so that the far edge overflows an
+  // int16_t.
+  clear();
+  control.fill_rect(60, 50, INT16_MAX, INT16_MAX, CRGB::Red);
+  TEST_ASSERT_EQUAL_UINT32(4 * 14, count_lit([](int16_t x, int16_t y) { return x >= 60 && y >= 50; }));
+
+  // Outside, empty or negative.
+  clear();
+  control.fill_rect(MATRIX_COLS, 0, 10, 10, CRGB::Red);
+  control.fill_rect(-10, -10, 10, 10, CRGB::Red);
+  control.fill_rect(5, 5, 0, 10, CRGB::Red);
+  control.fill_rect(5, 5, -3, -3, CRGB::Red);
+  TEST_ASSERT_EQUAL_UINT32(0, count_lit([](int16_t, int16_t) { return false; }));
+
+  control.fill_rect(INT16_MIN, INT16_MIN, INT16_MAX, INT16_MAX, CRGB::Red);
+  TEST_ASSERT_EQUAL_UINT32(0, count_lit([](int16_t, int16_t) { return false; }));
+
+  // The whole matrix.
+  control.fill_rect(-1, -1, MATRIX_COLS + 2, MATRIX_ROWS + 2, CRGB::Red);
+  TEST_ASSERT_EQUAL_UINT32(NUM_LEDS, count_lit([](int16_t, int16_t) { return true; }));
+}
+
+void test_draw_line_clips() {
+  // Diagonal through the whole matrix, both ends outside.
+  control.draw_line(-10, -10, MATRIX_COLS + 10, MATRIX_ROWS + 10, CRGB::Red);
+  TEST_ASSERT_EQUAL_UINT32(MATRIX_COLS, count_lit([](int16_t x, int16_t y) { return x == y; }));
+
+  // Ends as far apart as they get.
+  clear();
+  control.draw_line(INT16_MIN, 5, INT16_MAX, 5, CRGB::Red);
+  TEST_ASSERT_EQUAL_UINT32(MATRIX_COLS, count_lit([](int16_t x, int16_t y) { return y == 5; }));
+
+  clear();
+  control.draw_line(7, INT16_MAX, 7, INT16_MIN, CRGB::Red);
+  TEST_ASSERT_EQUAL_UINT32(MATRIX_ROWS, count_lit([](int16_t x, int16_t y) { return x == 7; }));
+
+  // Entirely outside.
+  clear();
+  control.draw_line(-1, 0, -1, MATRIX_ROWS - 1, CRGB::Red);
+  control.draw_line(0, MATRIX_ROWS, MATRIX_COLS, MATRIX_ROWS + 40, CRGB::Red);
+  TEST_ASSERT_EQUAL_UINT32(0, count_lit([](int16_t, int16_t) { return false; }));
+
+  // A single point, and a line drawn backwards.
+  control.draw_line(3, 4, 3, 4, CRGB::Red);
+  control.draw_line(12, 10, 10, 10, CRGB::Red);
+  TEST_ASSERT_EQUAL_UINT32(4, count_lit([](int16_t x, int16_t y) {
+    return (x == 3 && y == 4) || (y == 10 && x >= 10 && x <= 12);
+  }));
+}
+
+// What high bit depth animations and the dithering read, see LedControl.h.
+void test_drawing_syncs_hd() {
+  control.fill_solid(CRGB::Black);
+
+  control.set_xy(1, 2, CRGB(10, 20, 30));
+  control.fill_rect(-3, 20, 10, 5, CRGB(200, 1, 99));
+  control.draw_line(0, MATRIX_ROWS - 1, MATRIX_COLS - 1, 0, CRGB(7, 250, 3));
+  control.draw_line(40, -5, 40, 70, CRGB::White);
+
+  uint32_t lit = 0;
+  for (uint16_t i = 0; i < NUM_LEDS; i++) {
+    TEST_ASSERT_TRUE(control.leds16[i] == CRGB16(leds[i]));
+    lit += (bool)leds[i];
+  }
+  // The two lines cross at (40, 23).
+  TEST_ASSERT_EQUAL_UINT32(1 + 7 * 5 + MATRIX_COLS + MATRIX_ROWS - 1, lit);
+}
+
+static void bench_fill(const char *name, uint16_t size) {
+  char label[48];
+  uint8_t hue = 0;
+
+  const uint32_t allocs = total_allocs();
+  const double ns = bench_ns(2000, [&]() {
+    control.fill_rect(0, 0, size, size, CHSV(hue++, 255, 255));
+  });
+  snprintf(label, sizeof(label), "%s fill_rect", name);
+  bench_report(label, ns, "fill");
+
+  const double set_ns = bench_ns(2000, [&]() {
+    const CRGB color = CHSV(hue++, 255, 255);
+    for (int16_t y = 0; y < size; y++) {
+      for (int16_t x = 0; x < size; x++) {
+        control.set_xy(x, y, color);
+      }
+    }
+  });
+  snprintf(label, sizeof(label), "%s set_xy", name);
+  bench_report(label, set_ns, "fill");
+
+  TEST_ASSERT_EQUAL_UINT32(allocs, total_allocs());
+  // Filling the panel is a small part of a frame.
+  TEST_ASSERT_TRUE(ns < (double)NATIVE_FRAME_BUDGET_NS / 4 / NATIVE_HOST_SPEEDUP * size * size / NUM_LEDS);
+}
+
+void test_bench_fill() {
+  bench_fill("32x32", 32);
+  bench_fill("64x64", 64);
+
+  // The strip order, for comparison.
+  uint8_t hue = 0;
+  const double ns = bench_ns(2000, [&]() {
+    control.fill_solid(CHSV(hue++, 255, 255));
+  });
+  bench_report("64x64 fill_solid", ns, "fill");
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_layouts_are_bijective);
+  RUN_TEST(test_layout_corners);
+  RUN_TEST(test_xy_matches_layout);
+  RUN_TEST(test_set_xy_clips);
+  RUN_TEST(test_fill_rect_clips);
+  RUN_TEST(test_draw_line_clips);
+  RUN_TEST(test_drawing_syncs_hd);
+  RUN_TEST(test_bench_fill);
+  return UNITY_END();
+}
@@ -0,0 +1,131 @@
+#define NUM_LEDS 1000
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+#include "NativeTest.h"
+#include "LedParticles.h"
+
+#define POOL_CAPACITY 1024
+
+static ParticlePool<POOL_CAPACITY> pool;
+static CRGB leds[NUM_LEDS];
+
+void setUp() {
+  pool.clear();
+  std::fill_n(leds, NUM_LEDS, CRGB::Black);
+}
+
+void tearDown() {}
+
+void test_spawn_until_full() {
+  for (uint16_t i = 0; i < POOL_CAPACITY; i++) {
+    TEST_ASSERT_TRUE(pool.spawn(i * PARTICLE_ONE, 0, CRGB::Red, 1));
+  }
+  TEST_ASSERT_TRUE(pool.full());
+  TEST_ASSERT_FALSE(pool.spawn(0, 0, CRGB::Red, 1));
+  TEST_ASSERT_EQUAL_UINT16(POOL_CAPACITY, pool.size());
+}
+
+void test_update_recycles() {
+  // Fades out on the second frame.
+  pool.spawn(10 * PARTICLE_ONE, 0, CRGB::Red, 128);
+  // Leaves the strip on the first frame, either way.
+  pool.spawn(0, -2 * PARTICLE_ONE, CRGB::Lime, 0);
+  pool.spawn((NUM_LEDS - 1) * PARTICLE_ONE, 2 * PARTICLE_ONE, CRGB::Blue, 0);
+  // Pulled back off the strip by gravity.
+  pool.spawn(2 * PARTICLE_ONE, PARTICLE_ONE, CRGB::White, 0);
+
+  pool.update(NUM_LEDS, -PARTICLE_ONE);
+  TEST_ASSERT_EQUAL_UINT16(2, pool.size());
+
+  pool.update(NUM_LEDS, -PARTICLE_ONE);
+  TEST_ASSERT_EQUAL_UINT16(1, pool.size());
+  TEST_ASSERT_TRUE(pool.color(0) == CRGB(CRGB::White));
+
+  pool.update(NUM_LEDS, -PARTICLE_ONE);
+  TEST_ASSERT_EQUAL_UINT16(0, pool.size());
+}
+
+void test_splat_splits_between_pixels() {
+  pool.spawn(10 * PARTICLE_ONE + PARTICLE_ONE / 4, 0, CRGB(200, 100, 0), 0);
+  pool.splat(leds, NUM_LEDS);
+
+  TEST_ASSERT_UINT32_WITHIN(1, 150, leds[10].r);
+  TEST_ASSERT_UINT32_WITHIN(1, 50, leds[11].r);
+  TEST_ASSERT_UINT32_WITHIN(1, 75, leds[10].g);
+  TEST_ASSERT_UINT32_WITHIN(1, 25, leds[11].g);
+  TEST_ASSERT_FALSE(leds[9]);
+  TEST_ASSERT_FALSE(leds[12]);
+
+  // Half off either end of the strip.
+  pool.clear();
+  std::fill_n(leds, NUM_LEDS, CRGB::Black);
+  pool.spawn(-PARTICLE_ONE / 2, 0, CRGB::White, 0);
+  pool.spawn((NUM_LEDS - 1) * PARTICLE_ONE + PARTICLE_ONE / 2, 0, CRGB::White, 0);
+  pool.splat(leds, NUM_LEDS);
+  TEST_ASSERT_UINT32_WITHIN(1, 128, leds[0].r);
+  TEST_ASSERT_UINT32_WITHIN(1, 128, leds[NUM_LEDS - 1].r);
+}
+
+/**
+ * Fills the pool with `count` slow particles spread over the strip, slow
+ * and bright enough that they're all still alive after the benchmark.
+ */
+static void spawn_particles(uint16_t count) {
+  pool.clear();
+  random16_set_seed(count);
+  for (uint16_t i = 0; i < count; i++) {
+    const int32_t pos = (int32_t)(100 + random16() % (NUM_LEDS - 200)) * PARTICLE_ONE + random8();
+    const int16_t vel = (int16_t)(random8() % 7) - 3;
+    pool.spawn(pos, vel, CHSV(random8(), 255, 255), 0);
+  }
+}
+
+static void bench_particles(uint16_t count) {
+  char label[48];
+  spawn_particles(count);
+
+  const uint32_t allocs = total_allocs();
+  const double update_ns = bench_ns(2000, []() {
+    pool.update(NUM_LEDS);
+  });
+  const double splat_ns = bench_ns(2000, []() {
+    pool.splat(leds, NUM_LEDS);
+  });
+
+  TEST_ASSERT_EQUAL_UINT16(count, pool.size());
+  TEST_ASSERT_EQUAL_UINT32(allocs, total_allocs());
+
+  snprintf(label, sizeof(label), "update x%u", count);
+  bench_report(label, update_ns / count, "particle");
+  snprintf(label, sizeof(label), "splat x%u", count);
+  bench_report(label, splat_ns / count, "particle");
+
+  // Both passes together are a small part of a frame, even with the pool
+  // full.
+  TEST_ASSERT_TRUE(update_ns + splat_ns < (double)NATIVE_FRAME_BUDGET_NS / 4 / NATIVE_HOST_SPEEDUP * count / POOL_CAPACITY);
+}
+
+void test_bench_64() {
+  bench_particles(64);
+}
+
+void test_bench_256() {
+  bench_particles(256);
+}
+
+void test_bench_1024() {
+  bench_particles(1024);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_spawn_until_full);
+  RUN_TEST(test_update_recycles);
+  RUN_TEST(test_splat_splits_between_pixels);
+  RUN_TEST(test_bench_64);
+  RUN_TEST(test_bench_256);
+  RUN_TEST(test_bench_1024);
+  return UNITY_END();
+}
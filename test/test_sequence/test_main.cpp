@@ -0,0 +1,178 @@
+#include <Arduino.h>
+#include <FastLED.h>
+#include <LittleFS.h>
+
+#include "NativeTest.h"
+#include "LedSequence.h"
+
+#define BENCH_PATH "/bench.lbs"
+#define BENCH_FRAMES 64
+
+enum class Content : uint8_t { Black, Solid, Gradient, Sparse, Noise };
+
+static const char *content_name(Content content) {
+  static const char *names[] = { "black", "solid", "gradient", "sparse", "noise" };
+  return names[(uint8_t)content];
+}
+
+// Frame `frame` of a test pattern that moves a little from one frame to the
+// next, the way animations do.
+static void make_frame(Content content, uint16_t frame, CRGB *leds, uint16_t led_count) {
+  random16_set_seed(frame);
+
+  for (uint16_t i = 0; i < led_count; i++) {
+    switch (content) {
+      case Content::Black:
+        leds[i] = CRGB::Black;
+        break;
+      case Content::Solid:
+        leds[i] = CHSV(frame, 255, 255);
+        break;
+      case Content::Gradient:
+        leds[i] = CHSV(frame + i, 255, 255);
+        break;
+      case Content::Sparse:
+        leds[i] = (i + frame) % 16 == 0 ? CRGB(CHSV(i, 200, 255)) : CRGB(CRGB::Black);
+        break;
+      case Content::Noise:
+        leds[i] = CRGB(random8(), random8(), random8());
+        break;
+    }
+  }
+}
+
+// As keyframes, or as delta frames after the first one.
+static void write_sequence(Content content, uint16_t led_count, bool delta = false) {
+  std::vector<CRGB> leds(led_count);
+  std::vector<CRGB> previous(led_count);
+  SequenceWriter writer;
+
+  TEST_ASSERT_TRUE(writer.open(BENCH_PATH, led_count, BENCH_FRAMES));
+  for (uint16_t f = 0; f < BENCH_FRAMES; f++) {
+    make_frame(content, f, leds.data(), led_count);
+    TEST_ASSERT_TRUE(writer.write_frame(leds.data(), 16, delta ? previous.data() : nullptr));
+    previous = leds;
+  }
+  TEST_ASSERT_TRUE(writer.close());
+}
+
+// Decodes the whole sequence in a loop and reports how fast it went.
+static void bench_sequence(const char *name, uint16_t led_count) {
+  std::vector<CRGB> leds(led_count);
+  SequenceReader reader;
+  TEST_ASSERT_TRUE(reader.open(BENCH_PATH));
+
+  const uint32_t frames = reader.get_frame_count();
+  const uint32_t iterations = std::max(frames, (uint32_t)2000);
+  const uint32_t allocs = total_allocs();
+
+  const double ns = bench_ns(iterations, [&]() {
+    reader.next_frame(leds.data(), led_count);
+  });
+
+  TEST_ASSERT_EQUAL_UINT32(allocs, total_allocs());
+
+  File file = LittleFS.open(BENCH_PATH, "r");
+  const double bytes_per_frame = (double)(file.size() - SEQUENCE_HEADER_BYTES) / frames;
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "%s, %u leds: %.0f frames/s, %.1f bytes/frame (raw %u), %.2f ns/led",
+           name, led_count, 1e9 / ns, bytes_per_frame, led_count * 3, ns / led_count);
+  TEST_MESSAGE(msg);
+
+  // Decoding may take up to a quarter of a frame.
+  TEST_ASSERT_LESS_THAN(NATIVE_FRAME_BUDGET_NS / 4 / NATIVE_HOST_SPEEDUP, ns);
+}
+
+void setUp() {
+  LittleFS.format();
+}
+
+void tearDown() {}
+
+void test_round_trip() {
+  const uint16_t led_count = 150;
+  std::vector<CRGB> expected(led_count);
+  std::vector<CRGB> decoded(led_count);
+
+  for (uint8_t c = 0; c <= 2 * (uint8_t)Content::Noise + 1; c++) {
+    const Content content = (Content)(c / 2);
+    write_sequence(content, led_count, c % 2);
+
+    SequenceReader reader;
+    TEST_ASSERT_TRUE(reader.open(BENCH_PATH));
+    TEST_ASSERT_EQUAL_UINT16(led_count, reader.get_led_count());
+    TEST_ASSERT_EQUAL_UINT32(BENCH_FRAMES, reader.get_frame_count());
+
+    // Twice over, to go through the loop back to the first frame.
+    for (uint16_t f = 0; f < 2 * BENCH_FRAMES; f++) {
+      make_frame(content, f % BENCH_FRAMES, expected.data(), led_count);
+      TEST_ASSERT_EQUAL_UINT16(16, reader.next_frame(decoded.data(), led_count));
+      TEST_ASSERT_EQUAL_MEMORY_MESSAGE(expected.data(), decoded.data(), led_count * sizeof(CRGB),
+                                       content_name(content));
+    }
+  }
+}
+
+void test_truncated_file() {
+  const uint16_t led_count = 60;
+  write_sequence(Content::Noise, led_count);
+
+  // Keep the header and half of the first frame.
+  File full = LittleFS.open(BENCH_PATH, "r");
+  std::vector<uint8_t> data(SEQUENCE_HEADER_BYTES + 3 + led_count * 3 / 2);
+  full.read(data.data(), data.size());
+  full.close();
+  LittleFS.open(BENCH_PATH, "w").write(data.data(), data.size());
+
+  std::vector<CRGB> leds(led_count);
+  SequenceReader reader;
+  TEST_ASSERT_TRUE(reader.open(BENCH_PATH));
+  TEST_ASSERT_EQUAL_UINT16(0, reader.next_frame(leds.data(), led_count));
+}
+
+void test_bench_decode() {
+  const uint16_t led_counts[] = { 60, 300, 1000 };
+
+  for (uint16_t led_count : led_counts) {
+    for (uint8_t c = 0; c <= (uint8_t)Content::Noise; c++) {
+      write_sequence((Content)c, led_count);
+      bench_sequence(content_name((Content)c), led_count);
+    }
+  }
+}
+
+// Benchmarks a sequence encoded elsewhere (e.g. by tools/seq_encode.py):
+//   SEQUENCE_BENCH_FILE=show.lbs pio test -e native -f test_sequence
+void test_bench_file() {
+  const char *path = getenv("SEQUENCE_BENCH_FILE");
+  if (path == nullptr) {
+    TEST_IGNORE_MESSAGE("Set SEQUENCE_BENCH_FILE to benchmark a sequence file");
+  }
+
+  FILE *f = fopen(path, "rb");
+  TEST_ASSERT_NOT_NULL(f);
+  std::vector<uint8_t> data;
+  uint8_t buf[4096];
+  for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) {
+    data.insert(data.end(), buf, buf + n);
+  }
+  fclose(f);
+  LittleFS.open(BENCH_PATH, "w").write(data.data(), data.size());
+
+  SequenceReader probe;
+  TEST_ASSERT_TRUE(probe.open(BENCH_PATH));
+  const uint16_t led_count = probe.get_led_count();
+  probe.close();
+
+  bench_sequence(path, led_count);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_truncated_file);
+  RUN_TEST(test_bench_decode);
+  RUN_TEST(test_bench_file);
+  return UNITY_END();
+}
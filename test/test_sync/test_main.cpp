@@ -0,0 +1,201 @@
+#define NUM_LEDS 60
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+#include "NativeTest.h"
+#include "LedSync.h"
+
+// The leader's clock reads this much more than the follower's: it has been
+// up for longer.
+#define LEADER_AHEAD_US (3600LL * 1000000)
+// From the leader sending a beacon to the follower reading it.
+#define NETWORK_LATENCY_US 3000
+
+/**
+ * Two ledboxes in one program, talking over the loopback in WiFiUdp.h. The
+ * follower runs on `sync_clock`, like the firmware; the leader on a clock of
+ * its own. Both render from GET_MILLIS(), the follower's clock, so once the
+ * follower has caught up they draw the same frames.
+ */
+static LedManager leader_mgr;
+static LedManager follower_mgr;
+static SyncClock leader_clock;
+static LedSync<SYNC_LEADER> leader;
+static LedSync<SYNC_FOLLOWER> follower;
+
+// Listens to the group like a follower, and sends made up beacons.
+static WiFiUDP sniffer;
+
+static void run_ms(uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    native_advance_us(1000);
+    leader_mgr.handle();
+    follower_mgr.handle();
+    leader.handle();
+    follower.handle();
+  }
+}
+
+// Error of the follower's clock, against the leader's.
+static int64_t clock_error_us() {
+  return (int64_t)(sync_clock.now_us() - leader_clock.now_us());
+}
+
+static uint8_t save_state(LedManager &mgr, uint8_t *buf) {
+  return mgr.get_animation()->save_sync_state(buf, SYNC_MAX_STATE_BYTES);
+}
+
+static void assert_followed() {
+  TEST_ASSERT_EQUAL_INT(leader_mgr.get_effect(), follower_mgr.get_effect());
+
+  uint8_t leader_state[SYNC_MAX_STATE_BYTES];
+  uint8_t follower_state[SYNC_MAX_STATE_BYTES];
+  const uint8_t len = save_state(leader_mgr, leader_state);
+  TEST_ASSERT_EQUAL_UINT8(len, save_state(follower_mgr, follower_state));
+  TEST_ASSERT_EQUAL_MEMORY(leader_state, follower_state, len);
+
+  TEST_ASSERT_TRUE(sync_clock.get_estimator()->is_locked());
+  // Beacons always arrive late by the latency, and that can't be told apart
+  // from an offset.
+  TEST_ASSERT_INT64_WITHIN(1000, -NETWORK_LATENCY_US, clock_error_us());
+
+  TEST_ASSERT_EQUAL_MEMORY(leader_mgr.get_control()->leds, follower_mgr.get_control()->leds,
+                           sizeof(CRGB) * NUM_LEDS);
+}
+
+static void send_raw(const void *data, size_t len) {
+  sniffer.beginPacketMulticast(SYNC_MULTICAST_ADDRESS, SYNC_PORT, WiFi.localIP());
+  sniffer.write((const uint8_t *)data, len);
+  sniffer.endPacket();
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+// Field by field, as it goes on the wire.
+void test_beacon_encoding() {
+  leader_mgr.set_effect(AnimEffect::Solid);
+  leader_mgr.click();
+
+  SyncBeacon beacon;
+  const size_t len = sync_beacon_encode(beacon, 0x01020304, AnimEffect::Solid, leader_mgr.get_animation());
+  beacon.leader_us = 0x1122334455667788ULL;
+  TEST_ASSERT_EQUAL_UINT32(SYNC_BEACON_HEADER_BYTES + 1, len);
+  TEST_ASSERT_EQUAL_UINT32(20, SYNC_BEACON_HEADER_BYTES);
+
+  static const uint8_t expected[] = {
+    'L', 'B', 'S', 'Y', SYNC_VERSION, AnimEffect::Solid, 1, 0,
+    0x04, 0x03, 0x02, 0x01,
+    0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11,
+    1,
+  };
+  TEST_ASSERT_EQUAL_MEMORY(expected, &beacon, sizeof(expected));
+  TEST_ASSERT_TRUE(sync_beacon_valid(beacon, len));
+
+  // Anything cut short, or from another program or version, is dropped.
+  TEST_ASSERT_FALSE(sync_beacon_valid(beacon, len - 1));
+  TEST_ASSERT_FALSE(sync_beacon_valid(beacon, SYNC_BEACON_HEADER_BYTES - 1));
+  SyncBeacon other = beacon;
+  other.magic[3] = 'Z';
+  TEST_ASSERT_FALSE(sync_beacon_valid(other, len));
+  other = beacon;
+  other.version++;
+  TEST_ASSERT_FALSE(sync_beacon_valid(other, len));
+}
+
+// What the leader sends, one beacon per interval.
+void test_leader_beacons() {
+  leader_mgr.set_effect(AnimEffect::Wave);
+  while (sniffer.parsePacket() > 0) {}
+
+  run_ms(SYNC_BEACON_INTERVAL_MS * 4);
+
+  uint32_t count = 0;
+  uint32_t last_seq = 0;
+  SyncBeacon beacon;
+  while (sniffer.parsePacket() > 0) {
+    const int len = sniffer.read((uint8_t *)&beacon, sizeof(beacon));
+    TEST_ASSERT_TRUE(sync_beacon_valid(beacon, len));
+    TEST_ASSERT_EQUAL_INT(AnimEffect::Wave, beacon.effect);
+    TEST_ASSERT_EQUAL_UINT8(12, beacon.state_len);
+    if (count > 0) {
+      TEST_ASSERT_EQUAL_UINT32(last_seq + 1, beacon.seq);
+    }
+    last_seq = beacon.seq;
+    count++;
+  }
+  TEST_ASSERT_EQUAL_UINT32(4, count);
+
+  // Stamped with the leader's clock, when it was sent.
+  TEST_ASSERT_INT64_WITHIN(2 * SYNC_BEACON_INTERVAL_MS * 1000, leader_clock.now_us(), beacon.leader_us);
+}
+
+void test_follower_converges() {
+  leader_mgr.set_effect(AnimEffect::Solid);
+  follower_mgr.set_effect(AnimEffect::Hue);
+  leader_mgr.click();
+  leader_mgr.click();
+
+  run_ms(SYNC_BEACON_INTERVAL_MS * 2);
+  assert_followed();
+
+  // Effects whose state depends on when they started.
+  leader_mgr.set_effect(AnimEffect::Wave);
+  run_ms(SYNC_BEACON_INTERVAL_MS * 2);
+  assert_followed();
+
+  // And stays in sync, well past the estimator's first windows.
+  run_ms(60 * 1000);
+  assert_followed();
+}
+
+void test_follower_ignores_bad_beacons() {
+  leader_mgr.set_effect(AnimEffect::Solid);
+  run_ms(SYNC_BEACON_INTERVAL_MS * 2);
+
+  // Would take the follower's clock 10s ahead.
+  SyncBeacon beacon;
+  const size_t len = sync_beacon_encode(beacon, 0, AnimEffect::Wave, leader_mgr.get_animation());
+  beacon.leader_us = leader_clock.now_us() + 10 * 1000000;
+
+  SyncBeacon bad = beacon;
+  bad.magic[0] = 'X';
+  send_raw(&bad, len);
+  bad = beacon;
+  bad.version = SYNC_VERSION + 1;
+  send_raw(&bad, len);
+  bad = beacon;
+  bad.state_len = SYNC_MAX_STATE_BYTES;
+  send_raw(&bad, len);
+  send_raw(&beacon, SYNC_BEACON_HEADER_BYTES - 1);
+
+  // Delivered, but none of them taken.
+  native_advance_us(NETWORK_LATENCY_US);
+  follower.handle();
+  TEST_ASSERT_EQUAL_INT(AnimEffect::Solid, follower_mgr.get_effect());
+  TEST_ASSERT_INT64_WITHIN(1000, -NETWORK_LATENCY_US, clock_error_us());
+}
+
+int main(int argc, char **argv) {
+  native_udp_latency_us = NETWORK_LATENCY_US;
+  native_advance_us(1000000);
+  // Locked from the start with an offset, the leader's clock only reads
+  // further ahead.
+  const uint64_t local_us = leader_clock.local_us();
+  leader_clock.get_estimator()->add_sample(local_us + LEADER_AHEAD_US, local_us);
+
+  leader_mgr.begin();
+  follower_mgr.begin();
+  leader.begin(&leader_mgr, &leader_clock);
+  follower.begin(&follower_mgr);
+  sniffer.beginMulticast(WiFi.localIP(), SYNC_MULTICAST_ADDRESS, SYNC_PORT);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_beacon_encoding);
+  RUN_TEST(test_leader_beacons);
+  RUN_TEST(test_follower_converges);
+  RUN_TEST(test_follower_ignores_bad_beacons);
+  return UNITY_END();
+}
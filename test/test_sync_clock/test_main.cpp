@@ -0,0 +1,207 @@
+#include <Arduino.h>
+
+#include "NativeTest.h"
+#include "SyncClock.h"
+
+// Time simulated for each run, long enough for the drift loop to settle.
+#define SIM_DURATION_US (20LL * 60 * 1000000)
+// Residual offset measured over the last SIM_SETTLED_US of each run.
+#define SIM_SETTLED_US (5LL * 60 * 1000000)
+// Same as SYNC_BEACON_INTERVAL_MS in LedSync.h. These runs only exercise the
+// estimator; test_sync runs LedSync itself, leader and follower.
+#define SIM_BEACON_INTERVAL_US (250 * 1000LL)
+
+/**
+ * A follower's crystal: its local clock reads `start_us` when the leader's
+ * reads 0 and runs `drift_ppm` fast.
+ */
+struct SimFollower {
+  int64_t start_us;
+  int32_t drift_ppm;
+  ClockEstimator estimator;
+
+  int64_t local_at(int64_t reference_us) const {
+    return start_us + reference_us + reference_us * drift_ppm / 1000000;
+  }
+};
+
+/**
+ * Network delay between the leader taking its timestamp and a follower
+ * reading the beacon: mostly a few ms, sometimes stuck behind other traffic
+ * for a lot longer. Seeded so runs are reproducible.
+ */
+class SimNetwork {
+public:
+  explicit SimNetwork(uint32_t seed) : state(seed) {}
+
+  int64_t delay_us() {
+    const uint32_t r = next();
+    if (r % 16 == 0) return 20000 + next() % 60000;
+    return 500 + next() % 4000;
+  }
+
+private:
+  uint32_t state;
+
+  uint32_t next() {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+  }
+};
+
+struct SimResult {
+  int64_t max_error_us;
+  int64_t max_spread_us;
+};
+
+/**
+ * Runs the leader and `count` followers for SIM_DURATION_US of reference
+ * time and returns the largest error of any follower's estimate of the
+ * reference time, and the largest difference between two followers, once
+ * settled.
+ */
+static SimResult simulate(SimFollower *followers, size_t count, uint32_t seed) {
+  SimNetwork network(seed);
+  SimResult result = { 0, 0 };
+
+  for (int64_t t = 0; t < SIM_DURATION_US; t += SIM_BEACON_INTERVAL_US) {
+    for (size_t i = 0; i < count; i++) {
+      followers[i].estimator.add_sample(t, followers[i].local_at(t + network.delay_us()));
+    }
+
+    if (t < SIM_DURATION_US - SIM_SETTLED_US) continue;
+
+    // Check half way between two beacons, where the estimate is the oldest.
+    const int64_t check_us = t + SIM_BEACON_INTERVAL_US / 2;
+    int64_t lowest = INT64_MAX, highest = INT64_MIN;
+    for (size_t i = 0; i < count; i++) {
+      TEST_ASSERT_TRUE(followers[i].estimator.is_locked());
+      const int64_t estimate = followers[i].estimator.to_reference(followers[i].local_at(check_us));
+      const int64_t error = estimate - check_us;
+      result.max_error_us = std::max(result.max_error_us, error < 0 ? -error : error);
+      lowest = std::min(lowest, estimate);
+      highest = std::max(highest, estimate);
+    }
+    result.max_spread_us = std::max(result.max_spread_us, highest - lowest);
+  }
+  return result;
+}
+
+static void report(const char *name, const SimResult &result) {
+  char msg[96];
+  snprintf(msg, sizeof(msg), "%s: max error %lld us, max spread %lld us",
+           name, (long long)result.max_error_us, (long long)result.max_spread_us);
+  TEST_MESSAGE(msg);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_locks_on_first_sample() {
+  ClockEstimator estimator;
+  TEST_ASSERT_FALSE(estimator.is_locked());
+  TEST_ASSERT_EQUAL_INT64(1234, estimator.to_reference(1234));
+
+  estimator.add_sample(1000000, 5000);
+  TEST_ASSERT_TRUE(estimator.is_locked());
+  TEST_ASSERT_EQUAL_INT64(1000000, estimator.to_reference(5000));
+}
+
+void test_no_drift_no_delay() {
+  SimFollower followers[] = {
+    { 3000000, 0 },
+    { -7000000, 0 },
+  };
+
+  for (int64_t t = 0; t < SIM_DURATION_US; t += SIM_BEACON_INTERVAL_US) {
+    for (SimFollower &f : followers) {
+      f.estimator.add_sample(t, f.local_at(t));
+    }
+  }
+  for (SimFollower &f : followers) {
+    TEST_ASSERT_EQUAL_INT64(SIM_DURATION_US, f.estimator.to_reference(f.local_at(SIM_DURATION_US)));
+    TEST_ASSERT_EQUAL_INT32(0, f.estimator.get_drift_ppb());
+  }
+}
+
+void test_followers_converge_under_drift_and_delay() {
+  // Typical crystals, one of them at the edge of its tolerance.
+  SimFollower followers[] = {
+    { 1500000, 20 },
+    { -40000000, -35 },
+    { 250000000, 50 },
+  };
+
+  const SimResult result = simulate(followers, 3, 42);
+  report("3 followers", result);
+
+  // Delays only make samples late and the window keeps the earliest of 8,
+  // so what's left is the few ms of delay the best sample still had.
+  TEST_ASSERT_INT64_WITHIN(5000, 0, result.max_error_us);
+  TEST_ASSERT_TRUE(result.max_spread_us <= 5000);
+
+  // A follower running fast is slowed down, one running slow sped up. The
+  // learned drift jitters by a few tens of ppm with the delay of the samples
+  // it's learned from.
+  for (SimFollower &f : followers) {
+    TEST_ASSERT_INT32_WITHIN(25000, -f.drift_ppm * 1000, f.estimator.get_drift_ppb());
+  }
+}
+
+void test_residual_offset_across_seeds() {
+  for (uint32_t seed = 1; seed <= 8; seed++) {
+    SimFollower followers[] = {
+      { (int64_t)seed * 1000000, (int32_t)seed * 6 - 25 },
+      { -(int64_t)seed * 3000000, 25 - (int32_t)seed * 6 },
+    };
+
+    const SimResult result = simulate(followers, 2, seed);
+    TEST_ASSERT_INT64_WITHIN(5000, 0, result.max_error_us);
+    TEST_ASSERT_TRUE(result.max_spread_us <= 5000);
+  }
+}
+
+void test_steps_when_leader_jumps() {
+  SimFollower follower = { 0, 30 };
+  SimNetwork network(7);
+
+  int64_t t = 0;
+  for (; t < SIM_DURATION_US / 4; t += SIM_BEACON_INTERVAL_US) {
+    follower.estimator.add_sample(t, follower.local_at(t + network.delay_us()));
+  }
+
+  // Leader rebooted: its clock restarts from 0 while ours keeps going. The
+  // window the reboot falls in still measures the old clock, the next one
+  // steps to the new one.
+  const int64_t jump_us = t;
+  for (int i = 0; i < 2 * SYNC_WINDOW_SAMPLES; i++, t += SIM_BEACON_INTERVAL_US) {
+    follower.estimator.add_sample(t - jump_us, follower.local_at(t + network.delay_us()));
+  }
+
+  const int64_t error = follower.estimator.to_reference(follower.local_at(t)) - (t - jump_us);
+  TEST_ASSERT_INT64_WITHIN(SYNC_STEP_THRESHOLD_US, 0, error);
+}
+
+void test_local_us_extends_micros() {
+  SyncClock clock;
+  native_micros = 0xfffff000u;
+  TEST_ASSERT_EQUAL_UINT64(0xfffff000ull, clock.local_us());
+
+  native_advance_us(0x2000);
+  TEST_ASSERT_EQUAL_UINT64(0x100001000ull, clock.local_us());
+
+  native_advance_us(0x1000);
+  TEST_ASSERT_EQUAL_UINT64(0x100002000ull, clock.local_us());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_locks_on_first_sample);
+  RUN_TEST(test_no_drift_no_delay);
+  RUN_TEST(test_followers_converge_under_drift_and_delay);
+  RUN_TEST(test_residual_offset_across_seeds);
+  RUN_TEST(test_steps_when_leader_jumps);
+  RUN_TEST(test_local_us_extends_micros);
+  return UNITY_END();
+}
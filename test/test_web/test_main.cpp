@@ -0,0 +1,314 @@
+#define NUM_LEDS 60
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <LittleFS.h>
+
+#include "NativeTest.h"
+#include "LedWeb.h"
+
+// Requests made up by the fuzzer, mostly mutations of the valid ones below.
+#define FUZZ_ITERATIONS 50000
+#define FUZZ_MAX_BODY_BYTES 300
+
+typedef LedApiOps<LedWeb> Ops;
+
+static LedManager led_mgr;
+static LedWeb web;
+
+// A typical request for every op.
+static const char *requests[] = {
+  "{\"op\":\"fill_solid\",\"color\":[255,128,0],\"range_start\":10,\"range_size\":20}",
+  "{\"op\":\"fill_gradient\",\"space\":\"hsv\",\"colors\":[[0,255,255],[96,255,255],[160,255,255],[224,255,255]]}",
+  "{\"op\":\"fill_rainbow\",\"initial_hue\":32,\"hue_step\":512}",
+  "{\"op\":\"status\"}",
+  "{\"op\":\"reboot\"}",
+  "{\"op\":\"set_brightness\",\"value\":128}",
+  "{\"op\":\"set_param\",\"name\":\"cooling\",\"value\":80}",
+  "{\"op\":\"heap_stats\"}",
+};
+
+#define OP_COUNT (sizeof(Ops::OPS) / sizeof(Ops::OPS[0]))
+static_assert(sizeof(requests) / sizeof(requests[0]) == OP_COUNT, "One request per op");
+
+/**
+ * Serves one request the way the device does: the server hands it to
+ * LedWeb from its loop. Returns the status code sent, 0 if there was none.
+ */
+static int serve(HTTPMethod method, const char *uri, const char *body = nullptr) {
+  native_http(method, uri, body);
+  web.handle();
+  return native_http_response.code;
+}
+
+/**
+ * Whether the API must accept `body`: it parses, names an op and matches the
+ * op's schema. Parsed separately from LedWeb, into a copy of the body.
+ */
+static bool is_valid_request(const char *body, size_t len) {
+  static StaticJsonDocument<JSON_BUFFER_CAPACITY_BYTES> doc;
+  static char copy[FUZZ_MAX_BODY_BYTES + 1];
+  memcpy(copy, body, len);
+  copy[len] = '\0';
+
+  if (deserializeJson(doc, copy, len)) return false;
+  const ApiOp<Ops::Handler> *op = Ops::find(doc["op"]);
+  return op != nullptr && api_validate(doc.as<JsonObjectConst>(), *op) == nullptr;
+}
+
+// Seeded so that a failure can be reproduced.
+static uint32_t fuzz_state = 1;
+
+static uint32_t fuzz_next() {
+  fuzz_state = fuzz_state * 1664525u + 1013904223u;
+  return fuzz_state >> 8;
+}
+
+// Bytes JSON cares about are picked more often than the others.
+static char fuzz_byte() {
+  static const char json_bytes[] = "{}[]\",:0123456789-.eE \\truefalsnl";
+  if (fuzz_next() % 4 == 0) return (char)(1 + fuzz_next() % 255);
+  return json_bytes[fuzz_next() % (sizeof(json_bytes) - 1)];
+}
+
+// Makes up a request body in `body`: random bytes, or a valid request with
+// a few bytes changed, inserted, removed or cut off.
+static size_t fuzz_body(char *body) {
+  if (fuzz_next() % 8 == 0) {
+    const size_t len = fuzz_next() % FUZZ_MAX_BODY_BYTES;
+    for (size_t i = 0; i < len; i++) {
+      body[i] = fuzz_byte();
+    }
+    body[len] = '\0';
+    return len;
+  }
+
+  const char *request = requests[fuzz_next() % OP_COUNT];
+  size_t len = strlen(request);
+  memcpy(body, request, len);
+
+  for (uint32_t mutations = 1 + fuzz_next() % 4; mutations > 0 && len > 0; mutations--) {
+    const size_t pos = fuzz_next() % len;
+    switch (fuzz_next() % 4) {
+      case 0:
+        body[pos] = fuzz_byte();
+        break;
+      case 1:
+        if (len < FUZZ_MAX_BODY_BYTES) {
+          memmove(&body[pos + 1], &body[pos], len - pos);
+          body[pos] = fuzz_byte();
+          len++;
+        }
+        break;
+      case 2:
+        memmove(&body[pos], &body[pos + 1], len - pos - 1);
+        len--;
+        break;
+      case 3:
+        len = pos;
+        break;
+    }
+  }
+  body[len] = '\0';
+  return len;
+}
+
+void setUp() {
+  LittleFS.format();
+  native_wifi_status = WL_CONNECTED;
+}
+
+void tearDown() {}
+
+void test_every_op_is_served() {
+  for (size_t i = 0; i < OP_COUNT; i++) {
+    const uint32_t restarts = ESP.restarts;
+    // Heat based effects are the ones with a "cooling" parameter.
+    led_mgr.set_effect(AnimEffect::Fire);
+
+    TEST_ASSERT_EQUAL_INT(200, serve(HTTP_POST, "/api", requests[i]));
+    TEST_ASSERT_EQUAL_STRING("application/json", native_http_response.content_type.c_str());
+    TEST_ASSERT_EQUAL_UINT32(strcmp(Ops::OPS[i].name, "reboot") == 0 ? restarts + 1 : restarts, ESP.restarts);
+  }
+
+  TEST_ASSERT_EQUAL_UINT8(128, led_mgr.get_control()->get_brightness());
+  TEST_ASSERT_EQUAL_INT(200, serve(HTTP_POST, "/api", "{\"op\":\"status\"}"));
+  TEST_ASSERT_NOT_NULL(strstr(native_http_response.content.c_str(), "\"brightness\":128"));
+}
+
+void test_bad_requests() {
+  static const char *bad[] = {
+    "", "{", "[]", "null", "{}", "{\"op\":12}", "{\"op\":\"no_such_op\"}",
+    "{\"op\":\"set_brightness\"}",
+    "{\"op\":\"fill_solid\",\"color\":[1,2,3],\"range_start\":60}",
+    // Valid for the schema, refused by the handler.
+    "{\"op\":\"fill_gradient\",\"space\":\"xyz\",\"colors\":[[0,0,0],[1,1,1]]}",
+  };
+
+  for (const char *body : bad) {
+    TEST_ASSERT_EQUAL_INT(400, serve(HTTP_POST, "/api", body));
+  }
+  // No body at all.
+  TEST_ASSERT_EQUAL_INT(400, serve(HTTP_POST, "/api"));
+}
+
+/**
+ * Random and mutated bodies through LedWeb::handle_api_request(): nothing
+ * crashes (run it with -fsanitize=address,undefined to catch more than
+ * segfaults), every request gets an answer, and requests the API doesn't
+ * accept get a 400.
+ */
+void test_fuzz_api() {
+  static char body[FUZZ_MAX_BODY_BYTES + 1];
+  uint32_t accepted = 0;
+
+  for (uint32_t i = 0; i < FUZZ_ITERATIONS; i++) {
+    const size_t len = fuzz_body(body);
+    const bool valid = is_valid_request(body, len);
+
+    const int code = serve(HTTP_POST, "/api", body);
+    if (!valid) {
+      TEST_ASSERT_EQUAL_INT_MESSAGE(400, code, body);
+    } else {
+      TEST_ASSERT_TRUE_MESSAGE(code == 200 || code == 400, body);
+      accepted += code == 200;
+    }
+  }
+
+  char msg[64];
+  snprintf(msg, sizeof(msg), "%u of %u requests accepted", accepted, FUZZ_ITERATIONS);
+  TEST_MESSAGE(msg);
+  // Mutations leave a fair share of requests valid, so handlers ran too.
+  TEST_ASSERT_GREATER_THAN_UINT32(FUZZ_ITERATIONS / 50, accepted);
+}
+
+// Pages are only stored gzipped (see serve_page()).
+void test_page_encoding() {
+  const HtmlPage &page = HTML_PAGES[0];
+
+  native_http(HTTP_GET, page.path).headers.push_back({ "Accept-Encoding", "gzip, deflate" });
+  web.handle();
+  TEST_ASSERT_EQUAL_INT(200, native_http_response.code);
+  TEST_ASSERT_EQUAL_STRING("gzip", native_http_header("Content-Encoding")->c_str());
+  TEST_ASSERT_EQUAL_UINT32(page.length, native_http_response.content_length);
+  TEST_ASSERT_EQUAL_UINT32(page.length, native_http_response.content.length());
+  TEST_ASSERT_EQUAL_MEMORY(page.content, native_http_response.content.c_str(), page.length);
+
+  // Without the header any encoding will do.
+  TEST_ASSERT_EQUAL_INT(200, serve(HTTP_GET, page.path));
+
+  native_http(HTTP_GET, page.path).headers.push_back({ "Accept-Encoding", "identity" });
+  web.handle();
+  TEST_ASSERT_EQUAL_INT(406, native_http_response.code);
+  TEST_ASSERT_NULL(native_http_header("Content-Encoding"));
+
+  native_http(HTTP_GET, page.path).headers.push_back({ "If-None-Match", page.etag });
+  web.handle();
+  TEST_ASSERT_EQUAL_INT(304, native_http_response.code);
+}
+
+static std::vector<uint8_t> make_sequence(const CRGB &color) {
+  CRGB leds[NUM_LEDS];
+  std::fill_n(leds, NUM_LEDS, color);
+
+  SequenceWriter writer;
+  TEST_ASSERT_TRUE(writer.open("/made.lbs", NUM_LEDS, 2));
+  TEST_ASSERT_TRUE(writer.write_frame(leds, 100));
+  TEST_ASSERT_TRUE(writer.write_frame(leds, 100));
+  writer.close();
+
+  File file = LittleFS.open("/made.lbs", "r");
+  std::vector<uint8_t> data(file.size());
+  file.read(data.data(), data.size());
+  LittleFS.remove("/made.lbs");
+  return data;
+}
+
+static int upload(const std::vector<uint8_t> &data) {
+  NativeHttpRequest &request = native_http(HTTP_POST, "/sequence");
+  request.has_upload = true;
+  request.upload = data;
+  web.handle();
+  return native_http_response.code;
+}
+
+static std::vector<uint8_t> stored_sequence() {
+  File file = LittleFS.open(SEQUENCE_PATH, "r");
+  std::vector<uint8_t> data(file ? file.size() : 0);
+  file.read(data.data(), data.size());
+  return data;
+}
+
+void test_sequence_upload() {
+  const std::vector<uint8_t> red = make_sequence(CRGB::Red);
+  const std::vector<uint8_t> blue = make_sequence(CRGB::Blue);
+
+  led_mgr.set_effect(AnimEffect::Fire);
+  TEST_ASSERT_EQUAL_INT(200, upload(red));
+  TEST_ASSERT_EQUAL_INT8(AnimEffect::Sequence, led_mgr.get_effect());
+  TEST_ASSERT_TRUE(red == stored_sequence());
+
+  // Replaces the sequence that's playing.
+  TEST_ASSERT_EQUAL_INT(200, upload(blue));
+  TEST_ASSERT_TRUE(blue == stored_sequence());
+  TEST_ASSERT_FALSE(LittleFS.exists(SEQUENCE_UPLOAD_PATH));
+  TEST_ASSERT_FALSE(LittleFS.exists(SEQUENCE_BACKUP_PATH));
+
+  // Not a sequence: what was there stays, and so does the effect.
+  led_mgr.set_effect(AnimEffect::Fire);
+  TEST_ASSERT_EQUAL_INT(400, upload(std::vector<uint8_t>(100, 0x42)));
+  TEST_ASSERT_EQUAL_INT8(AnimEffect::Fire, led_mgr.get_effect());
+  TEST_ASSERT_TRUE(blue == stored_sequence());
+  TEST_ASSERT_FALSE(LittleFS.exists(SEQUENCE_UPLOAD_PATH));
+
+  // The client went away half way.
+  NativeHttpRequest &request = native_http(HTTP_POST, "/sequence");
+  request.has_upload = true;
+  request.upload = red;
+  request.upload_aborted = true;
+  web.handle();
+  TEST_ASSERT_EQUAL_INT(500, native_http_response.code);
+  TEST_ASSERT_EQUAL_INT8(AnimEffect::Fire, led_mgr.get_effect());
+  TEST_ASSERT_TRUE(blue == stored_sequence());
+}
+
+/**
+ * Time to serve a typical request for every op, through the server: parsed,
+ * looked up, validated and run by its handler.
+ */
+void test_bench_api_requests() {
+  for (size_t i = 0; i < OP_COUNT; i++) {
+    // Waits a second before restarting.
+    if (strcmp(Ops::OPS[i].name, "reboot") == 0) continue;
+
+    led_mgr.set_effect(AnimEffect::Fire);
+    TEST_ASSERT_EQUAL_INT(200, serve(HTTP_POST, "/api", requests[i]));
+    // The body is parsed in place, so it's queued again every time.
+    const double ns = bench_ns(5000, [&]() {
+      serve(HTTP_POST, "/api", requests[i]);
+    });
+
+    char label[48];
+    snprintf(label, sizeof(label), "%s served", Ops::OPS[i].name);
+    bench_report(label, ns, "request");
+
+    // Requests are served between two frames.
+    TEST_ASSERT_LESS_THAN(NATIVE_FRAME_BUDGET_NS / 4 / NATIVE_HOST_SPEEDUP, ns);
+  }
+}
+
+int main(int argc, char **argv) {
+  led_mgr.begin();
+  web.begin(&led_mgr);
+  // Connects, and sets the server up.
+  web.handle();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_every_op_is_served);
+  RUN_TEST(test_bad_requests);
+  RUN_TEST(test_fuzz_api);
+  RUN_TEST(test_page_encoding);
+  RUN_TEST(test_sequence_upload);
+  RUN_TEST(test_bench_api_requests);
+  return UNITY_END();
+}
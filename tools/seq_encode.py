@@ -0,0 +1,270 @@
+#!/usr/bin/env python3
+"""
+Encodes a sequence of frames into the ledbox sequence format (see
+src/LedSequence.h) and reports how well it compressed.
+
+Frames can be provided either as raw RGB24 data (`--num-leds` pixels per frame,
+frames back to back) or as JSON: a list where every entry is either a list of
+"#rrggbb" colors or an object {"duration": ms, "leds": [...]}.
+
+    python3 tools/seq_encode.py show.json -o show.lbs
+    python3 tools/seq_encode.py show.rgb --num-leds 60 --fps 60 -o show.lbs
+    python3 tools/seq_encode.py --bench show.lbs
+
+--bench times the Python decoder, which only says how the file compressed.
+For the decoding speed of the firmware, run its decoder natively on the file:
+
+    SEQUENCE_BENCH_FILE=$PWD/show.lbs pio test -e native -f test_sequence
+
+Upload the result with:
+
+    curl -F "file=@show.lbs" http://ledbox.local/sequence
+"""
+
+import argparse
+import json
+import struct
+import sys
+import time
+from pathlib import Path
+
+MAGIC = b"LBSQ"
+VERSION = 1
+HEADER = struct.Struct("<4sBBHI")
+FRAME_HEADER = struct.Struct("<BH")
+
+FLAG_KEYFRAME = 0x01
+
+OP_SKIP = 0x00
+OP_RUN = 0x40
+OP_LITERAL = 0x80
+OP_MASK = 0xC0
+OP_MAX_COUNT = 64
+
+BLACK = (0, 0, 0)
+
+
+def parse_color(value):
+    value = value.lstrip("#")
+    return (int(value[0:2], 16), int(value[2:4], 16), int(value[4:6], 16))
+
+
+def load_json(path, frame_ms):
+    frames = []
+    for entry in json.loads(Path(path).read_text()):
+        if isinstance(entry, dict):
+            duration = entry.get("duration", frame_ms)
+            leds = entry["leds"]
+        else:
+            duration = frame_ms
+            leds = entry
+        frames.append((duration, [parse_color(c) for c in leds]))
+    return frames
+
+
+def load_raw(path, num_leds, frame_ms):
+    data = Path(path).read_bytes()
+    frame_size = num_leds * 3
+    if len(data) % frame_size:
+        raise ValueError("raw input is not a whole number of %d-led frames" % num_leds)
+
+    frames = []
+    for off in range(0, len(data), frame_size):
+        chunk = data[off:off + frame_size]
+        frames.append((frame_ms, [tuple(chunk[i:i + 3]) for i in range(0, frame_size, 3)]))
+    return frames
+
+
+def frame_durations(count, fps):
+    """
+    Per-frame durations in whole ms whose running total tracks the exact
+    frame rate (e.g. 60fps becomes 17, 17, 16, 17, 17, 16...).
+    """
+    durations = []
+    elapsed = 0
+    for i in range(1, count + 1):
+        target = round(i * 1000 / fps)
+        durations.append(target - elapsed)
+        elapsed = target
+    return durations
+
+
+def encode_ops(pixels, prev):
+    """
+    Encodes a frame as a list of ops. When `prev` is None the frame is a
+    keyframe and skipped pixels are black.
+    """
+    out = bytearray()
+    n = len(pixels)
+
+    def skippable(i):
+        return pixels[i] == (BLACK if prev is None else prev[i])
+
+    def run_length(i):
+        j = i + 1
+        while j < n and j - i < OP_MAX_COUNT and pixels[j] == pixels[i]:
+            j += 1
+        return j - i
+
+    i = 0
+    while i < n:
+        if skippable(i):
+            j = i + 1
+            while j < n and j - i < OP_MAX_COUNT and skippable(j):
+                j += 1
+            out.append(OP_SKIP | (j - i - 1))
+            i = j
+            continue
+
+        run = run_length(i)
+        if run >= 2:
+            out.append(OP_RUN | (run - 1))
+            out.extend(pixels[i])
+            i += run
+            continue
+
+        # Literal: stop as soon as something cheaper can take over.
+        j = i + 1
+        while j < n and j - i < OP_MAX_COUNT and not skippable(j) and run_length(j) < 3:
+            j += 1
+        out.append(OP_LITERAL | (j - i - 1))
+        for p in pixels[i:j]:
+            out.extend(p)
+        i = j
+
+    return bytes(out)
+
+
+def encode(frames, keyframe_interval):
+    num_leds = len(frames[0][1])
+    out = bytearray(HEADER.pack(MAGIC, VERSION, 0, num_leds, len(frames)))
+
+    prev = None
+    since_keyframe = 0
+    for duration, pixels in frames:
+        if len(pixels) != num_leds:
+            raise ValueError("all frames must have the same number of leds")
+        if not 0 < duration <= 0xFFFF:
+            raise ValueError("frame duration out of range: %d" % duration)
+
+        key = encode_ops(pixels, None)
+        if prev is None or since_keyframe >= keyframe_interval:
+            flags, ops = FLAG_KEYFRAME, key
+        else:
+            delta = encode_ops(pixels, prev)
+            # Prefer keyframes whenever they're not larger: they're cheaper
+            # to decode and make the stream more robust.
+            if len(key) <= len(delta):
+                flags, ops = FLAG_KEYFRAME, key
+            else:
+                flags, ops = 0, delta
+
+        since_keyframe = 0 if flags & FLAG_KEYFRAME else since_keyframe + 1
+        out.extend(FRAME_HEADER.pack(flags, duration))
+        out.extend(ops)
+        prev = pixels
+
+    return bytes(out)
+
+
+def decode(data):
+    """
+    Reference decoder, mirrors SequenceReader::next_frame(). Yields
+    (duration, pixels, keyframe) tuples.
+    """
+    magic, version, _, num_leds, frame_count = HEADER.unpack_from(data, 0)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a ledbox sequence")
+
+    pos = HEADER.size
+    pixels = [BLACK] * num_leds
+    for _ in range(frame_count):
+        flags, duration = FRAME_HEADER.unpack_from(data, pos)
+        pos += FRAME_HEADER.size
+        keyframe = bool(flags & FLAG_KEYFRAME)
+
+        led = 0
+        while led < num_leds:
+            ctrl = data[pos]
+            pos += 1
+            count = (ctrl & ~OP_MASK & 0xFF) + 1
+            op = ctrl & OP_MASK
+            if op == OP_SKIP:
+                if keyframe:
+                    pixels[led:led + count] = [BLACK] * count
+            elif op == OP_RUN:
+                pixels[led:led + count] = [tuple(data[pos:pos + 3])] * count
+                pos += 3
+            elif op == OP_LITERAL:
+                for k in range(count):
+                    pixels[led + k] = tuple(data[pos:pos + 3])
+                    pos += 3
+            else:
+                raise ValueError("invalid op 0x%02x" % ctrl)
+            led += count
+
+        yield duration, list(pixels), keyframe
+
+
+def bench(data, frames=None):
+    _, _, _, num_leds, frame_count = HEADER.unpack_from(data, 0)
+
+    start = time.perf_counter()
+    decoded = list(decode(data))
+    elapsed = time.perf_counter() - start
+
+    keyframes = sum(1 for _, _, key in decoded if key)
+    payload = len(data) - HEADER.size
+    print("leds:            %d" % num_leds)
+    print("frames:          %d (%d keyframes)" % (frame_count, keyframes))
+    print("size:            %d bytes (raw: %d bytes, %.1f%%)" % (
+        len(data), frame_count * num_leds * 3, 100.0 * len(data) / (frame_count * num_leds * 3)))
+    print("bytes/frame:     %.1f" % (payload / frame_count))
+    print("decode (python): %.0f frames/s" % (frame_count / elapsed))
+
+    if frames is not None:
+        for idx, ((duration, pixels), (d_duration, d_pixels, _)) in enumerate(zip(frames, decoded)):
+            if duration != d_duration or pixels != d_pixels:
+                raise AssertionError("round trip mismatch at frame %d" % idx)
+        print("round trip:      ok")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="frames (.json or raw RGB24), or a .lbs file with --bench")
+    parser.add_argument("-o", "--output", help="output .lbs file")
+    parser.add_argument("--num-leds", type=int, help="leds per frame for raw RGB24 input")
+    parser.add_argument("--fps", type=float, default=60, help="frame rate for frames without a duration")
+    parser.add_argument("--keyframe-interval", type=int, default=60, help="max frames between keyframes")
+    parser.add_argument("--bench", action="store_true", help="decode the input/output and report stats")
+    args = parser.parse_args()
+
+    if args.bench and args.input.endswith(".lbs"):
+        bench(Path(args.input).read_bytes())
+        return 0
+
+    # Frames without an explicit duration are timed from --fps afterwards.
+    if args.input.endswith(".json"):
+        frames = load_json(args.input, None)
+    else:
+        if not args.num_leds:
+            parser.error("--num-leds is required for raw input")
+        frames = load_raw(args.input, args.num_leds, None)
+
+    if not frames:
+        parser.error("no frames in input")
+
+    durations = frame_durations(len(frames), args.fps)
+    frames = [(d if d is not None else durations[i], p) for i, (d, p) in enumerate(frames)]
+
+    data = encode(frames, args.keyframe_interval)
+    if args.output:
+        Path(args.output).write_bytes(data)
+    if args.bench or not args.output:
+        bench(data, frames)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())